@@ -0,0 +1,783 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "ofc/types.h"
+#include "ofc/framework.h"
+#include "ofc/libc.h"
+#include "ofc/heap.h"
+#include "ofc/file.h"
+#include "ofc/thread.h"
+
+#include "of_core_fs_pipe/fs_pipe.h"
+
+/**
+ * \defgroup pipe_bench Pipe File System Benchmarks
+ *
+ * Drives the pipe handler through the ofc file API.  Each measurement
+ * is printed as one line of key=value pairs.
+ *
+ *   fs_pipe_bench contention [max_pairs] [messages] [size]
+ *   fs_pipe_bench coalesce [messages] [size]
+ *   fs_pipe_bench transact [calls] [size] [spin]
+ *   fs_pipe_bench sweep [max_pairs] [max_size] [max_threads] [mb]
+ *   fs_pipe_bench shm [calls] [size]
+ *
+ * contention: streams messages over 1, 2, 4 ... max_pairs independent
+ * pipe pairs with one writer and one reader thread per pair.  With per
+ * pipe locking, aggregate throughput should scale with the number of
+ * pairs until the cores are saturated.
+ *
+ * coalesce: queues small messages on a pipe and drains them with large
+ * reads, once in message mode and once in byte mode, reporting how many
+ * ReadFile calls each needed per megabyte.
+ *
+ * transact: one client issues TransactNamedPipe calls against a server
+ * thread that echoes each request, reporting round trip latency
+ * percentiles in microseconds.  A non zero spin count lets readers
+ * poll before blocking and the share of waits that spinning saved is
+ * reported.
+ *
+ * sweep: for stream and transact traffic, runs every combination of
+ * message size (64 bytes to max_size by fours), pipe pairs (1 to
+ * max_pairs by fours) and client threads (1 to max_threads by fours,
+ * never more than there are pairs).  Each pair has its own server
+ * thread and the client threads share the pairs between them.  A run
+ * moves about mb megabytes in all.  Stream latency is the time a
+ * WriteFile takes and transact latency the round trip.  Runs whose
+ * buffers would need more than 64 MB are skipped.
+ *
+ * shm: forks a server process and measures TransactNamedPipe round
+ * trips to it over a shared pipe, then the same echo over an AF_UNIX
+ * socket for comparison.  Needs the library built with
+ * OFC_FS_PIPE_SHARED_MEMORY.
+ */
+
+/** \{ */
+
+typedef struct
+{
+  OFC_INT index ;
+  OFC_INT messages ;
+  OFC_INT size ;
+} BENCH_PAIR ;
+
+static double bench_now (OFC_VOID)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return ((double) ts.tv_sec + (double) ts.tv_nsec / 1e9) ;
+}
+
+static OFC_LPTSTR bench_pipe_name (OFC_CCHAR *prefix, OFC_INT index)
+{
+  OFC_CHAR name[64] ;
+
+  ofc_snprintf (name, sizeof (name), "IPC:/%s_%d", prefix, index) ;
+  return (ofc_cstr2tstr (name)) ;
+}
+
+static OFC_HANDLE bench_open_client (OFC_LPCTSTR name)
+{
+  OFC_HANDLE hFile ;
+  /*
+   * The server may not have registered its instance yet
+   */
+  for (hFile = OFC_HANDLE_NULL ; hFile == OFC_HANDLE_NULL ; )
+    {
+      hFile = OfcCreateFile (name, OFC_GENERIC_READ | OFC_GENERIC_WRITE,
+			     OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			     OFC_NULL, OFC_OPEN_EXISTING, 0, OFC_HANDLE_NULL) ;
+      if (hFile == OFC_HANDLE_NULL)
+	ofc_sleep (1) ;
+    }
+  return (hFile) ;
+}
+
+static OFC_HANDLE bench_create_server (OFC_LPCTSTR name)
+{
+  return (OfcCreateFile (name, OFC_GENERIC_READ | OFC_GENERIC_WRITE,
+			 OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			 OFC_NULL, OFC_CREATE_ALWAYS, 0, OFC_HANDLE_NULL)) ;
+}
+
+static void *bench_stream_reader (void *context)
+{
+  BENCH_PAIR *pair ;
+  OFC_LPTSTR name ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *buffer ;
+  OFC_DWORD nread ;
+  OFC_UINT64 remaining ;
+
+  pair = context ;
+  name = bench_pipe_name ("bench_stream", pair->index) ;
+  hFile = bench_create_server (name) ;
+  buffer = ofc_malloc (pair->size) ;
+
+  remaining = (OFC_UINT64) pair->messages * pair->size ;
+  while (hFile != OFC_HANDLE_NULL && remaining > 0 &&
+	 OfcReadFile (hFile, buffer, pair->size, &nread, OFC_HANDLE_NULL))
+    remaining -= nread ;
+
+  ofc_free (buffer) ;
+  if (hFile != OFC_HANDLE_NULL)
+    OfcCloseHandle (hFile) ;
+  ofc_free (name) ;
+  return (NULL) ;
+}
+
+static void *bench_stream_writer (void *context)
+{
+  BENCH_PAIR *pair ;
+  OFC_LPTSTR name ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *buffer ;
+  OFC_DWORD nwritten ;
+  OFC_INT i ;
+
+  pair = context ;
+  name = bench_pipe_name ("bench_stream", pair->index) ;
+  hFile = bench_open_client (name) ;
+  buffer = ofc_malloc (pair->size) ;
+  ofc_memset (buffer, 0x5a, pair->size) ;
+
+  for (i = 0 ; i < pair->messages ; i++)
+    OfcWriteFile (hFile, buffer, pair->size, &nwritten, OFC_HANDLE_NULL) ;
+
+  ofc_free (buffer) ;
+  OfcCloseHandle (hFile) ;
+  ofc_free (name) ;
+  return (NULL) ;
+}
+
+static OFC_VOID bench_contention (OFC_INT max_pairs, OFC_INT messages,
+				  OFC_INT size)
+{
+  BENCH_PAIR *pairs ;
+  pthread_t *readers ;
+  pthread_t *writers ;
+  OFC_INT npairs ;
+  OFC_INT i ;
+  double start ;
+  double elapsed ;
+  double total ;
+
+  pairs = ofc_malloc (sizeof (BENCH_PAIR) * max_pairs) ;
+  readers = ofc_malloc (sizeof (pthread_t) * max_pairs) ;
+  writers = ofc_malloc (sizeof (pthread_t) * max_pairs) ;
+
+  for (npairs = 1 ; npairs <= max_pairs ; npairs *= 2)
+    {
+      start = bench_now () ;
+      for (i = 0 ; i < npairs ; i++)
+	{
+	  pairs[i].index = i ;
+	  pairs[i].messages = messages ;
+	  pairs[i].size = size ;
+	  pthread_create (&readers[i], NULL, bench_stream_reader, &pairs[i]) ;
+	  pthread_create (&writers[i], NULL, bench_stream_writer, &pairs[i]) ;
+	}
+      for (i = 0 ; i < npairs ; i++)
+	{
+	  pthread_join (writers[i], NULL) ;
+	  pthread_join (readers[i], NULL) ;
+	}
+      elapsed = bench_now () - start ;
+      total = (double) npairs * messages ;
+
+      printf ("mode=contention pairs=%d messages=%d size=%d secs=%.3f "
+	      "msgs_per_sec=%.0f mb_per_sec=%.1f\n",
+	      npairs, messages, size, elapsed, total / elapsed,
+	      total * size / elapsed / (1024.0 * 1024.0)) ;
+    }
+
+  ofc_free (writers) ;
+  ofc_free (readers) ;
+  ofc_free (pairs) ;
+}
+
+static OFC_VOID bench_coalesce (OFC_INT messages, OFC_INT size)
+{
+  static const OFC_FS_PIPE_READMODE modes[] =
+    {
+      OFC_FS_PIPE_READMODE_MESSAGE,
+      OFC_FS_PIPE_READMODE_BYTE
+    } ;
+  OFC_FS_PIPE_CONFIG config ;
+  OFC_LPTSTR name ;
+  OFC_LPTSTR config_name ;
+  OFC_HANDLE hServer ;
+  OFC_HANDLE hClient ;
+  OFC_CHAR *buffer ;
+  OFC_DWORD nbytes ;
+  OFC_UINT64 remaining ;
+  OFC_UINT64 total ;
+  OFC_INT reads ;
+  OFC_INT m ;
+  OFC_INT i ;
+  double start ;
+  double elapsed ;
+
+  name = bench_pipe_name ("bench_coalesce", 0) ;
+  config_name = ofc_cstr2tstr ("bench_coalesce_0") ;
+  buffer = ofc_malloc (64 * 1024) ;
+  ofc_memset (buffer, 0x5a, size) ;
+  total = (OFC_UINT64) messages * size ;
+
+  for (m = 0 ; m < 2 ; m++)
+    {
+      ofc_memset (&config, 0, sizeof (config)) ;
+      config.read_mode = modes[m] ;
+      OfcFSPipeSetConfig (config_name, &config) ;
+      /*
+       * The server does not wait for a client so one thread can queue
+       * everything before draining it
+       */
+      hServer = OfcCreateFile (name, OFC_GENERIC_READ | OFC_GENERIC_WRITE,
+			       OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			       OFC_NULL, OFC_CREATE_ALWAYS,
+			       OFC_FILE_FLAG_OVERLAPPED, OFC_HANDLE_NULL) ;
+      hClient = bench_open_client (name) ;
+
+      for (i = 0 ; i < messages ; i++)
+	OfcWriteFile (hClient, buffer, size, &nbytes, OFC_HANDLE_NULL) ;
+
+      start = bench_now () ;
+      reads = 0 ;
+      remaining = total ;
+      while (remaining > 0 &&
+	     OfcReadFile (hServer, buffer, 64 * 1024, &nbytes,
+			  OFC_HANDLE_NULL))
+	{
+	  remaining -= nbytes ;
+	  reads++ ;
+	}
+      elapsed = bench_now () - start ;
+
+      printf ("mode=coalesce read_mode=%s messages=%d size=%d reads=%d "
+	      "reads_per_mb=%.1f secs=%.3f\n",
+	      modes[m] == OFC_FS_PIPE_READMODE_BYTE ? "byte" : "message",
+	      messages, size, reads,
+	      (double) reads * 1024.0 * 1024.0 / (double) total, elapsed) ;
+
+      OfcCloseHandle (hClient) ;
+      OfcCloseHandle (hServer) ;
+    }
+
+  OfcFSPipeSetConfig (config_name, OFC_NULL) ;
+  ofc_free (buffer) ;
+  ofc_free (config_name) ;
+  ofc_free (name) ;
+}
+
+static void *bench_echo_server (void *context)
+{
+  BENCH_PAIR *pair ;
+  OFC_LPTSTR name ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *buffer ;
+  OFC_DWORD nread ;
+  OFC_DWORD nwritten ;
+
+  pair = context ;
+  name = bench_pipe_name ("bench_transact", pair->index) ;
+  hFile = bench_create_server (name) ;
+  buffer = ofc_malloc (pair->size) ;
+
+  while (hFile != OFC_HANDLE_NULL &&
+	 OfcReadFile (hFile, buffer, pair->size, &nread, OFC_HANDLE_NULL) &&
+	 OfcWriteFile (hFile, buffer, nread, &nwritten, OFC_HANDLE_NULL)) ;
+
+  ofc_free (buffer) ;
+  if (hFile != OFC_HANDLE_NULL)
+    OfcCloseHandle (hFile) ;
+  ofc_free (name) ;
+  return (NULL) ;
+}
+
+static int bench_compare_double (const void *a, const void *b)
+{
+  double da ;
+  double db ;
+
+  da = *(const double *) a ;
+  db = *(const double *) b ;
+  return (da < db ? -1 : da > db ? 1 : 0) ;
+}
+
+static double bench_percentile (double *samples, OFC_INT count, double p)
+{
+  OFC_INT i ;
+
+  i = (OFC_INT) (p * (count - 1) + 0.5) ;
+  return (samples[i]) ;
+}
+
+static OFC_VOID bench_transact (OFC_INT calls, OFC_INT size, OFC_INT spin)
+{
+  OFC_FS_PIPE_WAIT_STATS before ;
+  OFC_FS_PIPE_WAIT_STATS after ;
+  BENCH_PAIR pair ;
+  pthread_t server ;
+  OFC_LPTSTR name ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *request ;
+  OFC_CHAR *reply ;
+  OFC_DWORD nread ;
+  double *samples ;
+  double start ;
+  double total ;
+  OFC_INT i ;
+
+  OfcFSPipeSetSpinCount (spin) ;
+  OfcFSPipeGetWaitStats (&before) ;
+
+  pair.index = 0 ;
+  pair.messages = calls ;
+  pair.size = size ;
+  pthread_create (&server, NULL, bench_echo_server, &pair) ;
+
+  name = bench_pipe_name ("bench_transact", 0) ;
+  hFile = bench_open_client (name) ;
+  request = ofc_malloc (size) ;
+  reply = ofc_malloc (size) ;
+  ofc_memset (request, 0x5a, size) ;
+  samples = ofc_malloc (sizeof (double) * calls) ;
+
+  total = 0.0 ;
+  for (i = 0 ; i < calls ; i++)
+    {
+      start = bench_now () ;
+      OfcTransactNamedPipe (hFile, request, size, reply, size, &nread,
+			    OFC_HANDLE_NULL) ;
+      samples[i] = (bench_now () - start) * 1e6 ;
+      total += samples[i] ;
+    }
+
+  OfcCloseHandle (hFile) ;
+  pthread_join (server, NULL) ;
+  OfcFSPipeGetWaitStats (&after) ;
+  OfcFSPipeSetSpinCount (0) ;
+
+  qsort (samples, calls, sizeof (double), bench_compare_double) ;
+  printf ("mode=transact calls=%d size=%d spin=%d mean_us=%.2f "
+	  "p50_us=%.2f p99_us=%.2f max_us=%.2f waits=%llu spin_hits=%llu "
+	  "parks=%llu\n",
+	  calls, size, spin, total / calls,
+	  bench_percentile (samples, calls, 0.50),
+	  bench_percentile (samples, calls, 0.99),
+	  samples[calls - 1],
+	  (unsigned long long) (after.waits - before.waits),
+	  (unsigned long long) (after.spin_hits - before.spin_hits),
+	  (unsigned long long) (after.parks - before.parks)) ;
+
+  ofc_free (samples) ;
+  ofc_free (reply) ;
+  ofc_free (request) ;
+  ofc_free (name) ;
+}
+
+typedef struct
+{
+  OFC_INT first ;
+  OFC_INT count ;
+  OFC_INT messages ;
+  OFC_INT size ;
+  OFC_BOOL transact ;
+  double *samples ;
+} BENCH_CLIENT ;
+
+static void *bench_sweep_client (void *context)
+{
+  BENCH_CLIENT *client ;
+  OFC_HANDLE *handles ;
+  OFC_LPTSTR name ;
+  OFC_CHAR *request ;
+  OFC_CHAR *reply ;
+  OFC_DWORD nbytes ;
+  OFC_INT m ;
+  OFC_INT i ;
+  OFC_INT n ;
+  double start ;
+
+  client = context ;
+  handles = ofc_malloc (sizeof (OFC_HANDLE) * client->count) ;
+  for (i = 0 ; i < client->count ; i++)
+    {
+      name = bench_pipe_name (client->transact ?
+			      "bench_transact" : "bench_stream",
+			      client->first + i) ;
+      handles[i] = bench_open_client (name) ;
+      ofc_free (name) ;
+    }
+  request = ofc_malloc (client->size) ;
+  reply = ofc_malloc (client->size) ;
+  ofc_memset (request, 0x5a, client->size) ;
+
+  n = 0 ;
+  for (m = 0 ; m < client->messages ; m++)
+    {
+      for (i = 0 ; i < client->count ; i++)
+	{
+	  start = bench_now () ;
+	  if (client->transact)
+	    OfcTransactNamedPipe (handles[i], request, client->size,
+				  reply, client->size, &nbytes,
+				  OFC_HANDLE_NULL) ;
+	  else
+	    OfcWriteFile (handles[i], request, client->size, &nbytes,
+			  OFC_HANDLE_NULL) ;
+	  client->samples[n++] = (bench_now () - start) * 1e6 ;
+	}
+    }
+
+  for (i = 0 ; i < client->count ; i++)
+    OfcCloseHandle (handles[i]) ;
+  ofc_free (reply) ;
+  ofc_free (request) ;
+  ofc_free (handles) ;
+  return (NULL) ;
+}
+
+static OFC_VOID bench_sweep_run (OFC_BOOL transact, OFC_INT npairs,
+				 OFC_INT nthreads, OFC_INT size,
+				 OFC_INT messages)
+{
+  BENCH_PAIR *pairs ;
+  BENCH_CLIENT *clients ;
+  pthread_t *servers ;
+  pthread_t *threads ;
+  double *samples ;
+  OFC_INT nsamples ;
+  OFC_INT first ;
+  OFC_INT i ;
+  double start ;
+  double elapsed ;
+  double total ;
+
+  pairs = ofc_malloc (sizeof (BENCH_PAIR) * npairs) ;
+  servers = ofc_malloc (sizeof (pthread_t) * npairs) ;
+  clients = ofc_malloc (sizeof (BENCH_CLIENT) * nthreads) ;
+  threads = ofc_malloc (sizeof (pthread_t) * nthreads) ;
+  nsamples = npairs * messages ;
+  samples = ofc_malloc (sizeof (double) * nsamples) ;
+
+  start = bench_now () ;
+  for (i = 0 ; i < npairs ; i++)
+    {
+      pairs[i].index = i ;
+      pairs[i].messages = messages ;
+      pairs[i].size = size ;
+      pthread_create (&servers[i], NULL,
+		      transact ? bench_echo_server : bench_stream_reader,
+		      &pairs[i]) ;
+    }
+  /*
+   * Spread the pairs as evenly as possible over the client threads
+   */
+  first = 0 ;
+  for (i = 0 ; i < nthreads ; i++)
+    {
+      clients[i].first = first ;
+      clients[i].count = npairs / nthreads + (i < npairs % nthreads) ;
+      clients[i].messages = messages ;
+      clients[i].size = size ;
+      clients[i].transact = transact ;
+      clients[i].samples = samples + first * messages ;
+      first += clients[i].count ;
+      pthread_create (&threads[i], NULL, bench_sweep_client, &clients[i]) ;
+    }
+  for (i = 0 ; i < nthreads ; i++)
+    pthread_join (threads[i], NULL) ;
+  for (i = 0 ; i < npairs ; i++)
+    pthread_join (servers[i], NULL) ;
+  elapsed = bench_now () - start ;
+  total = (double) nsamples ;
+
+  qsort (samples, nsamples, sizeof (double), bench_compare_double) ;
+  printf ("mode=sweep kind=%s pairs=%d threads=%d size=%d messages=%d "
+	  "secs=%.3f msgs_per_sec=%.0f mb_per_sec=%.1f p50_us=%.2f "
+	  "p90_us=%.2f p99_us=%.2f max_us=%.2f\n",
+	  transact ? "transact" : "stream", npairs, nthreads, size,
+	  messages, elapsed, total / elapsed,
+	  total * size / elapsed / (1024.0 * 1024.0),
+	  bench_percentile (samples, nsamples, 0.50),
+	  bench_percentile (samples, nsamples, 0.90),
+	  bench_percentile (samples, nsamples, 0.99),
+	  samples[nsamples - 1]) ;
+  fflush (stdout) ;
+
+  ofc_free (samples) ;
+  ofc_free (threads) ;
+  ofc_free (clients) ;
+  ofc_free (servers) ;
+  ofc_free (pairs) ;
+}
+
+static OFC_VOID bench_sweep (OFC_INT max_pairs, OFC_INT max_size,
+			     OFC_INT max_threads, OFC_INT mb)
+{
+  OFC_INT kind ;
+  OFC_INT size ;
+  OFC_INT npairs ;
+  OFC_INT nthreads ;
+  OFC_INT64 messages ;
+
+  for (kind = 0 ; kind < 2 ; kind++)
+    for (size = 64 ; size <= max_size ; size *= 4)
+      for (npairs = 1 ; npairs <= max_pairs ; npairs *= 4)
+	{
+	  /*
+	   * Each side of a pair holds a buffer of the message size
+	   */
+	  if ((OFC_INT64) npairs * size * 2 > 64 * 1024 * 1024)
+	    continue ;
+	  messages = (OFC_INT64) mb * 1024 * 1024 / size / npairs ;
+	  messages = OFC_MAX (messages, 4) ;
+	  for (nthreads = 1 ;
+	       nthreads <= max_threads && nthreads <= npairs ;
+	       nthreads *= 4)
+	    bench_sweep_run (kind == 1, npairs, nthreads, size,
+			     (OFC_INT) messages) ;
+	}
+}
+
+static OFC_VOID bench_report (OFC_CCHAR *transport, OFC_INT calls,
+			      OFC_INT size, double *samples)
+{
+  double total ;
+  OFC_INT i ;
+
+  total = 0.0 ;
+  for (i = 0 ; i < calls ; i++)
+    total += samples[i] ;
+  qsort (samples, calls, sizeof (double), bench_compare_double) ;
+  printf ("mode=shm transport=%s calls=%d size=%d mean_us=%.2f "
+	  "p50_us=%.2f p99_us=%.2f max_us=%.2f\n",
+	  transport, calls, size, total / calls,
+	  bench_percentile (samples, calls, 0.50),
+	  bench_percentile (samples, calls, 0.99),
+	  samples[calls - 1]) ;
+  fflush (stdout) ;
+}
+
+static void *bench_socket_echo (void *context)
+{
+  OFC_INT *fd ;
+  OFC_CHAR *buffer ;
+  ssize_t len ;
+
+  fd = context ;
+  buffer = malloc (64 * 1024) ;
+  while ((len = recv (*fd, buffer, 64 * 1024, 0)) > 0 &&
+	 send (*fd, buffer, len, 0) == len) ;
+  free (buffer) ;
+  return (NULL) ;
+}
+
+/*
+ * The server process.  Runs the framework of its own and serves one
+ * shared pipe client and the socket.
+ */
+static OFC_INT bench_shm_server (OFC_INT fd, OFC_INT size)
+{
+  OFC_FS_PIPE_CONFIG config ;
+  pthread_t socket_thread ;
+  OFC_LPTSTR name ;
+  OFC_LPTSTR config_name ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *buffer ;
+  OFC_DWORD nread ;
+  OFC_DWORD nwritten ;
+
+  pthread_create (&socket_thread, NULL, bench_socket_echo, &fd) ;
+
+  ofc_framework_init () ;
+  ofc_framework_startup () ;
+
+  ofc_memset (&config, 0, sizeof (config)) ;
+  config.shared = OFC_TRUE ;
+  config_name = ofc_cstr2tstr ("bench_shm_0") ;
+  OfcFSPipeSetConfig (config_name, &config) ;
+  name = bench_pipe_name ("bench_shm", 0) ;
+  buffer = ofc_malloc (size) ;
+
+  hFile = bench_create_server (name) ;
+  while (hFile != OFC_HANDLE_NULL &&
+	 OfcReadFile (hFile, buffer, size, &nread, OFC_HANDLE_NULL) &&
+	 OfcWriteFile (hFile, buffer, nread, &nwritten, OFC_HANDLE_NULL)) ;
+  if (hFile != OFC_HANDLE_NULL)
+    OfcCloseHandle (hFile) ;
+
+  ofc_free (buffer) ;
+  ofc_free (name) ;
+  ofc_free (config_name) ;
+  ofc_framework_shutdown () ;
+  ofc_framework_destroy () ;
+
+  pthread_join (socket_thread, NULL) ;
+  return (0) ;
+}
+
+static OFC_INT bench_shm (OFC_INT calls, OFC_INT size)
+{
+  OFC_INT fds[2] ;
+  pid_t pid ;
+  OFC_LPTSTR name ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *request ;
+  OFC_CHAR *reply ;
+  OFC_DWORD nread ;
+  double *samples ;
+  double start ;
+  OFC_INT tries ;
+  OFC_INT ret ;
+  OFC_INT i ;
+
+  if (socketpair (AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0)
+    {
+      perror ("socketpair") ;
+      return (1) ;
+    }
+  /*
+   * Fork before either side starts the framework
+   */
+  pid = fork () ;
+  if (pid == 0)
+    {
+      close (fds[0]) ;
+      exit (bench_shm_server (fds[1], size)) ;
+    }
+  close (fds[1]) ;
+
+  ofc_framework_init () ;
+  ofc_framework_startup () ;
+
+  ret = 0 ;
+  name = bench_pipe_name ("bench_shm", 0) ;
+  request = ofc_malloc (size) ;
+  reply = ofc_malloc (size) ;
+  ofc_memset (request, 0x5a, size) ;
+  samples = ofc_malloc (sizeof (double) * calls) ;
+
+  hFile = OFC_HANDLE_NULL ;
+  for (tries = 0 ; hFile == OFC_HANDLE_NULL && tries < 5000 ; tries++)
+    {
+      hFile = OfcCreateFile (name, OFC_GENERIC_READ | OFC_GENERIC_WRITE,
+			     OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			     OFC_NULL, OFC_OPEN_EXISTING, 0, OFC_HANDLE_NULL) ;
+      if (hFile == OFC_HANDLE_NULL)
+	ofc_sleep (1) ;
+    }
+
+  if (hFile == OFC_HANDLE_NULL)
+    {
+      fprintf (stderr, "no shared pipe, is OFC_FS_PIPE_SHARED_MEMORY "
+	       "built in?\n") ;
+      kill (pid, SIGTERM) ;
+      ret = 1 ;
+    }
+  else
+    {
+      for (i = 0 ; i < calls ; i++)
+	{
+	  start = bench_now () ;
+	  OfcTransactNamedPipe (hFile, request, size, reply, size, &nread,
+				OFC_HANDLE_NULL) ;
+	  samples[i] = (bench_now () - start) * 1e6 ;
+	}
+      OfcCloseHandle (hFile) ;
+      bench_report ("pipe_shm", calls, size, samples) ;
+
+      for (i = 0 ; i < calls ; i++)
+	{
+	  start = bench_now () ;
+	  if (send (fds[0], request, size, 0) != size ||
+	      recv (fds[0], reply, size, 0) != size)
+	    break ;
+	  samples[i] = (bench_now () - start) * 1e6 ;
+	}
+      if (i == calls)
+	bench_report ("unix_socket", calls, size, samples) ;
+    }
+  close (fds[0]) ;
+  waitpid (pid, NULL, 0) ;
+
+  ofc_free (samples) ;
+  ofc_free (reply) ;
+  ofc_free (request) ;
+  ofc_free (name) ;
+  ofc_framework_shutdown () ;
+  ofc_framework_destroy () ;
+  return (ret) ;
+}
+
+static OFC_INT bench_arg (int argc, char **argv, int index, OFC_INT def)
+{
+  return (argc > index ? atoi (argv[index]) : def) ;
+}
+
+int main (int argc, char **argv)
+{
+  int ret ;
+
+  /*
+   * The two process benchmark starts the framework in each process
+   * once it has forked
+   */
+  if (argc >= 2 && strcmp (argv[1], "shm") == 0)
+    return (bench_shm (OFC_MAX(bench_arg (argc, argv, 2, 100000), 1),
+		       OFC_MIN(OFC_MAX(bench_arg (argc, argv, 3, 128), 1),
+			       64 * 1024))) ;
+
+  ret = 0 ;
+  ofc_framework_init () ;
+  ofc_framework_startup () ;
+
+  if (argc < 2 || strcmp (argv[1], "contention") == 0)
+    bench_contention (bench_arg (argc, argv, 2, 64),
+		      bench_arg (argc, argv, 3, 100000),
+		      bench_arg (argc, argv, 4, 256)) ;
+  else if (strcmp (argv[1], "coalesce") == 0)
+    bench_coalesce (bench_arg (argc, argv, 2, 20000),
+		    OFC_MIN(bench_arg (argc, argv, 3, 300), 64 * 1024)) ;
+  else if (strcmp (argv[1], "transact") == 0)
+    bench_transact (OFC_MAX(bench_arg (argc, argv, 2, 100000), 1),
+		    bench_arg (argc, argv, 3, 128),
+		    bench_arg (argc, argv, 4, 0)) ;
+  else if (strcmp (argv[1], "sweep") == 0)
+    bench_sweep (bench_arg (argc, argv, 2, 1024),
+		 bench_arg (argc, argv, 3, 1024 * 1024),
+		 bench_arg (argc, argv, 4, 16),
+		 OFC_MAX(bench_arg (argc, argv, 5, 16), 1)) ;
+  else
+    {
+      fprintf (stderr,
+	       "usage: %s contention [max_pairs] [messages] [size]\n"
+	       "       %s coalesce [messages] [size]\n"
+	       "       %s transact [calls] [size] [spin]\n"
+	       "       %s sweep [max_pairs] [max_size] [max_threads] [mb]\n"
+	       "       %s shm [calls] [size]\n",
+	       argv[0], argv[0], argv[0], argv[0], argv[0]) ;
+      ret = 1 ;
+    }
+
+  ofc_framework_shutdown () ;
+  ofc_framework_destroy () ;
+  return (ret) ;
+}
+
+/** \} */
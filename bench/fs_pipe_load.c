@@ -0,0 +1,562 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ofc/types.h"
+#include "ofc/framework.h"
+#include "ofc/libc.h"
+#include "ofc/heap.h"
+#include "ofc/file.h"
+#include "ofc/thread.h"
+
+#include "of_core_fs_pipe/fs_pipe.h"
+
+/**
+ * \defgroup pipe_load Pipe File System Load Generator
+ *
+ * Replays IPC$ style sessions against the pipe handler from many
+ * threads at once and reports the rates sustained.
+ *
+ *   fs_pipe_load [threads] [secs] [trace]
+ *
+ * Each client thread runs the trace over and over until the time is
+ * up.  A stand in server thread per client accepts sessions on the
+ * trace's pipe name and answers each request with as many bytes as
+ * the request asks for, the way an RPC service answers a call.
+ *
+ * A trace is a text file with one operation per line.  A line may
+ * start with a repeat count and # starts a comment.
+ *
+ *   pipe <name>              pipe to open, srvsvc if not given
+ *   open                     open the pipe as a client
+ *   transact <size> <reply>  TransactNamedPipe of size bytes
+ *   write <size> [reply]     WriteFile of size bytes
+ *   read <size>              ReadFile of up to size bytes
+ *   sleep <usecs>            pause between calls
+ *   close                    close the pipe
+ *
+ * Without a trace file a DCE/RPC like session is replayed: a bind,
+ * a burst of small calls, one call with a large response and a close.
+ * Results are printed as one line of key=value pairs.
+ */
+
+/** \{ */
+
+#define LOAD_MAX_MESSAGE (1024 * 1024)
+#define LOAD_MAX_OPS 256
+
+typedef enum
+{
+  LOAD_OPEN,
+  LOAD_CLOSE,
+  LOAD_TRANSACT,
+  LOAD_WRITE,
+  LOAD_READ,
+  LOAD_SLEEP
+} LOAD_OP_TYPE ;
+
+typedef struct
+{
+  LOAD_OP_TYPE type ;
+  OFC_INT repeat ;
+  OFC_INT size ;
+  OFC_INT reply ;
+} LOAD_OP ;
+
+typedef struct
+{
+  OFC_CHAR pipe[64] ;
+  LOAD_OP ops[LOAD_MAX_OPS] ;
+  OFC_INT count ;
+} LOAD_TRACE ;
+
+typedef struct
+{
+  OFC_UINT64 sessions ;
+  OFC_UINT64 connects ;
+  OFC_UINT64 connect_usecs ;
+  OFC_UINT64 transacts ;
+  OFC_UINT64 writes ;
+  OFC_UINT64 reads ;
+  OFC_UINT64 bytes ;
+  OFC_UINT64 errors ;
+} LOAD_STATS ;
+
+typedef struct
+{
+  const LOAD_TRACE *trace ;
+  OFC_LPTSTR name ;
+  double deadline ;
+  LOAD_STATS stats ;
+} LOAD_CLIENT ;
+
+typedef struct
+{
+  OFC_LPTSTR name ;
+} LOAD_SERVER ;
+
+static const OFC_CHAR *load_default_trace[] =
+  {
+    "pipe srvsvc",
+    "open",
+    "transact 72 68",
+    "16 transact 160 96",
+    "write 120",
+    "transact 256 65536",
+    "close",
+    OFC_NULL
+  } ;
+
+static volatile OFC_BOOL load_stopping ;
+
+static double load_now (OFC_VOID)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return ((double) ts.tv_sec + (double) ts.tv_nsec / 1e9) ;
+}
+
+static OFC_BOOL load_parse_line (LOAD_TRACE *trace, const OFC_CHAR *line)
+{
+  static const struct
+  {
+    const OFC_CHAR *name ;
+    LOAD_OP_TYPE type ;
+  } names[] =
+      {
+	{ "open", LOAD_OPEN },
+	{ "close", LOAD_CLOSE },
+	{ "transact", LOAD_TRANSACT },
+	{ "write", LOAD_WRITE },
+	{ "read", LOAD_READ },
+	{ "sleep", LOAD_SLEEP }
+      } ;
+  OFC_CHAR word[32] ;
+  LOAD_OP *op ;
+  OFC_INT repeat ;
+  OFC_INT size ;
+  OFC_INT reply ;
+  OFC_INT fields ;
+  OFC_INT skip ;
+  OFC_UINT i ;
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  repeat = 1 ;
+  skip = 0 ;
+  if (sscanf (line, " %d%n", &repeat, &skip) < 1)
+    repeat = 1 ;
+  line += skip ;
+
+  size = 0 ;
+  reply = 0 ;
+  fields = sscanf (line, " %31s %d %d", word, &size, &reply) ;
+  if (fields < 1 || word[0] == '#')
+    ;
+  else if (strcmp (word, "pipe") == 0)
+    {
+      if (sscanf (line, " %*s %63s", trace->pipe) != 1)
+	ret = OFC_FALSE ;
+    }
+  else if (trace->count == LOAD_MAX_OPS)
+    ret = OFC_FALSE ;
+  else
+    {
+      op = &trace->ops[trace->count] ;
+      for (i = 0 ; i < sizeof (names) / sizeof (names[0]) &&
+	     strcmp (word, names[i].name) != 0 ; i++) ;
+      if (i == sizeof (names) / sizeof (names[0]))
+	ret = OFC_FALSE ;
+      else
+	{
+	  op->type = names[i].type ;
+	  op->repeat = OFC_MAX (repeat, 1) ;
+	  /*
+	   * Requests carry the size of the reply they want.  A sleep's
+	   * size is its pause in microseconds
+	   */
+	  if (op->type == LOAD_SLEEP)
+	    op->size = OFC_MAX (size, 0) ;
+	  else
+	    op->size = OFC_MIN (size, LOAD_MAX_MESSAGE) ;
+	  if (op->type == LOAD_TRANSACT || op->type == LOAD_WRITE)
+	    op->size = OFC_MAX (op->size, (OFC_INT) sizeof (OFC_UINT32)) ;
+	  op->reply = OFC_MIN (OFC_MAX (reply, 0), LOAD_MAX_MESSAGE) ;
+	  trace->count++ ;
+	}
+    }
+  return (ret) ;
+}
+
+static OFC_BOOL load_trace_init (LOAD_TRACE *trace, const OFC_CHAR *path)
+{
+  FILE *fp ;
+  OFC_CHAR line[256] ;
+  OFC_INT lineno ;
+  OFC_INT i ;
+  OFC_BOOL ret ;
+
+  ofc_memset (trace, 0, sizeof (LOAD_TRACE)) ;
+  strncpy (trace->pipe, "srvsvc", sizeof (trace->pipe) - 1) ;
+  ret = OFC_TRUE ;
+
+  if (path == OFC_NULL)
+    {
+      for (i = 0 ; load_default_trace[i] != OFC_NULL ; i++)
+	load_parse_line (trace, load_default_trace[i]) ;
+    }
+  else
+    {
+      fp = fopen (path, "r") ;
+      if (fp == NULL)
+	{
+	  fprintf (stderr, "can't open trace %s\n", path) ;
+	  ret = OFC_FALSE ;
+	}
+      else
+	{
+	  for (lineno = 1 ; ret && fgets (line, sizeof (line), fp) != NULL ;
+	       lineno++)
+	    {
+	      if (!load_parse_line (trace, line))
+		{
+		  fprintf (stderr, "%s:%d: bad trace line\n", path, lineno) ;
+		  ret = OFC_FALSE ;
+		}
+	    }
+	  fclose (fp) ;
+	}
+    }
+  return (ret) ;
+}
+
+static OFC_VOID load_request_init (OFC_CHAR *buffer, OFC_INT reply)
+{
+  OFC_UINT32 want ;
+
+  want = (OFC_UINT32) reply ;
+  buffer[0] = (OFC_CHAR) (want & 0xff) ;
+  buffer[1] = (OFC_CHAR) ((want >> 8) & 0xff) ;
+  buffer[2] = (OFC_CHAR) ((want >> 16) & 0xff) ;
+  buffer[3] = (OFC_CHAR) ((want >> 24) & 0xff) ;
+}
+
+static OFC_INT load_request_reply (const OFC_CHAR *buffer, OFC_DWORD len)
+{
+  OFC_UINT32 want ;
+
+  want = 0 ;
+  if (len >= sizeof (OFC_UINT32))
+    want = (OFC_UINT32) (OFC_UINT8) buffer[0] |
+      (OFC_UINT32) (OFC_UINT8) buffer[1] << 8 |
+      (OFC_UINT32) (OFC_UINT8) buffer[2] << 16 |
+      (OFC_UINT32) (OFC_UINT8) buffer[3] << 24 ;
+  return ((OFC_INT) OFC_MIN (want, LOAD_MAX_MESSAGE)) ;
+}
+
+/*
+ * Accept sessions one after another, answering each request with the
+ * number of bytes it asks for.  Once the clients are done, each server
+ * is released by one last connect.
+ */
+static void *load_server (void *context)
+{
+  LOAD_SERVER *server ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *buffer ;
+  OFC_DWORD nread ;
+  OFC_DWORD nwritten ;
+  OFC_INT reply ;
+  OFC_BOOL done ;
+
+  server = context ;
+  buffer = ofc_malloc (LOAD_MAX_MESSAGE) ;
+  ofc_memset (buffer, 0x5a, LOAD_MAX_MESSAGE) ;
+
+  for (done = OFC_FALSE ; !done ; )
+    {
+      hFile = OfcCreateFile (server->name,
+			     OFC_GENERIC_READ | OFC_GENERIC_WRITE,
+			     OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			     OFC_NULL, OFC_CREATE_ALWAYS, 0,
+			     OFC_HANDLE_NULL) ;
+      if (hFile == OFC_HANDLE_NULL)
+	done = OFC_TRUE ;
+      else
+	{
+	  if (load_stopping)
+	    done = OFC_TRUE ;
+	  else
+	    {
+	      while (OfcReadFile (hFile, buffer, LOAD_MAX_MESSAGE, &nread,
+				  OFC_HANDLE_NULL))
+		{
+		  reply = load_request_reply (buffer, nread) ;
+		  if (reply > 0 &&
+		      !OfcWriteFile (hFile, buffer, reply, &nwritten,
+				     OFC_HANDLE_NULL))
+		    break ;
+		}
+	    }
+	  OfcCloseHandle (hFile) ;
+	}
+    }
+
+  ofc_free (buffer) ;
+  return (NULL) ;
+}
+
+static OFC_HANDLE load_open (OFC_LPCTSTR name)
+{
+  OFC_HANDLE hFile ;
+  /*
+   * Every server instance may be busy with another session
+   */
+  for (hFile = OFC_HANDLE_NULL ; hFile == OFC_HANDLE_NULL ; )
+    {
+      hFile = OfcCreateFile (name, OFC_GENERIC_READ | OFC_GENERIC_WRITE,
+			     OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			     OFC_NULL, OFC_OPEN_EXISTING, 0, OFC_HANDLE_NULL) ;
+      if (hFile == OFC_HANDLE_NULL)
+	ofc_sleep (0) ;
+    }
+  return (hFile) ;
+}
+
+static OFC_VOID load_session (LOAD_CLIENT *client, OFC_CHAR *request,
+			      OFC_CHAR *reply)
+{
+  const LOAD_TRACE *trace ;
+  const LOAD_OP *op ;
+  LOAD_STATS *stats ;
+  OFC_HANDLE hFile ;
+  OFC_DWORD nbytes ;
+  struct timespec pause ;
+  OFC_INT i ;
+  OFC_INT r ;
+  OFC_BOOL ok ;
+  double start ;
+
+  trace = client->trace ;
+  stats = &client->stats ;
+  hFile = OFC_HANDLE_NULL ;
+
+  for (i = 0 ; i < trace->count ; i++)
+    {
+      op = &trace->ops[i] ;
+      for (r = 0 ; r < op->repeat ; r++)
+	{
+	  ok = OFC_TRUE ;
+	  switch (op->type)
+	    {
+	    case LOAD_OPEN:
+	      if (hFile == OFC_HANDLE_NULL)
+		{
+		  start = load_now () ;
+		  hFile = load_open (client->name) ;
+		  stats->connect_usecs +=
+		    (OFC_UINT64) ((load_now () - start) * 1e6) ;
+		  stats->connects++ ;
+		}
+	      break ;
+
+	    case LOAD_CLOSE:
+	      if (hFile != OFC_HANDLE_NULL)
+		{
+		  OfcCloseHandle (hFile) ;
+		  hFile = OFC_HANDLE_NULL ;
+		  stats->sessions++ ;
+		}
+	      break ;
+
+	    case LOAD_TRANSACT:
+	      load_request_init (request, op->reply) ;
+	      ok = hFile != OFC_HANDLE_NULL &&
+		OfcTransactNamedPipe (hFile, request, op->size, reply,
+				      LOAD_MAX_MESSAGE, &nbytes,
+				      OFC_HANDLE_NULL) ;
+	      if (ok)
+		{
+		  stats->transacts++ ;
+		  stats->bytes += op->size + nbytes ;
+		}
+	      break ;
+
+	    case LOAD_WRITE:
+	      load_request_init (request, op->reply) ;
+	      ok = hFile != OFC_HANDLE_NULL &&
+		OfcWriteFile (hFile, request, op->size, &nbytes,
+			      OFC_HANDLE_NULL) ;
+	      if (ok)
+		{
+		  stats->writes++ ;
+		  stats->bytes += nbytes ;
+		}
+	      break ;
+
+	    case LOAD_READ:
+	      ok = hFile != OFC_HANDLE_NULL &&
+		OfcReadFile (hFile, reply, OFC_MAX (op->size, 1), &nbytes,
+			     OFC_HANDLE_NULL) ;
+	      if (ok)
+		{
+		  stats->reads++ ;
+		  stats->bytes += nbytes ;
+		}
+	      break ;
+
+	    case LOAD_SLEEP:
+	      pause.tv_sec = op->size / 1000000 ;
+	      pause.tv_nsec = (long) (op->size % 1000000) * 1000 ;
+	      nanosleep (&pause, NULL) ;
+	      break ;
+	    }
+	  if (!ok)
+	    stats->errors++ ;
+	}
+    }
+
+  if (hFile != OFC_HANDLE_NULL)
+    {
+      OfcCloseHandle (hFile) ;
+      stats->sessions++ ;
+    }
+}
+
+static void *load_client (void *context)
+{
+  LOAD_CLIENT *client ;
+  OFC_CHAR *request ;
+  OFC_CHAR *reply ;
+
+  client = context ;
+  request = ofc_malloc (LOAD_MAX_MESSAGE) ;
+  reply = ofc_malloc (LOAD_MAX_MESSAGE) ;
+  ofc_memset (request, 0x5a, LOAD_MAX_MESSAGE) ;
+
+  while (load_now () < client->deadline)
+    load_session (client, request, reply) ;
+
+  ofc_free (reply) ;
+  ofc_free (request) ;
+  return (NULL) ;
+}
+
+static OFC_VOID load_run (const LOAD_TRACE *trace, OFC_INT nthreads,
+			  OFC_INT secs)
+{
+  LOAD_CLIENT *clients ;
+  LOAD_SERVER server ;
+  LOAD_STATS total ;
+  pthread_t *client_threads ;
+  pthread_t *server_threads ;
+  OFC_CHAR name[80] ;
+  OFC_HANDLE hFile ;
+  OFC_INT i ;
+  double start ;
+  double elapsed ;
+
+  ofc_snprintf (name, sizeof (name), "IPC:/%s", trace->pipe) ;
+  server.name = ofc_cstr2tstr (name) ;
+  clients = ofc_malloc (sizeof (LOAD_CLIENT) * nthreads) ;
+  client_threads = ofc_malloc (sizeof (pthread_t) * nthreads) ;
+  server_threads = ofc_malloc (sizeof (pthread_t) * nthreads) ;
+
+  load_stopping = OFC_FALSE ;
+  for (i = 0 ; i < nthreads ; i++)
+    pthread_create (&server_threads[i], NULL, load_server, &server) ;
+
+  start = load_now () ;
+  for (i = 0 ; i < nthreads ; i++)
+    {
+      ofc_memset (&clients[i], 0, sizeof (LOAD_CLIENT)) ;
+      clients[i].trace = trace ;
+      clients[i].name = server.name ;
+      clients[i].deadline = start + secs ;
+      pthread_create (&client_threads[i], NULL, load_client, &clients[i]) ;
+    }
+  for (i = 0 ; i < nthreads ; i++)
+    pthread_join (client_threads[i], NULL) ;
+  elapsed = load_now () - start ;
+
+  /*
+   * Each server is left waiting on one instance.  Connect to each so
+   * it sees we are stopping.
+   */
+  load_stopping = OFC_TRUE ;
+  for (i = 0 ; i < nthreads ; i++)
+    {
+      hFile = load_open (server.name) ;
+      OfcCloseHandle (hFile) ;
+    }
+  for (i = 0 ; i < nthreads ; i++)
+    pthread_join (server_threads[i], NULL) ;
+
+  ofc_memset (&total, 0, sizeof (total)) ;
+  for (i = 0 ; i < nthreads ; i++)
+    {
+      total.sessions += clients[i].stats.sessions ;
+      total.connects += clients[i].stats.connects ;
+      total.connect_usecs += clients[i].stats.connect_usecs ;
+      total.transacts += clients[i].stats.transacts ;
+      total.writes += clients[i].stats.writes ;
+      total.reads += clients[i].stats.reads ;
+      total.bytes += clients[i].stats.bytes ;
+      total.errors += clients[i].stats.errors ;
+    }
+
+  printf ("mode=load pipe=%s threads=%d secs=%.3f sessions=%llu "
+	  "connects_per_sec=%.0f transacts_per_sec=%.0f "
+	  "writes_per_sec=%.0f reads_per_sec=%.0f mb_per_sec=%.1f "
+	  "connect_mean_us=%.2f errors=%llu\n",
+	  trace->pipe, nthreads, elapsed,
+	  (unsigned long long) total.sessions,
+	  (double) total.connects / elapsed,
+	  (double) total.transacts / elapsed,
+	  (double) total.writes / elapsed,
+	  (double) total.reads / elapsed,
+	  (double) total.bytes / elapsed / (1024.0 * 1024.0),
+	  total.connects == 0 ? 0.0 :
+	  (double) total.connect_usecs / (double) total.connects,
+	  (unsigned long long) total.errors) ;
+
+  ofc_free (server_threads) ;
+  ofc_free (client_threads) ;
+  ofc_free (clients) ;
+  ofc_free (server.name) ;
+}
+
+int main (int argc, char **argv)
+{
+  LOAD_TRACE *trace ;
+  int ret ;
+
+  ret = 1 ;
+  ofc_framework_init () ;
+  ofc_framework_startup () ;
+
+  trace = ofc_malloc (sizeof (LOAD_TRACE)) ;
+
+  if (load_trace_init (trace, argc > 3 ? argv[3] : OFC_NULL))
+    {
+      load_run (trace,
+		OFC_MAX(argc > 1 ? atoi (argv[1]) : 16, 1),
+		OFC_MAX(argc > 2 ? atoi (argv[2]) : 10, 1)) ;
+      ret = 0 ;
+    }
+  ofc_free (trace) ;
+
+  ofc_framework_shutdown () ;
+  ofc_framework_destroy () ;
+  return (ret) ;
+}
+
+/** \} */
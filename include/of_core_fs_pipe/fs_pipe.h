@@ -16,12 +16,1046 @@
 
 /** \{ */
 
+/**
+ * Message pool statistics
+ *
+ * Messages written to a pipe are carved from a per pipe cache of
+ * released messages in a few size classes.
+ */
+typedef struct
+{
+  /** Allocations satisfied from a free list */
+  OFC_UINT64 hits ;
+  /** Allocations of a size class that had to go to the heap */
+  OFC_UINT64 misses ;
+  /** Allocations larger than the biggest size class */
+  OFC_UINT64 oversize ;
+} OFC_FS_PIPE_POOL_STATS ;
+
+/**
+ * Statistics of readers waiting for data
+ */
+typedef struct
+{
+  /** Times a reader found nothing queued and had to wait */
+  OFC_UINT64 waits ;
+  /** Waits that spun before blocking */
+  OFC_UINT64 spins ;
+  /** Spins that saw data arrive and so avoided blocking */
+  OFC_UINT64 spin_hits ;
+  /** Waits that blocked */
+  OFC_UINT64 parks ;
+} OFC_FS_PIPE_WAIT_STATS ;
+
+/**
+ * How reads return data queued on a pipe
+ */
+typedef enum
+{
+  /**
+   * Each read returns data from at most one write.  If the message does
+   * not fit the read fails with OFC_ERROR_MORE_DATA, returning the part
+   * that did, and the rest is returned by the following reads.
+   */
+  OFC_FS_PIPE_READMODE_MESSAGE = 0,
+  /** Reads return as much queued data as fits, across writes */
+  OFC_FS_PIPE_READMODE_BYTE
+} OFC_FS_PIPE_READMODE ;
+
+/**
+ * Per pipe name configuration
+ *
+ * Applied to every server instance of the name created after the
+ * configuration is set.  Sizes are in the spirit of the Win32
+ * nOutBufferSize and nInBufferSize.
+ */
+typedef struct
+{
+  /**
+   * Capacity in bytes of the server to client direction.  0 queues
+   * written data without bound.
+   */
+  OFC_DWORD out_buffer_size ;
+  /**
+   * Capacity in bytes of the client to server direction.  0 queues
+   * written data without bound.
+   */
+  OFC_DWORD in_buffer_size ;
+  /**
+   * If OFC_TRUE, a write to a full pipe returns with the number of
+   * bytes that fit (possibly none) rather than blocking
+   */
+  OFC_BOOL nowait ;
+  /**
+   * Maximum number of instances of the name that may be waiting for a
+   * client at once.  Creating another fails with OFC_ERROR_PIPE_BUSY.
+   * 0 for no limit.
+   */
+  OFC_UINT backlog ;
+  /**
+   * Read mode of both ends of new instances.  Bounded pipes are always
+   * read as a byte stream.
+   */
+  OFC_FS_PIPE_READMODE read_mode ;
+  /**
+   * Most polls a reader makes for data before blocking.  The number
+   * actually made adapts to how often polling succeeds.  0 uses the
+   * count set with OfcFSPipeSetSpinCount.
+   */
+  OFC_UINT spin_count ;
+  /**
+   * If OFC_TRUE, server instances are published in shared memory so
+   * clients in other processes can open them.  Only honored when the
+   * library is built with OFC_FS_PIPE_SHARED_MEMORY.  Shared instances
+   * are read in message mode by one thread per end at a time.  They
+   * support ReadFile, WriteFile, TransactNamedPipe and a blocking
+   * OfcFSPipeConnect but not overlapped I/O or the other pipe specific
+   * calls.  Their capacity in each direction is in_buffer_size rounded
+   * up to a power of two, or 64 KB if 0.
+   */
+  OFC_BOOL shared ;
+  /**
+   * Milliseconds a blocking call on either end of new instances may
+   * wait, in the spirit of the Win32 nDefaultTimeOut.  This covers a
+   * server waiting for its client in CreateFile or OfcFSPipeConnect
+   * and blocking reads, writes and transacts.  A call that runs out
+   * fails with OFC_ERROR_SEM_TIMEOUT.  0 waits without limit.  Shared
+   * instances are not timed.
+   */
+  OFC_DWORD timeout ;
+} OFC_FS_PIPE_CONFIG ;
+
+/**
+ * Passed as a timeout to wait as long as the handle allows
+ */
+#define OFC_FS_PIPE_WAIT_DEFAULT 0xFFFFFFFE
+
+/**
+ * Pipe specific information classes
+ *
+ * Accepted by GetFileInformationByHandleEx and SetFileInformationByHandle
+ * on pipe handles.  Values lie above the generic
+ * OFC_FILE_INFO_BY_HANDLE_CLASS values so the two cannot collide.
+ */
+#define OFC_FS_PIPE_INFO_CLASS_BASE 0x1000
+/** Get or set the OFC_FS_PIPE_MODE_INFO of one end of a pipe */
+#define OfcFSPipeModeInfo (OFC_FS_PIPE_INFO_CLASS_BASE + 0)
+/** Get the OFC_FS_PIPE_LOCAL_INFO of one end of a pipe */
+#define OfcFSPipeLocalInfo (OFC_FS_PIPE_INFO_CLASS_BASE + 1)
+
+/**
+ * Settable state of one end of a pipe
+ */
+typedef struct
+{
+  /** Read mode of the end the handle was opened on */
+  OFC_FS_PIPE_READMODE read_mode ;
+} OFC_FS_PIPE_MODE_INFO ;
+
+/**
+ * Connection state of one end of a pipe
+ */
+typedef enum
+{
+  /** A server instance waiting for a client */
+  OFC_FS_PIPE_STATE_LISTENING = 0,
+  /** Both ends are open */
+  OFC_FS_PIPE_STATE_CONNECTED,
+  /** The other end has closed.  Queued data can still be read. */
+  OFC_FS_PIPE_STATE_CLOSING
+} OFC_FS_PIPE_STATE ;
+
+/**
+ * Local information of one end of a pipe
+ *
+ * Modelled on FilePipeLocalInformation.  Inbound is the direction read
+ * by this end and outbound the direction it writes.
+ */
+typedef struct
+{
+  /** OFC_TRUE on the server end, OFC_FALSE on the client end */
+  OFC_BOOL server_end ;
+  OFC_FS_PIPE_STATE state ;
+  OFC_FS_PIPE_READMODE read_mode ;
+  /** Open instances of the pipe name, including this one */
+  OFC_UINT current_instances ;
+  /** Instances of the pipe name waiting for a client */
+  OFC_UINT listening_instances ;
+  /** Capacity of the inbound direction.  0 if unbounded. */
+  OFC_DWORD inbound_quota ;
+  /** Capacity of the outbound direction.  0 if unbounded. */
+  OFC_DWORD outbound_quota ;
+  /** Bytes queued to be read */
+  OFC_DWORD read_data_available ;
+  /** Messages queued to be read.  0 on a bounded pipe. */
+  OFC_DWORD read_messages ;
+  /** Bytes that can be written without blocking if outbound is bounded */
+  OFC_DWORD write_quota_available ;
+} OFC_FS_PIPE_LOCAL_INFO ;
+
+/**
+ * Statistics of one direction of a pipe
+ */
+typedef struct
+{
+  /** Bytes written in this direction */
+  OFC_UINT64 bytes_written ;
+  /** Messages written in this direction.  Bounded pipes count none. */
+  OFC_UINT64 messages_written ;
+  /** Bytes read in this direction */
+  OFC_UINT64 bytes_read ;
+  /** Writes handed straight to a waiting reader */
+  OFC_UINT64 handoffs ;
+  /** Time readers of this direction spent waiting for data */
+  OFC_UINT64 wait_usecs ;
+  /** Bytes queued when the snapshot was taken */
+  OFC_DWORD queued_bytes ;
+  /** Messages queued when the snapshot was taken */
+  OFC_DWORD queued_messages ;
+  /** Most bytes ever queued */
+  OFC_DWORD queued_bytes_hwm ;
+  /** Most messages ever queued */
+  OFC_DWORD queued_messages_hwm ;
+} OFC_FS_PIPE_DIRECTION_STATS ;
+
+/**
+ * Statistics of one pipe instance
+ */
+typedef struct
+{
+  /** Name of the pipe.  Freed by OfcFSPipeFreeStats. */
+  OFC_TCHAR *name ;
+  /** State of the server end */
+  OFC_FS_PIPE_STATE state ;
+  /** Client to server direction */
+  OFC_FS_PIPE_DIRECTION_STATS inbound ;
+  /** Server to client direction */
+  OFC_FS_PIPE_DIRECTION_STATS outbound ;
+} OFC_FS_PIPE_INSTANCE_STATS ;
+
+/**
+ * Statistics of the pipe file system as a whole
+ *
+ * Traffic totals cover every pipe since startup, open or closed.
+ */
+typedef struct
+{
+  /** Server instances created */
+  OFC_UINT64 instances_created ;
+  /** Clients that connected to an instance */
+  OFC_UINT64 connects ;
+  OFC_UINT64 bytes_written ;
+  OFC_UINT64 messages_written ;
+  OFC_UINT64 bytes_read ;
+  OFC_UINT64 wait_usecs ;
+  /** Instances open now */
+  OFC_UINT instances ;
+  /** Most instances ever open at once */
+  OFC_UINT instances_hwm ;
+} OFC_FS_PIPE_GLOBAL_STATS ;
+
+/**
+ * Operations whose latency is recorded in the histograms
+ */
+typedef enum
+{
+  /** A blocking server create or connect waiting for a client */
+  OFC_FS_PIPE_LATENCY_CONNECT = 0,
+  /** A blocking read that had to wait for data */
+  OFC_FS_PIPE_LATENCY_READ,
+  /** A blocking transact from request to reply */
+  OFC_FS_PIPE_LATENCY_TRANSACT,
+  OFC_FS_PIPE_LATENCY_MAX
+} OFC_FS_PIPE_LATENCY ;
+
+/**
+ * Percentiles of one latency histogram
+ *
+ * Latencies are kept in power of two buckets so each percentile is
+ * the upper bound of the bucket it falls in.
+ */
+typedef struct
+{
+  /** Operations recorded */
+  OFC_UINT64 count ;
+  OFC_UINT64 p50_usecs ;
+  OFC_UINT64 p90_usecs ;
+  OFC_UINT64 p99_usecs ;
+  OFC_UINT64 max_usecs ;
+} OFC_FS_PIPE_PERCENTILES ;
+
+/**
+ * One buffer of a scatter or gather list
+ */
+typedef struct
+{
+  /** Start of the buffer */
+  OFC_LPVOID buffer ;
+  /** Length of the buffer in bytes */
+  OFC_DWORD len ;
+} OFC_FS_PIPE_SEGMENT ;
+
+/**
+ * Conditions a wait set waits for on a pipe handle
+ */
+/** Data is queued to be read */
+#define OFC_FS_PIPE_READABLE 0x0001
+/** A write would not block */
+#define OFC_FS_PIPE_WRITABLE 0x0002
+/** Both ends are open */
+#define OFC_FS_PIPE_CONNECTED 0x0004
+/** The other end has closed */
+#define OFC_FS_PIPE_BROKEN 0x0008
+
+/**
+ * A pipe handle returned ready by OfcFSPipeWaitSetWait
+ */
+typedef struct
+{
+  /** The pipe handle */
+  OFC_HANDLE hPipe ;
+  /** Conditions that hold, among those it was added for */
+  OFC_DWORD events ;
+  /** Context the handle was added with */
+  OFC_VOID *context ;
+} OFC_FS_PIPE_READY ;
+
+/**
+ * Largest reply a pipe service handler can return
+ */
+#define OFC_FS_PIPE_SERVICE_REPLY_MAX (64 * 1024)
+
+/**
+ * Handle one request received by a pipe service
+ *
+ * Called on one of the service's workers.  Requests on one connection
+ * are handled one at a time and in order, requests on different
+ * connections may be handled at once.
+ *
+ * \param context
+ * Context the service was started with
+ *
+ * \param request
+ * The request.  Only valid until the handler returns.
+ *
+ * \param request_len
+ * Length of the request in bytes
+ *
+ * \param reply
+ * Where to put the reply
+ *
+ * \param reply_size
+ * Size of the reply buffer
+ *
+ * \param lpReplyLen
+ * Where to return the length of the reply.  Nothing is written back if
+ * it is left at 0.  A length larger than reply_size closes the
+ * connection without a reply.
+ *
+ * \returns
+ * OFC_TRUE to keep the connection, OFC_FALSE to close it
+ */
+typedef OFC_BOOL (*OFC_FS_PIPE_SERVICE_HANDLER) (OFC_VOID *context,
+						 const OFC_VOID *request,
+						 OFC_DWORD request_len,
+						 OFC_VOID *reply,
+						 OFC_DWORD reply_size,
+						 OFC_LPDWORD lpReplyLen) ;
+
 #if defined(__cplusplus)
 extern "C"
 {
 #endif
   OFC_VOID OfcFSPipeStartup (OFC_VOID) ;
   OFC_VOID OfcFSPipeShutdown (OFC_VOID);
+  /**
+   * Return the message pool statistics of all pipes
+   *
+   * \param stats
+   * Pointer to where to return the statistics.  Totals include pipes
+   * that have already been closed.
+   */
+  OFC_VOID OfcFSPipeGetPoolStats (OFC_FS_PIPE_POOL_STATS *stats) ;
+  /**
+   * Return the wait statistics of all pipes
+   *
+   * \param stats
+   * Pointer to where to return the statistics.  Totals include pipes
+   * that have already been closed.
+   */
+  OFC_VOID OfcFSPipeGetWaitStats (OFC_FS_PIPE_WAIT_STATS *stats) ;
+  /**
+   * Take a snapshot of the pipe statistics
+   *
+   * Counters are relaxed atomics that are read without any pipe's
+   * lock.  The snapshot holds a pipe's lock only long enough to read
+   * its state and queue depth, so it can be taken periodically without
+   * holding up traffic.
+   *
+   * \param global
+   * Optional.  Where to return the totals of the file system.
+   *
+   * \param instances
+   * Optional.  Where to return an array with an entry for each open
+   * instance.  Release it with OfcFSPipeFreeStats.
+   *
+   * \param count
+   * Optional.  Where to return the number of entries in the array.
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE if the array could not be
+   * allocated
+   */
+  OFC_BOOL OfcFSPipeGetStats (OFC_FS_PIPE_GLOBAL_STATS *global,
+			      OFC_FS_PIPE_INSTANCE_STATS **instances,
+			      OFC_UINT *count) ;
+  /**
+   * Release a snapshot returned by OfcFSPipeGetStats
+   *
+   * \param instances
+   * The array returned
+   *
+   * \param count
+   * The number of entries returned
+   */
+  OFC_VOID OfcFSPipeFreeStats (OFC_FS_PIPE_INSTANCE_STATS *instances,
+			       OFC_UINT count) ;
+  /**
+   * Set the spin count of pipes that do not configure their own
+   *
+   * Takes effect at the next wait.  Spinning helps when replies arrive
+   * within microseconds and there are cores to spare.  It wastes cycles
+   * otherwise.
+   *
+   * \param spin_count
+   * Most polls a reader makes before blocking.  0, the default, blocks
+   * straight away.
+   */
+  OFC_VOID OfcFSPipeSetSpinCount (OFC_UINT spin_count) ;
+  /**
+   * Turn latency histograms on or off
+   *
+   * Histograms are only available when the library is built with
+   * OFC_FS_PIPE_HISTOGRAMS.  They are off at startup.  While off,
+   * operations are not timed.
+   *
+   * \param enable
+   * OFC_TRUE to record latencies, OFC_FALSE to stop
+   */
+  OFC_VOID OfcFSPipeSetHistograms (OFC_BOOL enable) ;
+  /**
+   * Return latency percentiles of a pipe name
+   *
+   * Histograms are kept per name across all instances and survive the
+   * instances that recorded them.
+   *
+   * \param lpPipeName
+   * Name of the pipe.  Names are case insensitive.
+   *
+   * \param latency
+   * The operation to report on
+   *
+   * \param percentiles
+   * Pointer to where to return the percentiles
+   *
+   * \returns
+   * OFC_TRUE if the name has a histogram, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeGetPercentiles (OFC_LPCTSTR lpPipeName,
+				    OFC_FS_PIPE_LATENCY latency,
+				    OFC_FS_PIPE_PERCENTILES *percentiles) ;
+  /**
+   * Log the latency percentiles of every pipe name
+   */
+  OFC_VOID OfcFSPipeDumpHistograms (OFC_VOID) ;
+  /**
+   * Set the configuration of a pipe name
+   *
+   * \param lpPipeName
+   * Name of the pipe as it is opened on the pipe file system.  Names
+   * are case insensitive.
+   *
+   * \param config
+   * Configuration for new instances of the pipe or OFC_NULL to revert
+   * to the defaults.  Existing instances are not affected.
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeSetConfig (OFC_LPCTSTR lpPipeName,
+			       const OFC_FS_PIPE_CONFIG *config) ;
+  /**
+   * Bridge a pipe name to a local stream socket
+   *
+   * A client opening a bridged name when no server instance of it
+   * exists in this process is connected to the AF_UNIX stream socket
+   * at path, as served by an RPC daemon.  What the client writes is
+   * sent to the socket and what the daemon sends is read by the
+   * client.  A single forwarder thread moves the data for every
+   * bridged pipe, so no server thread is needed.  Bridged pipes are
+   * unbounded byte mode pipes whatever their configuration says.  Set
+   * bridges after OfcFSPipeStartup and before clients open the names.
+   *
+   * Only available when the library is built with
+   * OFC_FS_PIPE_SOCKET_BRIDGE.
+   *
+   * \param lpPipeName
+   * Name of the pipe as it is opened on the pipe file system.  Names
+   * are case insensitive.
+   *
+   * \param path
+   * Path of the socket or OFC_NULL to remove the bridge.  Pipes
+   * already open are not affected.
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeSetBridge (OFC_LPCTSTR lpPipeName,
+			       const OFC_CHAR *path) ;
+  /**
+   * Wait for a client to connect to a server instance
+   *
+   * A server created with OFC_FILE_FLAG_OVERLAPPED returns from
+   * CreateFile immediately without waiting for a client.  Instances
+   * created this way queue in the order they were created and clients
+   * are handed to the oldest one, so a single dispatcher thread can
+   * keep a backlog of listening instances and accept them as clients
+   * arrive.
+   *
+   * \param hPipe
+   * Handle of the server instance
+   *
+   * \param hOverlapped
+   * Optional overlapped handle.  If supplied and no client has
+   * connected yet, the call fails with OFC_ERROR_IO_PENDING and the
+   * overlapped event is set when one does.
+   *
+   * \returns
+   * OFC_TRUE if a client is connected.  Fails with OFC_ERROR_NO_DATA if
+   * the client has already come and gone.
+   */
+  OFC_BOOL OfcFSPipeConnect (OFC_HANDLE hPipe, OFC_HANDLE hOverlapped) ;
+  /**
+   * Return the completion event of a pipe overlapped handle
+   *
+   * ReadFile, WriteFile and TransactNamedPipe on a pipe accept an
+   * overlapped handle.  If the operation cannot complete immediately
+   * the call fails with OFC_ERROR_IO_PENDING and the event is set once
+   * it completes.  The event can be added to a wait set so one thread
+   * can service many outstanding operations.
+   *
+   * \param hOverlapped
+   * Overlapped handle created on a pipe handle
+   *
+   * \returns
+   * Handle to a manual reset event or OFC_HANDLE_NULL
+   */
+  OFC_HANDLE OfcFSPipeGetOverlappedEvent (OFC_HANDLE hOverlapped) ;
+  /**
+   * Send a request without waiting for its reply
+   *
+   * Many requests may be outstanding on one pipe instance at once.  Each
+   * carries a correlation id.  The server reads them with
+   * OfcFSPipeReadRequest and answers with OfcFSPipeWriteReply in any
+   * order.  Each reply is copied into the output buffer of the request
+   * with the same id and completes its overlapped handle.  Not
+   * supported on bounded pipes.
+   *
+   * \param hPipe
+   * Handle of the client end
+   *
+   * \param hOverlapped
+   * Overlapped handle created on the pipe.  Its event is set when the
+   * reply arrives and GetOverlappedResult returns the reply length.
+   * Destroying it cancels the request.
+   *
+   * \param id
+   * Correlation id.  Must not be 0 or match another request still
+   * outstanding on the handle.
+   *
+   * \param lpInBuffer
+   * The request
+   *
+   * \param nInBufferSize
+   * Size of the request
+   *
+   * \param lpOutBuffer
+   * Buffer for the reply.  It must stay valid until the request
+   * completes.  A longer reply is truncated and the request completes
+   * with OFC_ERROR_MORE_DATA.
+   *
+   * \param nOutBufferSize
+   * Size of the reply buffer
+   *
+   * \returns
+   * OFC_FALSE.  The last error is OFC_ERROR_IO_PENDING if the request
+   * was sent.
+   */
+  OFC_BOOL OfcFSPipeTransactPost (OFC_HANDLE hPipe,
+				  OFC_HANDLE hOverlapped,
+				  OFC_UINT32 id,
+				  OFC_LPVOID lpInBuffer,
+				  OFC_DWORD nInBufferSize,
+				  OFC_LPVOID lpOutBuffer,
+				  OFC_DWORD nOutBufferSize) ;
+  /**
+   * Read the next request along with its correlation id
+   *
+   * Blocks until a message arrives.  One request is returned per call
+   * regardless of the read mode.  If it does not fit the call fails with
+   * OFC_ERROR_MORE_DATA and the next call returns the rest under the
+   * same id.  Ordinary writes are returned with an id of 0.
+   *
+   * \param hPipe
+   * Handle of the server end
+   *
+   * \param lpBuffer
+   * Buffer to read the request into
+   *
+   * \param nNumberOfBytesToRead
+   * Size of the buffer
+   *
+   * \param lpNumberOfBytesRead
+   * Where to return the number of bytes read
+   *
+   * \param lpId
+   * Where to return the correlation id of the request
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeReadRequest (OFC_HANDLE hPipe,
+				 OFC_LPVOID lpBuffer,
+				 OFC_DWORD nNumberOfBytesToRead,
+				 OFC_LPDWORD lpNumberOfBytesRead,
+				 OFC_UINT32 *lpId) ;
+  /**
+   * Answer a request posted with OfcFSPipeTransactPost
+   *
+   * The reply is copied straight into the waiting caller's buffer.  A
+   * reply to a request that has been cancelled is discarded.
+   *
+   * \param hPipe
+   * Handle of the server end
+   *
+   * \param id
+   * Correlation id of the request being answered
+   *
+   * \param lpBuffer
+   * The reply
+   *
+   * \param nNumberOfBytesToWrite
+   * Size of the reply
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE if the client has gone
+   */
+  OFC_BOOL OfcFSPipeWriteReply (OFC_HANDLE hPipe,
+				OFC_UINT32 id,
+				OFC_LPVOID lpBuffer,
+				OFC_DWORD nNumberOfBytesToWrite) ;
+  /**
+   * Acquire a buffer owned by the pipe to write a message into
+   *
+   * The buffer is filled in place and handed to the reader by
+   * OfcFSPipeCommit without being copied.  Several buffers may be
+   * acquired at once.  Any not committed when the handle is closed are
+   * reclaimed.
+   *
+   * \param hPipe
+   * Handle of the end to write on
+   *
+   * \param nBytes
+   * Size of the buffer
+   *
+   * \returns
+   * Pointer to the buffer or OFC_NULL on failure
+   */
+  OFC_LPVOID OfcFSPipeAcquire (OFC_HANDLE hPipe, OFC_DWORD nBytes) ;
+  /**
+   * Write a buffer acquired with OfcFSPipeAcquire as one message
+   *
+   * The buffer belongs to the pipe again once this returns, whether or
+   * not it succeeds.  On a bounded pipe the contents are copied into the
+   * ring and the call blocks like WriteFile while the ring is full.
+   *
+   * \param hPipe
+   * Handle the buffer was acquired on
+   *
+   * \param lpBuffer
+   * Pointer returned by OfcFSPipeAcquire
+   *
+   * \param nBytes
+   * Number of bytes of the buffer to write, no more than were acquired.
+   * 0 gives the buffer back without writing anything.
+   *
+   * \returns
+   * OFC_TRUE if the message was written
+   */
+  OFC_BOOL OfcFSPipeCommit (OFC_HANDLE hPipe, OFC_LPVOID lpBuffer,
+			    OFC_DWORD nBytes) ;
+  /**
+   * Borrow the next message queued on a pipe without copying it
+   *
+   * Blocks until a message is available.  The message is removed from
+   * the pipe and remains valid until returned by OfcFSPipeRelease.  A
+   * message partly consumed by an earlier read is lent from where that
+   * read stopped.  Messages are lent one at a time regardless of the
+   * read mode.  Bounded pipes do not keep messages and fail with
+   * OFC_ERROR_NOT_SUPPORTED.
+   *
+   * \param hPipe
+   * Handle of the end to read on
+   *
+   * \param lpNumberOfBytes
+   * Where to return the size of the message
+   *
+   * \returns
+   * Pointer to the message or OFC_NULL on failure
+   */
+  OFC_LPVOID OfcFSPipeBorrow (OFC_HANDLE hPipe, OFC_LPDWORD lpNumberOfBytes) ;
+  /**
+   * Return a message borrowed with OfcFSPipeBorrow
+   *
+   * \param hPipe
+   * Handle the message was borrowed on
+   *
+   * \param lpBuffer
+   * Pointer returned by OfcFSPipeBorrow
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE if the buffer was not borrowed
+   */
+  OFC_BOOL OfcFSPipeRelease (OFC_HANDLE hPipe, OFC_LPVOID lpBuffer) ;
+  /**
+   * Look at the data queued on a pipe without consuming it
+   *
+   * Never blocks, so a server can poll its pipes rather than dedicating
+   * a thread to each.  In message mode only the head message is copied.
+   * In byte mode data is copied across messages.
+   *
+   * \param hPipe
+   * Handle of the end to look at
+   *
+   * \param lpBuffer
+   * Optional buffer to copy the data into
+   *
+   * \param nBufferSize
+   * Size of the buffer
+   *
+   * \param lpBytesRead
+   * Optional.  Where to return the number of bytes copied.
+   *
+   * \param lpTotalBytesAvail
+   * Optional.  Where to return the number of bytes queued.
+   *
+   * \param lpBytesLeftThisMessage
+   * Optional.  Where to return the bytes of the head message that were
+   * not copied.  Always 0 in byte mode.
+   *
+   * \returns
+   * OFC_TRUE if successful.  Fails with OFC_ERROR_BROKEN_PIPE once the
+   * other end has closed and nothing is left to read.
+   */
+  OFC_BOOL OfcFSPipePeek (OFC_HANDLE hPipe,
+			  OFC_LPVOID lpBuffer,
+			  OFC_DWORD nBufferSize,
+			  OFC_LPDWORD lpBytesRead,
+			  OFC_LPDWORD lpTotalBytesAvail,
+			  OFC_LPDWORD lpBytesLeftThisMessage) ;
+  /**
+   * Write a list of buffers as a single message
+   *
+   * The segments are gathered straight into the message so callers need
+   * not flatten them first.  On a bounded pipe they are written to the
+   * ring in turn and the call blocks like WriteFile while it is full.
+   *
+   * \param hPipe
+   * Handle of the end to write on
+   *
+   * \param segments
+   * Buffers to write, in order
+   *
+   * \param count
+   * Number of segments
+   *
+   * \param lpNumberOfBytesWritten
+   * Where to return the number of bytes written
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeWriteFileGather (OFC_HANDLE hPipe,
+				     const OFC_FS_PIPE_SEGMENT *segments,
+				     OFC_DWORD count,
+				     OFC_LPDWORD lpNumberOfBytesWritten) ;
+  /**
+   * Read into a list of buffers
+   *
+   * Blocks until data is available, then fills the segments in order.
+   * In message mode they are filled from one message and if it does
+   * not fit the call fails with OFC_ERROR_MORE_DATA, leaving the rest
+   * for the next read.  In byte mode they are filled with as much data
+   * as is queued.
+   *
+   * \param hPipe
+   * Handle of the end to read on
+   *
+   * \param segments
+   * Buffers to fill, in order
+   *
+   * \param count
+   * Number of segments.  Must be at least one.
+   *
+   * \param lpNumberOfBytesRead
+   * Where to return the number of bytes read across all segments
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeReadFileScatter (OFC_HANDLE hPipe,
+				     const OFC_FS_PIPE_SEGMENT *segments,
+				     OFC_DWORD count,
+				     OFC_LPDWORD lpNumberOfBytesRead) ;
+  /**
+   * Create a wait set
+   *
+   * A wait set lets one thread wait on many pipe handles at once, the
+   * way poll or epoll do for descriptors.  Conditions are level
+   * triggered: a handle is returned by every wait for as long as a
+   * condition it was added for holds.
+   *
+   * \returns
+   * Handle of the wait set or OFC_HANDLE_NULL
+   */
+  OFC_HANDLE OfcFSPipeCreateWaitSet (OFC_VOID) ;
+  /**
+   * Destroy a wait set
+   *
+   * Removes every handle still in the set.  No thread may be waiting
+   * on the set.
+   *
+   * \param hWaitSet
+   * Handle of the wait set
+   */
+  OFC_VOID OfcFSPipeDestroyWaitSet (OFC_HANDLE hWaitSet) ;
+  /**
+   * Add a pipe handle to a wait set or change what it is waited for
+   *
+   * A handle may be in several wait sets.  Closing it removes it from
+   * them.  Handles of pipes shared with another process cannot be
+   * added.
+   *
+   * \param hWaitSet
+   * Handle of the wait set
+   *
+   * \param hPipe
+   * Handle of either end of a pipe
+   *
+   * \param dwEvents
+   * Conditions to wait for, a combination of OFC_FS_PIPE_READABLE,
+   * OFC_FS_PIPE_WRITABLE, OFC_FS_PIPE_CONNECTED and OFC_FS_PIPE_BROKEN
+   *
+   * \param context
+   * Returned with the handle when it is ready
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeWaitSetAdd (OFC_HANDLE hWaitSet, OFC_HANDLE hPipe,
+				OFC_DWORD dwEvents, OFC_VOID *context) ;
+  /**
+   * Remove a pipe handle from a wait set
+   *
+   * \param hWaitSet
+   * Handle of the wait set
+   *
+   * \param hPipe
+   * Handle that was added
+   *
+   * \returns
+   * OFC_TRUE if successful.  Fails with OFC_ERROR_INVALID_PARAMETER if
+   * the handle is not in the set.
+   */
+  OFC_BOOL OfcFSPipeWaitSetRemove (OFC_HANDLE hWaitSet, OFC_HANDLE hPipe) ;
+  /**
+   * Wait for pipe handles in a wait set to become ready
+   *
+   * Handles are returned in the order they became ready.  If more are
+   * ready than fit, the rest are returned by the next wait.
+   *
+   * \param hWaitSet
+   * Handle of the wait set
+   *
+   * \param lpReady
+   * Where to return the ready handles
+   *
+   * \param nCount
+   * Most handles to return
+   *
+   * \param lpReadyCount
+   * Where to return the number of handles returned
+   *
+   * \param dwMilliseconds
+   * Most milliseconds to wait for something to be ready.  0 returns
+   * straight away and OFC_INFINITE waits without limit.  A wait that
+   * runs out succeeds with no handles returned.
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeWaitSetWait (OFC_HANDLE hWaitSet,
+				 OFC_FS_PIPE_READY *lpReady,
+				 OFC_DWORD nCount,
+				 OFC_LPDWORD lpReadyCount,
+				 OFC_DWORD dwMilliseconds) ;
+  /**
+   * Start serving a pipe name
+   *
+   * The service keeps listening instances of the name up, accepts
+   * clients, and reads each request on a pool of worker threads.  The
+   * handler's reply is written back on the instance the request came
+   * in on.  Each request is one message so the name should be read in
+   * message mode, the default.  Connections are handed between workers
+   * by work stealing, so a burst on a few connections is spread over
+   * the pool while the thread count stays fixed.
+   *
+   * \param lpPipeName
+   * Name of the pipe as it is opened on the pipe file system
+   *
+   * \param handler
+   * Called for each request
+   *
+   * \param context
+   * Passed to the handler
+   *
+   * \param workers
+   * Number of worker threads, at least one
+   *
+   * \returns
+   * Handle of the service or OFC_HANDLE_NULL
+   */
+  OFC_HANDLE OfcFSPipeServiceStart (OFC_LPCTSTR lpPipeName,
+				    OFC_FS_PIPE_SERVICE_HANDLER handler,
+				    OFC_VOID *context,
+				    OFC_UINT workers) ;
+  /**
+   * Stop a pipe service
+   *
+   * Waits for requests being handled to finish, then closes every
+   * instance of the service.  Services must be stopped before the pipe
+   * file system is shut down.
+   *
+   * \param hService
+   * Handle of the service
+   */
+  OFC_VOID OfcFSPipeServiceStop (OFC_HANDLE hService) ;
+  /**
+   * Set how long blocking calls on a pipe handle may wait
+   *
+   * Overrides the timeout of the pipe name's configuration for this
+   * end only.
+   *
+   * \param hPipe
+   * Handle of either end of a pipe
+   *
+   * \param dwMilliseconds
+   * Most milliseconds a call may wait before failing with
+   * OFC_ERROR_SEM_TIMEOUT.  0 fails any call that would block and
+   * OFC_INFINITE waits without limit.
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeSetTimeout (OFC_HANDLE hPipe, OFC_DWORD dwMilliseconds) ;
+  /**
+   * Wait a limited time for a client to connect to a server instance
+   *
+   * If no client connects in time the instance keeps listening and the
+   * call fails with OFC_ERROR_SEM_TIMEOUT.
+   *
+   * \param hPipe
+   * Handle of the server instance
+   *
+   * \param dwMilliseconds
+   * Most milliseconds to wait, OFC_INFINITE to wait without limit or
+   * OFC_FS_PIPE_WAIT_DEFAULT to use the handle's timeout
+   *
+   * \returns
+   * OFC_TRUE if a client is connected, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeConnectTimeout (OFC_HANDLE hPipe,
+				    OFC_DWORD dwMilliseconds) ;
+  /**
+   * Read from a pipe, waiting a limited time for data
+   *
+   * Otherwise as ReadFile.  A read that runs out fails with
+   * OFC_ERROR_SEM_TIMEOUT and consumes nothing.
+   *
+   * \param hPipe
+   * Handle of either end of a pipe
+   *
+   * \param lpBuffer
+   * Where to return the data
+   *
+   * \param nNumberOfBytesToRead
+   * Size of the buffer
+   *
+   * \param lpNumberOfBytesRead
+   * Where to return the number of bytes read
+   *
+   * \param dwMilliseconds
+   * Most milliseconds to wait, OFC_INFINITE to wait without limit or
+   * OFC_FS_PIPE_WAIT_DEFAULT to use the handle's timeout
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeReadFileTimeout (OFC_HANDLE hPipe,
+				     OFC_LPVOID lpBuffer,
+				     OFC_DWORD nNumberOfBytesToRead,
+				     OFC_LPDWORD lpNumberOfBytesRead,
+				     OFC_DWORD dwMilliseconds) ;
+  /**
+   * Write a request and read its reply within a time limit
+   *
+   * Otherwise as TransactNamedPipe.  The limit covers both the write
+   * and the wait for the reply.  If it runs out while waiting for the
+   * reply the request has been sent and the reply, when it comes, is
+   * returned by the next read.
+   *
+   * \param hPipe
+   * Handle of either end of a pipe
+   *
+   * \param lpInBuffer
+   * The request
+   *
+   * \param nInBufferSize
+   * Length of the request
+   *
+   * \param lpOutBuffer
+   * Where to return the reply
+   *
+   * \param nOutBufferSize
+   * Size of the reply buffer
+   *
+   * \param lpBytesRead
+   * Where to return the length of the reply
+   *
+   * \param dwMilliseconds
+   * Most milliseconds to wait, OFC_INFINITE to wait without limit or
+   * OFC_FS_PIPE_WAIT_DEFAULT to use the handle's timeout
+   *
+   * \returns
+   * OFC_TRUE if successful, OFC_FALSE otherwise
+   */
+  OFC_BOOL OfcFSPipeTransactTimeout (OFC_HANDLE hPipe,
+				     OFC_LPVOID lpInBuffer,
+				     OFC_DWORD nInBufferSize,
+				     OFC_LPVOID lpOutBuffer,
+				     OFC_DWORD nOutBufferSize,
+				     OFC_LPDWORD lpBytesRead,
+				     OFC_DWORD dwMilliseconds) ;
 #if defined(__cplusplus)
 }
 #endif
@@ -11,47 +11,428 @@
 #include "ofc/thread.h"
 #include "ofc/lock.h"
 #include "ofc/heap.h"
+#include "ofc/event.h"
+#include "ofc/time.h"
+#include "ofc/timer.h"
+#include "ofc/waitset.h"
 
 #include "ofc/fs.h"
 #include "ofc/fstype.h"
 
+#include "of_core_fs_pipe/fs_pipe.h"
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+#include "fs_pipe_shm.h"
+#endif
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+#include "fs_pipe_bridge.h"
+#endif
+
 /**
  * \defgroup pipe Pipe File Interface
  */
 
 /** \{ */
 
-typedef struct
+typedef struct _OFC_FS_PIPE_DATA
 {
+  /*
+   * Link on the pool free list while the message is not in use or on a
+   * half's loan list while it is lent to the caller
+   */
+  struct _OFC_FS_PIPE_DATA *free_next ;
+  /* Pool size class or OFC_FS_PIPE_POOL_HEAP */
+  OFC_INT pool_class ;
   OFC_UINT len ;
   OFC_INT offset ;
+  /* Link on the reading half's queue */
+  struct _OFC_FS_PIPE_DATA *next ;
+  /* Correlation id of a pipelined request, 0 for ordinary data */
+  OFC_UINT32 id ;
   OFC_CHAR buffer[1] ;
 } OFC_FS_PIPE_DATA ;
 
+/*
+ * Message Pool
+ *
+ * Each pipe file keeps a small cache of released messages per size
+ * class.  The free lists are lock free: a release pushes with a compare
+ * and swap, and an allocation takes the whole list, keeps its first
+ * message and puts the rest back.  Taking the list in one exchange
+ * means a message is never unlinked through a stale next pointer.
+ * Payloads larger than the biggest class go straight to the heap.
+ */
+#define OFC_FS_PIPE_POOL_CLASSES 4
+#define OFC_FS_PIPE_POOL_DEPTH 16
+#define OFC_FS_PIPE_POOL_HEAP (-1)
+
+static const OFC_DWORD
+pipe_pool_class_size[OFC_FS_PIPE_POOL_CLASSES] =
+  {
+    128, 1024, 4096, 65536
+  } ;
+
+typedef struct
+{
+  OFC_FS_PIPE_DATA *free[OFC_FS_PIPE_POOL_CLASSES] ;
+  OFC_UINT depth[OFC_FS_PIPE_POOL_CLASSES] ;
+  OFC_FS_PIPE_POOL_STATS stats ;
+} OFC_FS_PIPE_POOL ;
+
+/*
+ * Bounded Ring
+ *
+ * When a pipe is configured with a buffer size, each direction owns a
+ * contiguous ring of that capacity.  Written bytes are copied straight
+ * into the reader's ring and writers block (or return short in no wait
+ * mode) while it is full.  Without a buffer size, messages are queued
+ * on the reader's wait queue without bound.
+ */
+typedef struct
+{
+  OFC_CHAR *buffer ;
+  OFC_DWORD size ;
+  /* Offset of the next byte to read */
+  OFC_DWORD head ;
+  /* Number of bytes queued */
+  OFC_DWORD count ;
+} OFC_FS_PIPE_RING ;
+
+/*
+ * Configuration registered for a pipe name with OfcFSPipeSetConfig
+ */
+typedef struct _OFC_FS_PIPE_CONFIG_ENTRY
+{
+  struct _OFC_FS_PIPE_CONFIG_ENTRY *next ;
+  OFC_TCHAR *name ;
+  OFC_FS_PIPE_CONFIG config ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+  /* Socket set with OfcFSPipeSetBridge */
+  OFC_CHAR *bridge ;
+#endif
+} OFC_FS_PIPE_CONFIG_ENTRY ;
+
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+#define OFC_FS_PIPE_HISTOGRAM_BUCKETS 32
+
+/*
+ * Latency histograms of a pipe name.  Bucket 0 counts operations that
+ * took under a microsecond and bucket n those that took at least
+ * 2^(n-1) and under 2^n.
+ */
+typedef struct _OFC_FS_PIPE_HISTOGRAM
+{
+  struct _OFC_FS_PIPE_HISTOGRAM *next ;
+  OFC_TCHAR *name ;
+  OFC_UINT64 buckets[OFC_FS_PIPE_LATENCY_MAX][OFC_FS_PIPE_HISTOGRAM_BUCKETS] ;
+} OFC_FS_PIPE_HISTOGRAM ;
+#endif
+
 struct _OFC_FS_PIPE_HALF;
 
+/*
+ * Overlapped I/O
+ *
+ * A read or write posted with an overlapped handle that cannot be
+ * satisfied immediately is queued on the half and the call returns
+ * OFC_ERROR_IO_PENDING.  The operation is advanced whenever the other
+ * half reads or writes and its manual reset event is set when it
+ * completes.
+ */
+typedef struct _OFC_FS_PIPE_OVERLAPPED
+{
+  struct _OFC_FS_PIPE_OVERLAPPED *next ;
+  OFC_HANDLE hEvent ;
+  OFC_OFFT offset ;
+  /* Half the operation is pending on, OFC_NULL if none */
+  struct _OFC_FS_PIPE_HALF *half ;
+  /* Pipe file of the last operation, whose lock guards half */
+  struct _OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_CHAR *buffer ;
+  OFC_DWORD len ;
+  OFC_DWORD transferred ;
+  OFC_DWORD error ;
+  /* Correlation id of a pipelined transact */
+  OFC_UINT32 id ;
+} OFC_FS_PIPE_OVERLAPPED ;
+
+typedef struct
+{
+  OFC_FS_PIPE_OVERLAPPED *first ;
+  OFC_FS_PIPE_OVERLAPPED *last ;
+} OFC_FS_PIPE_OVQ ;
+
 typedef struct _OFC_FS_PIPE_FILE
 {
   /* Since this is queued in shared memory, link must be first */
   struct _OFC_FS_PIPE_FILE *next ;
+  struct _OFC_FS_PIPE_FILE *prev ;
+  /*
+   * Link within the hash bucket of instances waiting for a client
+   */
+  struct _OFC_FS_PIPE_FILE *free_next ;
+  struct _OFC_FS_PIPE_FILE *free_prev ;
   OFC_TCHAR *name;
+  OFC_UINT32 hash ;
+  OFC_BOOL registered ;
+  OFC_BOOL listening ;
+  /*
+   * Guards the sibling links and the data queues of both halves
+   */
+  OFC_LOCK lock ;
+  OFC_FS_PIPE_POOL pool ;
+  OFC_FS_PIPE_WAIT_STATS wait_stats ;
+  /*
+   * Traffic read by the server and by the client.  Kept here rather
+   * than in the halves so a direction's history outlives its reader.
+   */
+  OFC_FS_PIPE_DIRECTION_STATS inbound ;
+  OFC_FS_PIPE_DIRECTION_STATS outbound ;
+  /* Configuration in effect when the server instance was created */
+  OFC_FS_PIPE_CONFIG config ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  OFC_FS_PIPE_HISTOGRAM *histogram ;
+#endif
   struct _OFC_FS_PIPE_HALF *server ;
   struct _OFC_FS_PIPE_HALF *client ;
 } OFC_FS_PIPE_FILE ;
 
+/*
+ * A synchronous read blocked waiting for data.  Writers hand data
+ * straight to it rather than queueing a message.
+ */
+typedef struct
+{
+  OFC_CHAR *buffer ;
+  OFC_DWORD len ;
+  OFC_DWORD read ;
+  OFC_BOOL done ;
+} OFC_FS_PIPE_PARKED ;
+
+/*
+ * A timer paired with an event in an ofc wait set, for waits with a
+ * deadline.  Created on the first timed wait and kept for the next.
+ * Only one thread uses it at a time, which busy records under the lock
+ * of its owner.
+ */
+typedef struct
+{
+  OFC_HANDLE hWaitSet ;
+  OFC_HANDLE hTimer ;
+  OFC_BOOL busy ;
+} OFC_FS_PIPE_TIMED ;
+
+/*
+ * A pipe handle in a wait set.  Linked on the members of the set and
+ * on the watchers of its half, and queued on the set's ready list
+ * while it may be ready.
+ */
+typedef struct _OFC_FS_PIPE_WATCH
+{
+  struct _OFC_FS_PIPE_WATCH *next ;
+  struct _OFC_FS_PIPE_WATCH *half_next ;
+  struct _OFC_FS_PIPE_WATCH *ready_next ;
+  struct _OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_HANDLE hPipe ;
+  OFC_DWORD events ;
+  OFC_VOID *context ;
+  /* Pass of the set that last looked at it */
+  OFC_UINT pass ;
+  OFC_BOOL queued ;
+  OFC_BOOL removed ;
+} OFC_FS_PIPE_WATCH ;
+
+/*
+ * The lock guards the lists of the set and the flags of its members.
+ * Members removed while threads are waiting are kept until the last
+ * one leaves, since a waiter may be looking at them.
+ */
+typedef struct _OFC_FS_PIPE_WAITSET
+{
+  OFC_LOCK lock ;
+  OFC_HANDLE hEvent ;
+  OFC_FS_PIPE_WATCH *members ;
+  OFC_FS_PIPE_WATCH *ready_first ;
+  OFC_FS_PIPE_WATCH *ready_last ;
+  OFC_FS_PIPE_WATCH *removed ;
+  OFC_UINT waiters ;
+  OFC_UINT pass ;
+  /* Set to release every wait on the set, now and later */
+  volatile OFC_BOOL interrupted ;
+  OFC_FS_PIPE_TIMED timed ;
+} OFC_FS_PIPE_WAITSET ;
+
 typedef struct _OFC_FS_PIPE_HALF
 {
   OFC_HANDLE hPipe ;
+  /*
+   * Readers block here until the sibling writes.  The messages
+   * themselves are linked on first and last under the pipe lock so
+   * the data path does not go through the waitq's own locking.
+   */
   OFC_HANDLE hWaitQ;
+  /* Writers block here while the sibling's ring is full */
+  OFC_HANDLE hSpaceQ ;
   OFC_FS_PIPE_FILE *pipe_file;
   struct _OFC_FS_PIPE_HALF *sibling ;
+  /* Bytes written by the sibling when the pipe is bounded */
+  OFC_FS_PIPE_RING ring ;
+  OFC_BOOL nowait ;
+  /* Milliseconds a blocking call may wait, or OFC_INFINITE */
+  OFC_DWORD timeout ;
+  /* For timed waits on hWaitQ and hSpaceQ */
+  OFC_FS_PIPE_TIMED data_timed ;
+  OFC_FS_PIPE_TIMED space_timed ;
+  OFC_FS_PIPE_READMODE read_mode ;
+  /* Statistics of the direction this half reads */
+  OFC_FS_PIPE_DIRECTION_STATS *stats ;
+  /* Reader blocked on hWaitQ that writers can hand data to */
+  OFC_FS_PIPE_PARKED *parked ;
+  /* Messages written by the sibling */
+  OFC_FS_PIPE_DATA *first ;
+  OFC_FS_PIPE_DATA *last ;
+  /* Threads blocked on hWaitQ */
+  OFC_UINT waiters ;
+  /*
+   * Bumped whenever readers are woken so a spinning reader can tell
+   * without the lock that something happened
+   */
+  volatile OFC_UINT wakes ;
+  /* Current spin budget, adapted between 1 and the configured count */
+  OFC_UINT spin ;
+  /* Bytes and messages queued */
+  OFC_DWORD queued ;
+  OFC_DWORD messages ;
+  /* Set once the half has been connected to a sibling */
+  OFC_BOOL connected ;
+  /* Pending overlapped reads, writes and connects */
+  OFC_FS_PIPE_OVQ reads ;
+  OFC_FS_PIPE_OVQ writes ;
+  OFC_FS_PIPE_OVQ connects ;
+  /* Pipelined transacts waiting for their reply */
+  OFC_FS_PIPE_OVQ calls ;
+  /* Buffers acquired for writing and not yet committed */
+  OFC_FS_PIPE_DATA *acquired ;
+  /* Messages borrowed for reading and not yet released */
+  OFC_FS_PIPE_DATA *borrowed ;
+  /* Wait set members watching this half */
+  OFC_FS_PIPE_WATCH *watches ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  /* Shared memory instance when the other end is in another process */
+  OFC_FS_PIPE_SHM *shm ;
+#endif
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+  /*
+   * Forwarder serving this half when the pipe is bridged to a socket.
+   * Only ever set on the server half, which has no handle outside.
+   */
+  OFC_FS_PIPE_BRIDGE *bridge ;
+#endif
 } OFC_FS_PIPE_HALF ;
 
+/*
+ * One name in a listing of the pipe file system
+ */
+typedef struct
+{
+  OFC_TCHAR *name ;
+  /* Server instances of the name and how many have no client */
+  OFC_UINT instances ;
+  OFC_UINT listening ;
+} OFC_FS_PIPE_FIND_ENTRY ;
+
+/*
+ * A listing in progress.  The names are copied when the listing starts
+ * so FindNextFile never touches the registry.
+ */
+typedef struct
+{
+  OFC_FS_PIPE_FIND_ENTRY *entries ;
+  OFC_UINT count ;
+  OFC_UINT next ;
+} OFC_FS_PIPE_FIND ;
+
+/*
+ * Number of buckets in the pipe name hash.  Must be a power of two.
+ */
+#define OFC_FS_PIPE_HASH_SIZE 256
+
+/*
+ * A bucket is a queue of server instances that have no client yet.
+ * Instances of the same name are handed out in the order they were
+ * created.
+ */
+typedef struct
+{
+  OFC_FS_PIPE_FILE *first ;
+  OFC_FS_PIPE_FILE *last ;
+} OFC_FS_PIPE_BUCKET ;
+
+/*
+ * Lock Ordering
+ *
+ * The global pipes.lock only guards the name registry: the list of
+ * pipe files, the hash of listening instances, the client slot of
+ * each registered pipe file and the per name configuration.  It is
+ * taken when a pipe is created or opened and when the last half of a
+ * pipe is closed and the pipe file is unlinked.
+ *
+ * Each pipe file carries its own lock which guards the data path of
+ * that pipe: the sibling links of both halves and their data queues.
+ * Reads and writes on unrelated pipes therefore never contend.  The
+ * queues are plain lists under this lock.  The waitqs of a half are
+ * only used to park and wake threads, so streaming between two busy
+ * threads takes no lock but this one.
+ *
+ * When more than one lock is needed, they are always taken in this
+ * order:
+ *
+ *   ofc_handle_lock (hFile) -> pipes.lock -> pipe_file->lock
+ *
+ * ofc_handle_lock only pins a handle while it is in use, so an
+ * overlapped handle may be locked with a pipe lock held.  Destroying
+ * an overlapped structure takes pipes.lock ahead of the lock of the
+ * pipe its operation is pending on.
+ *
+ * Histograms are created under pipes.lock and live until shutdown, so
+ * their buckets are updated and read without any lock.
+ *
+ * A shared instance is held under the pipe lock, which is then
+ * dropped.  Its read and write locks are taken with no pipe lock held
+ * and are kept while blocked on its rings.
+ *
+ * The remaining locks are leaves.  No other lock of the pipe handler
+ * is taken while one is held:
+ *
+ *   bridges.lock      taken under a pipe lock to ready a bridged half
+ *   waitset->lock     taken under a pipe lock when a half wakes its
+ *                     watchers
+ *   service->lock     taken with no pipe lock held
+ *   deque->lock       taken with no pipe lock held.  Thieves only try
+ *                     it.
+ *
+ * Neither pipes.lock nor a pipe file lock may be held while blocked on
+ * a wait queue.
+ */
 typedef struct
 {
   OFC_LOCK lock ;
   OFC_FS_PIPE_FILE *first ;
   OFC_FS_PIPE_FILE *last ;
+  OFC_FS_PIPE_BUCKET listening[OFC_FS_PIPE_HASH_SIZE] ;
+  /* Pool statistics of pipe files that have been freed */
+  OFC_FS_PIPE_POOL_STATS pool_stats ;
+  OFC_FS_PIPE_WAIT_STATS wait_stats ;
+  /*
+   * Instance counts and the traffic of pipe files that have been freed
+   */
+  OFC_FS_PIPE_GLOBAL_STATS stats ;
+  /* Spin count of pipes that do not configure their own */
+  volatile OFC_UINT spin_count ;
+  OFC_FS_PIPE_CONFIG_ENTRY *configs ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  volatile OFC_BOOL histograms ;
+  OFC_FS_PIPE_HISTOGRAM *histogram_list ;
+#endif
 } OFC_PIPES ;
 
 OFC_PIPES pipes;
@@ -66,524 +447,5304 @@ OFC_VOID ofc_pipe_unlock (OFC_VOID)
   ofc_unlock(pipes.lock);
 }
 
-static OFC_VOID pipe_unlink_internal (OFC_FS_PIPE_FILE *pipe_file)
+/*
+ * Pipe names are case insensitive.  Fold ASCII so that the hash and the
+ * comparison agree.
+ */
+static OFC_TCHAR pipe_fold (OFC_TCHAR c)
 {
-  OFC_FS_PIPE_FILE *curr;
-  OFC_FS_PIPE_FILE *prev;
-  OFC_BOOL found ;
+  if (c >= TCHAR('a') && c <= TCHAR('z'))
+    c = c - TCHAR('a') + TCHAR('A') ;
+  else if (c == TCHAR('/'))
+    c = TCHAR('\\') ;
+  return (c) ;
+}
 
-  prev = OFC_NULL;
-  found = OFC_FALSE ;
+/*
+ * Names may reach us with or without a leading separator depending on
+ * how the path was mapped, so they are compared without it
+ */
+static OFC_LPCTSTR pipe_name_skip (OFC_LPCTSTR name)
+{
+  for ( ; pipe_fold (*name) == TCHAR('\\') ; name++) ;
+  return (name) ;
+}
 
-  for (curr = pipes.first ;
-       curr != OFC_NULL && !found ;)
+static OFC_UINT32 pipe_hash (OFC_LPCTSTR name)
+{
+  OFC_UINT32 hash ;
+  /*
+   * FNV-1a over the folded characters
+   */
+  hash = 2166136261U ;
+  for (name = pipe_name_skip (name) ; *name != TCHAR_EOS ; name++)
     {
-      if (curr == pipe_file)
-	found = OFC_TRUE ;
-      else
+      hash ^= (OFC_UINT32) pipe_fold (*name) ;
+      hash *= 16777619U ;
+    }
+  return (hash) ;
+}
+
+static OFC_BOOL pipe_name_equal (OFC_LPCTSTR a, OFC_LPCTSTR b)
+{
+  a = pipe_name_skip (a) ;
+  b = pipe_name_skip (b) ;
+  for ( ; *a != TCHAR_EOS && pipe_fold (*a) == pipe_fold (*b) ; a++, b++) ;
+  return (pipe_fold (*a) == pipe_fold (*b)) ;
+}
+
+/*
+ * Order names the way they are compared so that a listing is sorted
+ * case insensitively
+ */
+static OFC_INT pipe_name_compare (OFC_LPCTSTR a, OFC_LPCTSTR b)
+{
+  a = pipe_name_skip (a) ;
+  b = pipe_name_skip (b) ;
+  for ( ; *a != TCHAR_EOS && pipe_fold (*a) == pipe_fold (*b) ; a++, b++) ;
+  return ((OFC_INT) pipe_fold (*a) - (OFC_INT) pipe_fold (*b)) ;
+}
+
+/*
+ * Match a name against a pattern of * and ? wildcards.  On a mismatch
+ * the last * is made to swallow one more character.
+ */
+static OFC_BOOL pipe_name_match (OFC_LPCTSTR pattern, OFC_LPCTSTR name)
+{
+  OFC_LPCTSTR star ;
+  OFC_LPCTSTR resume ;
+  OFC_BOOL ret ;
+
+  pattern = pipe_name_skip (pattern) ;
+  name = pipe_name_skip (name) ;
+  star = OFC_NULL ;
+  resume = OFC_NULL ;
+  ret = OFC_TRUE ;
+
+  while (ret && *name != TCHAR_EOS)
+    {
+      if (*pattern == TCHAR('*'))
+	{
+	  star = ++pattern ;
+	  resume = name ;
+	}
+      else if (*pattern == TCHAR('?') ||
+	       (*pattern != TCHAR_EOS &&
+		pipe_fold (*pattern) == pipe_fold (*name)))
+	{
+	  pattern++ ;
+	  name++ ;
+	}
+      else if (star != OFC_NULL)
 	{
-	  prev = curr ;
-	  curr = curr->next;
+	  pattern = star ;
+	  name = ++resume ;
 	}
+      else
+	ret = OFC_FALSE ;
     }
 
-  if (found)
+  for ( ; ret && *pattern == TCHAR('*') ; pattern++) ;
+  return (ret && *pattern == TCHAR_EOS) ;
+}
+
+static OFC_FS_PIPE_BUCKET *pipe_bucket (OFC_UINT32 hash)
+{
+  return (&pipes.listening[hash & (OFC_FS_PIPE_HASH_SIZE - 1)]) ;
+}
+
+static OFC_VOID pipe_listen_internal (OFC_FS_PIPE_FILE *pipe_file)
+{
+  OFC_FS_PIPE_BUCKET *bucket ;
+
+  bucket = pipe_bucket (pipe_file->hash) ;
+
+  pipe_file->free_next = OFC_NULL ;
+  pipe_file->free_prev = bucket->last ;
+  if (bucket->last == OFC_NULL)
+    bucket->first = pipe_file ;
+  else
+    bucket->last->free_next = pipe_file ;
+  bucket->last = pipe_file ;
+  pipe_file->listening = OFC_TRUE ;
+}
+
+static OFC_VOID pipe_unlisten_internal (OFC_FS_PIPE_FILE *pipe_file)
+{
+  OFC_FS_PIPE_BUCKET *bucket ;
+
+  if (pipe_file->listening)
     {
-      if (prev == OFC_NULL)
+      bucket = pipe_bucket (pipe_file->hash) ;
+
+      if (pipe_file->free_prev == OFC_NULL)
+	bucket->first = pipe_file->free_next ;
+      else
+	pipe_file->free_prev->free_next = pipe_file->free_next ;
+
+      if (pipe_file->free_next == OFC_NULL)
+	bucket->last = pipe_file->free_prev ;
+      else
+	pipe_file->free_next->free_prev = pipe_file->free_prev ;
+
+      pipe_file->free_next = OFC_NULL ;
+      pipe_file->free_prev = OFC_NULL ;
+      pipe_file->listening = OFC_FALSE ;
+    }
+}
+
+/*
+ * Find the oldest instance of a pipe that is waiting for a client
+ */
+static OFC_FS_PIPE_FILE *pipe_lookup_internal (OFC_LPCTSTR name)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_UINT32 hash ;
+
+  hash = pipe_hash (name) ;
+  for (pipe_file = pipe_bucket (hash)->first ;
+       pipe_file != OFC_NULL &&
+	 (pipe_file->hash != hash ||
+	  !pipe_name_equal (pipe_file->name, name)) ;
+       pipe_file = pipe_file->free_next) ;
+
+  return (pipe_file) ;
+}
+
+/*
+ * Count the instances of a pipe that are waiting for a client
+ */
+static OFC_UINT pipe_listen_count (OFC_LPCTSTR name, OFC_UINT32 hash)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_UINT count ;
+
+  count = 0 ;
+  for (pipe_file = pipe_bucket (hash)->first ;
+       pipe_file != OFC_NULL ;
+       pipe_file = pipe_file->free_next)
+    {
+      if (pipe_file->hash == hash && pipe_name_equal (pipe_file->name, name))
+	count++ ;
+    }
+  return (count) ;
+}
+
+static OFC_VOID pipe_unlink_internal (OFC_FS_PIPE_FILE *pipe_file)
+{
+  if (pipe_file->registered)
+    {
+      pipe_unlisten_internal (pipe_file) ;
+
+      if (pipe_file->prev == OFC_NULL)
 	pipes.first = pipe_file->next ;
       else
-	{
-	  prev->next = pipe_file->next;
-	}
+	pipe_file->prev->next = pipe_file->next ;
+
       if (pipe_file->next == OFC_NULL)
-	pipes.last = OFC_NULL ;
+	pipes.last = pipe_file->prev ;
+      else
+	pipe_file->next->prev = pipe_file->prev ;
+
+      pipe_file->next = OFC_NULL ;
+      pipe_file->prev = OFC_NULL ;
+      pipe_file->registered = OFC_FALSE ;
+      pipes.stats.instances-- ;
     }
 }
 
 OFC_VOID pipe_enqueue_internal (OFC_FS_PIPE_FILE *pipe_file)
 {
-  OFC_FS_PIPE_FILE *prev ;
-
   pipe_file->next = OFC_NULL;
+  pipe_file->prev = pipes.last ;
 
   if (pipes.last == OFC_NULL)
     pipes.first = pipe_file ;
   else
-    {
-      prev = pipes.last ;
-      prev->next = pipe_file;
-    }
+    pipes.last->next = pipe_file;
 
   pipes.last = pipe_file;
+  pipe_file->registered = OFC_TRUE ;
+
+  pipes.stats.instances_created++ ;
+  pipes.stats.instances++ ;
+  if (pipes.stats.instances > pipes.stats.instances_hwm)
+    pipes.stats.instances_hwm = pipes.stats.instances ;
+
+  pipe_listen_internal (pipe_file) ;
 }
 
-static OFC_HANDLE OfcFSPipeCreateFile (OFC_LPCTSTR lpFileName,
-					 OFC_DWORD dwDesiredAccess,
-					 OFC_DWORD dwShareMode,
-					 OFC_LPSECURITY_ATTRIBUTES 
-					 lpSecAttributes,
-					 OFC_DWORD dwCreationDisposition,
-					 OFC_DWORD dwFlagsAndAttributes,
-					 OFC_HANDLE hTemplateFile)
+static OFC_UINT64 pipe_now (OFC_VOID)
 {
-  OFC_HANDLE ret ;
-  OFC_FS_PIPE_FILE *pipe_file ;
-  OFC_FS_PIPE_HALF *client ;
-  OFC_FS_PIPE_HALF *server ;
-  OFC_BOOL found ;
+  OFC_ULONG sec ;
+  OFC_ULONG usec ;
 
-  ret = OFC_HANDLE_NULL ;
+  ofc_time_get_runtime (&sec, &usec) ;
+  return ((OFC_UINT64) sec * 1000000 + usec) ;
+}
 
-  /*
-   * If it's create always, we create the pipe (even if there's other pipes
-   * with the same name) and add it to the pipe list.  We will then
-   * wait for a connection before we return
-   */
-  if (dwCreationDisposition == OFC_CREATE_ALWAYS ||
-      dwCreationDisposition == OFC_CREATE_NEW)
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+/*
+ * Return the histograms of a pipe name.  Called with pipes.lock held
+ */
+static OFC_FS_PIPE_HISTOGRAM *pipe_histogram_lookup (OFC_LPCTSTR name)
+{
+  OFC_FS_PIPE_HISTOGRAM *histogram ;
+
+  for (histogram = pipes.histogram_list ;
+       histogram != OFC_NULL && !pipe_name_equal (histogram->name, name) ;
+       histogram = histogram->next) ;
+
+  return (histogram) ;
+}
+
+/*
+ * Return the histograms of a pipe name, creating them the first time
+ * the name is used.  Called with pipes.lock held
+ */
+static OFC_FS_PIPE_HISTOGRAM *pipe_histogram_get (OFC_LPCTSTR name)
+{
+  OFC_FS_PIPE_HISTOGRAM *histogram ;
+
+  histogram = pipe_histogram_lookup (name) ;
+  if (histogram == OFC_NULL)
     {
-      pipe_file = ofc_malloc(sizeof (OFC_FS_PIPE_FILE)) ;
-      if (pipe_file != OFC_NULL)
+      histogram = ofc_malloc (sizeof (OFC_FS_PIPE_HISTOGRAM)) ;
+      if (histogram != OFC_NULL)
 	{
-	  /*
-	   * We're creating the server
-	   */
-	  pipe_file->name = ofc_tstrdup(lpFileName) ;
+	  ofc_memset (histogram, 0, sizeof (OFC_FS_PIPE_HISTOGRAM)) ;
+	  histogram->name = ofc_tstrdup (name) ;
+	  histogram->next = pipes.histogram_list ;
+	  pipes.histogram_list = histogram ;
+	}
+    }
+  return (histogram) ;
+}
 
-	  server = ofc_malloc(sizeof (OFC_FS_PIPE_HALF)) ;
-	  if (server != OFC_NULL)
-	    {
-	      server->hWaitQ = ofc_waitq_create();
+/*
+ * Start timing an operation.  Returns 0 when histograms are off, which
+ * pipe_latency_record takes to mean the operation was not timed.
+ */
+static OFC_UINT64 pipe_latency_start (OFC_VOID)
+{
+  OFC_UINT64 start ;
 
-	      server->hPipe = ofc_handle_create (OFC_HANDLE_PIPE, server) ;
-	      server->pipe_file = pipe_file ;
-	      server->sibling = OFC_NULL;
+  start = 0 ;
+  if (pipes.histograms)
+    start = pipe_now () ;
+  return (start) ;
+}
 
-	      pipe_file->server = server ;
-	      pipe_file->client = OFC_NULL ;
+static OFC_VOID pipe_latency_record (OFC_FS_PIPE_FILE *pipe_file,
+				     OFC_FS_PIPE_LATENCY latency,
+				     OFC_UINT64 start)
+{
+  OFC_UINT64 usecs ;
+  OFC_UINT bucket ;
+  OFC_UINT64 *counter ;
 
-	      ofc_pipe_lock () ;
-	      pipe_enqueue_internal (pipe_file) ;
-	      ofc_pipe_unlock() ;
+  if (start != 0 && pipe_file->histogram != OFC_NULL)
+    {
+      usecs = pipe_now () - start ;
+      for (bucket = 0 ;
+	   usecs != 0 && bucket < OFC_FS_PIPE_HISTOGRAM_BUCKETS - 1 ;
+	   bucket++)
+	usecs >>= 1 ;
 
-	      while (server->sibling == OFC_NULL  &&
-                     server->hWaitQ != OFC_HANDLE_NULL)
-		{
-		  ofc_waitq_block(server->hWaitQ);
-		}
+      counter = &pipe_file->histogram->buckets[latency][bucket] ;
+#if defined(__GNUC__)
+      __atomic_fetch_add (counter, 1, __ATOMIC_RELAXED) ;
+#else
+      (*counter)++ ;
+#endif
+    }
+}
 
-	      ret = server->hPipe ;
-	    }
-	  else
+/*
+ * Return the upper bound of the bucket holding a percentile
+ */
+static OFC_UINT64 pipe_percentile (const OFC_UINT64 *counts,
+				   OFC_UINT64 total,
+				   OFC_UINT percent)
+{
+  OFC_UINT64 rank ;
+  OFC_UINT64 seen ;
+  OFC_UINT bucket ;
+  OFC_UINT64 ret ;
+
+  ret = 0 ;
+  if (total > 0)
+    {
+      rank = (total * percent + 99) / 100 ;
+      seen = 0 ;
+      for (bucket = 0 ; bucket < OFC_FS_PIPE_HISTOGRAM_BUCKETS ; bucket++)
+	{
+	  seen += counts[bucket] ;
+	  if (seen >= rank)
 	    {
-	      ofc_free(pipe_file->name) ;
-	      ofc_free(pipe_file) ;
-	      ofc_thread_set_variable
-		(OfcLastError, 
-		 (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	      ret = (OFC_UINT64) 1 << bucket ;
+	      break ;
 	    }
 	}
     }
-  else
-    {
-      /*
-       * We are opening the pipe from the client side.  We look for a pipe
-       * that has no client
-       */
-      ofc_pipe_lock () ;
-      found = OFC_FALSE ;
+  return (ret) ;
+}
 
-      for (pipe_file = pipes.first ;
-	   pipe_file != OFC_NULL && !found ;)
-	{
-	  if (ofc_tstrcmp (pipe_file->name, 
-			   lpFileName) == 0 &&
-	      pipe_file->client == OFC_NULL)
-	    found = OFC_TRUE ;
-	  else
-	    pipe_file = pipe_file->next ;
-	}
+static OFC_VOID pipe_percentiles (OFC_FS_PIPE_HISTOGRAM *histogram,
+				  OFC_FS_PIPE_LATENCY latency,
+				  OFC_FS_PIPE_PERCENTILES *percentiles)
+{
+  OFC_UINT64 counts[OFC_FS_PIPE_HISTOGRAM_BUCKETS] ;
+  OFC_UINT bucket ;
 
-      if (!found)
-	{
-	  ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) 
-				 OFC_ERROR_FILE_NOT_FOUND) ;
-	}
-      else
-	{
-	  client = ofc_malloc(sizeof (OFC_FS_PIPE_HALF)) ;
-	  if (client != OFC_NULL)
-	    {
-	      pipe_file->client = client ;
-	      server = pipe_file->server ;
+  ofc_memset (percentiles, 0, sizeof (OFC_FS_PIPE_PERCENTILES)) ;
+  /*
+   * Copy the buckets first so the percentiles agree with the count
+   * while other threads go on recording
+   */
+  for (bucket = 0 ; bucket < OFC_FS_PIPE_HISTOGRAM_BUCKETS ; bucket++)
+    {
+#if defined(__GNUC__)
+      counts[bucket] = __atomic_load_n (&histogram->buckets[latency][bucket],
+					__ATOMIC_RELAXED) ;
+#else
+      counts[bucket] = histogram->buckets[latency][bucket] ;
+#endif
+      percentiles->count += counts[bucket] ;
+      if (counts[bucket] != 0)
+	percentiles->max_usecs = (OFC_UINT64) 1 << bucket ;
+    }
 
-	      client->hWaitQ = ofc_waitq_create();
-	      client->hPipe = ofc_handle_create (OFC_HANDLE_PIPE, client) ;
-	      client->pipe_file = pipe_file ;
-	      client->sibling = pipe_file->server ;
-	      server->sibling = client ;
-	      /*
-	       * Set the event
-	       */
-	      ofc_waitq_wake(server->hWaitQ);
+  percentiles->p50_usecs = pipe_percentile (counts, percentiles->count, 50) ;
+  percentiles->p90_usecs = pipe_percentile (counts, percentiles->count, 90) ;
+  percentiles->p99_usecs = pipe_percentile (counts, percentiles->count, 99) ;
+}
+#else
+static OFC_UINT64 pipe_latency_start (OFC_VOID)
+{
+  return (0) ;
+}
 
-	      ret = client->hPipe ;
-	    }
-	  else
-	    {
-	      ofc_thread_set_variable 
-		(OfcLastError, 
-		 (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
-	    }
-	}
-      ofc_pipe_unlock () ;
-    }
-  return (ret) ;
+static OFC_VOID pipe_latency_record (OFC_FS_PIPE_FILE *pipe_file,
+				     OFC_FS_PIPE_LATENCY latency,
+				     OFC_UINT64 start)
+{
 }
+#endif
 
-static OFC_BOOL 
-OfcFSPipeCreateDirectory (OFC_LPCTSTR lpPathName,
-			   OFC_LPSECURITY_ATTRIBUTES lpSecurityAttr) 
+/*
+ * Statistics counters are bumped without a lock of their own and read
+ * while they are being bumped, so they are relaxed atomics where the
+ * compiler provides them
+ */
+static OFC_VOID pipe_counter_add (OFC_UINT64 *counter, OFC_UINT64 n)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+#if defined(__GNUC__)
+  __atomic_fetch_add (counter, n, __ATOMIC_RELAXED) ;
+#else
+  *counter += n ;
+#endif
+}
 
-  return (OFC_FALSE) ;
+static OFC_UINT64 pipe_counter_get (OFC_UINT64 *counter)
+{
+#if defined(__GNUC__)
+  return (__atomic_load_n (counter, __ATOMIC_RELAXED)) ;
+#else
+  return (*counter) ;
+#endif
 }
 
-static OFC_BOOL OfcFSPipeWriteFile (OFC_HANDLE hFile,
-				      OFC_LPCVOID lpBuffer,
-				      OFC_DWORD nNumberOfBytesToWrite,
-				      OFC_LPDWORD lpNumberOfBytesWritten,
-				      OFC_HANDLE hOverlapped)
+/*
+ * Raise a high water mark
+ */
+static OFC_VOID pipe_hwm_raise (OFC_DWORD *hwm, OFC_DWORD value)
 {
-  OFC_BOOL ret ;
-  OFC_FS_PIPE_DATA *data ;
-  OFC_FS_PIPE_HALF *half ;
-  OFC_FS_PIPE_HALF *sibling ;
+#if defined(__GNUC__)
+  OFC_DWORD old ;
 
-  ret = OFC_FALSE ;
+  old = __atomic_load_n (hwm, __ATOMIC_RELAXED) ;
+  while (value > old &&
+	 !__atomic_compare_exchange_n (hwm, &old, value, OFC_TRUE,
+				       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+#else
+  if (value > *hwm)
+    *hwm = value ;
+#endif
+}
 
-  half = ofc_handle_lock (hFile) ;
-  if (half != OFC_NULL)
-    {
-      ofc_pipe_lock() ;
-      if (half->sibling != OFC_NULL)
-	{
-	  sibling = half->sibling ;
-	  data = ofc_malloc (sizeof (OFC_FS_PIPE_DATA) +
-			     nNumberOfBytesToWrite - 1) ;
-	  data->len = nNumberOfBytesToWrite ;
-	  data->offset = 0 ;
-	  ofc_memcpy (data->buffer, lpBuffer, nNumberOfBytesToWrite) ;
+static OFC_DWORD pipe_hwm_get (OFC_DWORD *hwm)
+{
+#if defined(__GNUC__)
+  return (__atomic_load_n (hwm, __ATOMIC_RELAXED)) ;
+#else
+  return (*hwm) ;
+#endif
+}
 
-	  ofc_waitq_enqueue(sibling->hWaitQ, data);
+/*
+ * Account for data arriving in a direction and track how deep its
+ * queue has grown
+ */
+static OFC_VOID pipe_stats_written (OFC_FS_PIPE_DIRECTION_STATS *stats,
+				    OFC_DWORD bytes, OFC_DWORD messages,
+				    OFC_DWORD queued_bytes,
+				    OFC_DWORD queued_messages)
+{
+  pipe_counter_add (&stats->bytes_written, bytes) ;
+  if (messages != 0)
+    pipe_counter_add (&stats->messages_written, messages) ;
+  pipe_hwm_raise (&stats->queued_bytes_hwm, queued_bytes) ;
+  pipe_hwm_raise (&stats->queued_messages_hwm, queued_messages) ;
+}
 
-	  if (lpNumberOfBytesWritten != OFC_NULL)
-	    *lpNumberOfBytesWritten = nNumberOfBytesToWrite ;
-	  ret = OFC_TRUE ;
-	}
-      else
-	{
-	  ofc_thread_set_variable (OfcLastError, 
-				 (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
-	}
-      ofc_pipe_unlock() ;
-      ofc_handle_unlock (hFile) ;
-    }
+static OFC_VOID pipe_direction_stats_add (OFC_FS_PIPE_GLOBAL_STATS *total,
+					  OFC_FS_PIPE_DIRECTION_STATS *stats)
+{
+  total->bytes_written += pipe_counter_get (&stats->bytes_written) ;
+  total->messages_written += pipe_counter_get (&stats->messages_written) ;
+  total->bytes_read += pipe_counter_get (&stats->bytes_read) ;
+  total->wait_usecs += pipe_counter_get (&stats->wait_usecs) ;
+}
 
-  return (ret) ;
+static OFC_VOID pipe_pool_init (OFC_FS_PIPE_POOL *pool)
+{
+  ofc_memset (pool, 0, sizeof (OFC_FS_PIPE_POOL)) ;
 }
 
-static OFC_BOOL OfcFSPipeReadFile (OFC_HANDLE hFile,
-				     OFC_LPVOID lpBuffer,
-				     OFC_DWORD nNumberOfBytesToRead,
-				     OFC_LPDWORD lpNumberOfBytesRead,
-				     OFC_HANDLE hOverlapped)
+/*
+ * Push the chain first..last onto a free list
+ */
+static OFC_VOID pipe_pool_push (OFC_FS_PIPE_DATA **list,
+				OFC_FS_PIPE_DATA *first,
+				OFC_FS_PIPE_DATA *last)
 {
-  OFC_BOOL ret ;
-  OFC_FS_PIPE_HALF *half ;
-  OFC_FS_PIPE_DATA *data ;
-  OFC_INT nBytes ;
+#if defined(__GNUC__)
+  OFC_FS_PIPE_DATA *head ;
 
-  ret = OFC_FALSE ;
+  head = __atomic_load_n (list, __ATOMIC_RELAXED) ;
+  do
+    last->free_next = head ;
+  while (!__atomic_compare_exchange_n (list, &head, first, OFC_TRUE,
+				       __ATOMIC_RELEASE, __ATOMIC_RELAXED)) ;
+#else
+  last->free_next = *list ;
+  *list = first ;
+#endif
+}
 
-  half = ofc_handle_lock (hFile) ;
-  if (half != OFC_NULL)
+/*
+ * Take the first message of a free list, OFC_NULL if it is empty.
+ * Anyone allocating while the rest is out of the list finds it empty
+ * and goes to the heap.
+ */
+static OFC_FS_PIPE_DATA *pipe_pool_pop (OFC_FS_PIPE_DATA **list)
+{
+  OFC_FS_PIPE_DATA *data ;
+  OFC_FS_PIPE_DATA *last ;
+
+#if defined(__GNUC__)
+  data = __atomic_exchange_n (list, OFC_NULL, __ATOMIC_ACQUIRE) ;
+#else
+  data = *list ;
+  *list = OFC_NULL ;
+#endif
+  if (data != OFC_NULL && data->free_next != OFC_NULL)
     {
-      ofc_pipe_lock() ;
+      for (last = data->free_next ;
+	   last->free_next != OFC_NULL ;
+	   last = last->free_next) ;
+      pipe_pool_push (list, data->free_next, last) ;
+    }
+  return (data) ;
+}
 
-      for (data = ofc_waitq_first(half->hWaitQ) ;
-	   data == OFC_NULL && half->sibling != OFC_NULL ;
-	   data = ofc_waitq_first(half->hWaitQ))
-	{
-	  ofc_pipe_unlock() ;
-	  ofc_waitq_block(half->hWaitQ);
-	  ofc_pipe_lock() ;
-	}
+/*
+ * Allocate a message able to hold len bytes
+ */
+static OFC_FS_PIPE_DATA *pipe_data_alloc (OFC_FS_PIPE_FILE *pipe_file,
+					  OFC_DWORD len)
+{
+  OFC_FS_PIPE_POOL *pool ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_INT pool_class ;
 
-      if (data == OFC_NULL)
+  pool = &pipe_file->pool ;
+
+  for (pool_class = 0 ;
+       pool_class < OFC_FS_PIPE_POOL_CLASSES &&
+	 len > pipe_pool_class_size[pool_class] ;
+       pool_class++) ;
+
+  if (pool_class == OFC_FS_PIPE_POOL_CLASSES)
+    {
+      pipe_counter_add (&pool->stats.oversize, 1) ;
+      data = ofc_malloc (sizeof (OFC_FS_PIPE_DATA) + len - 1) ;
+      pool_class = OFC_FS_PIPE_POOL_HEAP ;
+    }
+  else
+    {
+      data = pipe_pool_pop (&pool->free[pool_class]) ;
+      if (data != OFC_NULL)
 	{
-	  ofc_thread_set_variable (OfcLastError, 
-				 (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  pipe_counter_add (&pool->stats.hits, 1) ;
+#if defined(__GNUC__)
+	  __atomic_fetch_sub (&pool->depth[pool_class], 1, __ATOMIC_RELAXED) ;
+#else
+	  pool->depth[pool_class]-- ;
+#endif
 	}
       else
 	{
-	  nBytes = OFC_MIN(nNumberOfBytesToRead, data->len) ;
-	  ofc_memcpy (lpBuffer, data->buffer + data->offset, nBytes) ;
-	  if (lpNumberOfBytesRead != OFC_NULL)
-	    *lpNumberOfBytesRead = nBytes ;
-	  data->len -= nBytes ;
-	  data->offset += nBytes ;
-	  if (data->len == 0)
-	    {
-	      ofc_waitq_dequeue(half->hWaitQ);
-	      ofc_free (data) ;
-	    }
-	  ret = OFC_TRUE ;
+	  pipe_counter_add (&pool->stats.misses, 1) ;
+	  data = ofc_malloc (sizeof (OFC_FS_PIPE_DATA) +
+			     pipe_pool_class_size[pool_class] - 1) ;
 	}
-      ofc_handle_unlock (hFile) ;
-      ofc_pipe_unlock() ;
     }
-  return (ret) ;
+
+  if (data != OFC_NULL)
+    {
+      data->free_next = OFC_NULL ;
+      data->pool_class = pool_class ;
+      data->len = len ;
+      data->offset = 0 ;
+      data->next = OFC_NULL ;
+      data->id = 0 ;
+    }
+
+  return (data) ;
 }
 
-static OFC_BOOL OfcFSPipeCloseHandle (OFC_HANDLE hFile)
+/*
+ * Release a message.  The depth is reserved before the push, so
+ * racing releases may leave a list a little short of full but never
+ * over.
+ */
+static OFC_VOID pipe_data_free (OFC_FS_PIPE_FILE *pipe_file,
+				OFC_FS_PIPE_DATA *data)
 {
-  OFC_BOOL ret ;
-  OFC_FS_PIPE_FILE *pipe_file ;
-  OFC_FS_PIPE_HALF *half ;
-  OFC_FS_PIPE_HALF *sibling ;
-  OFC_FS_PIPE_DATA *data ;
+  OFC_FS_PIPE_POOL *pool ;
+  OFC_UINT depth ;
 
-  ret = OFC_FALSE ;
+  pool = &pipe_file->pool ;
 
-  half = ofc_handle_lock (hFile) ;
-  if (half != OFC_NULL)
+  if (data->pool_class == OFC_FS_PIPE_POOL_HEAP)
+    ofc_free (data) ;
+  else
     {
-      ofc_pipe_lock () ;
-
-      for (data = ofc_waitq_dequeue (half->hWaitQ) ;
-	   data != OFC_NULL ;
-	   data = ofc_waitq_dequeue (half->hWaitQ))
+#if defined(__GNUC__)
+      depth = __atomic_fetch_add (&pool->depth[data->pool_class], 1,
+				  __ATOMIC_RELAXED) ;
+      if (depth >= OFC_FS_PIPE_POOL_DEPTH)
 	{
+	  __atomic_fetch_sub (&pool->depth[data->pool_class], 1,
+			      __ATOMIC_RELAXED) ;
 	  ofc_free (data) ;
 	}
-      ofc_waitq_wake(half->hWaitQ);
-      ofc_waitq_destroy(half->hWaitQ);
-      half->hWaitQ = OFC_HANDLE_NULL;
-      half->hPipe = OFC_HANDLE_NULL;
-
-      if (half->sibling != OFC_NULL)
+#else
+      depth = pool->depth[data->pool_class]++ ;
+      if (depth >= OFC_FS_PIPE_POOL_DEPTH)
 	{
-	  sibling = half->sibling ;
-	  sibling->sibling = OFC_NULL ;
-	  ofc_waitq_wake(sibling->hWaitQ);
+	  pool->depth[data->pool_class]-- ;
+	  ofc_free (data) ;
 	}
+#endif
       else
-	{
-	  pipe_file = half->pipe_file ;
-	  if (pipe_file != OFC_NULL)
-	    {
-	      pipe_unlink_internal (pipe_file) ;
-	      ofc_free (pipe_file->name) ;
-	      ofc_free (pipe_file) ;
-	    }
-	}
-      
-      ofc_free (half) ;
-
-      ofc_pipe_unlock () ;
-
-      ofc_handle_destroy (hFile) ;
-      ofc_handle_unlock (hFile) ;
-      
-      ret = OFC_TRUE ;
+	pipe_pool_push (&pool->free[data->pool_class], data, data) ;
     }
-  return (ret) ;
 }
 
-OFC_BOOL OfcFSPipeDeleteFile (OFC_LPCTSTR lpFileName) 
+static OFC_VOID pipe_pool_stats_add (OFC_FS_PIPE_POOL_STATS *total,
+				     OFC_FS_PIPE_POOL_STATS *stats)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  total->hits += pipe_counter_get (&stats->hits) ;
+  total->misses += pipe_counter_get (&stats->misses) ;
+  total->oversize += pipe_counter_get (&stats->oversize) ;
+}
 
-  return (OFC_TRUE) ;
+/*
+ * Add one set of wait statistics into another
+ */
+static OFC_VOID pipe_wait_stats_add (OFC_FS_PIPE_WAIT_STATS *total,
+				     OFC_FS_PIPE_WAIT_STATS *stats)
+{
+  total->waits += pipe_counter_get (&stats->waits) ;
+  total->spins += pipe_counter_get (&stats->spins) ;
+  total->spin_hits += pipe_counter_get (&stats->spin_hits) ;
+  total->parks += pipe_counter_get (&stats->parks) ;
 }
 
-OFC_BOOL OfcFSPipeRemoveDirectory (OFC_LPCTSTR lpPathName) 
+/*
+ * Free the cached messages of a pipe file.  Called with pipes.lock held
+ * so the statistics can be folded into the registry totals.  Nobody
+ * else uses the pool by now.
+ */
+static OFC_VOID pipe_pool_destroy (OFC_FS_PIPE_POOL *pool)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_INT pool_class ;
 
-  return (OFC_TRUE) ;
+  for (pool_class = 0 ; pool_class < OFC_FS_PIPE_POOL_CLASSES ;
+       pool_class++)
+    {
+      for (data = pool->free[pool_class] ;
+	   data != OFC_NULL ;
+	   data = pool->free[pool_class])
+	{
+	  pool->free[pool_class] = data->free_next ;
+	  ofc_free (data) ;
+	}
+      pool->depth[pool_class] = 0 ;
+    }
+
+  pipe_pool_stats_add (&pipes.pool_stats, &pool->stats) ;
 }
 
-OFC_HANDLE OfcFSPipeFindFirstFile (OFC_LPCTSTR lpFileName,
-				     OFC_LPWIN32_FIND_DATAW lpFindFileData,
-				     OFC_BOOL *more) 
+/*
+ * Return the configuration for a pipe name.  Called with pipes.lock held
+ */
+static OFC_FS_PIPE_CONFIG_ENTRY *pipe_config_lookup (OFC_LPCTSTR name)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_FS_PIPE_CONFIG_ENTRY *entry ;
+
+  for (entry = pipes.configs ;
+       entry != OFC_NULL && !pipe_name_equal (entry->name, name) ;
+       entry = entry->next) ;
 
-  return (OFC_HANDLE_NULL) ;
+  return (entry) ;
 }
 
-OFC_BOOL OfcFSPipeFindNextFile (OFC_HANDLE hFindFile,
-				  OFC_LPWIN32_FIND_DATAW lpFindFileData,
-				  OFC_BOOL *more) 
+static OFC_DWORD pipe_ring_put (OFC_FS_PIPE_RING *ring,
+				const OFC_CHAR *buffer, OFC_DWORD len)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_DWORD tail ;
+  OFC_DWORD n ;
+  OFC_DWORD ret ;
 
-  return (OFC_FALSE) ;
+  ret = OFC_MIN (len, ring->size - ring->count) ;
+  len = ret ;
+  while (len > 0)
+    {
+      tail = (ring->head + ring->count) % ring->size ;
+      n = OFC_MIN (len, ring->size - tail) ;
+      ofc_memcpy (ring->buffer + tail, buffer, n) ;
+      ring->count += n ;
+      buffer += n ;
+      len -= n ;
+    }
+  return (ret) ;
 }
 
-OFC_BOOL OfcFSPipeFindClose (OFC_HANDLE hFindFile) 
+static OFC_DWORD pipe_ring_peek (const OFC_FS_PIPE_RING *ring,
+				 OFC_CHAR *buffer, OFC_DWORD len)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_DWORD head ;
+  OFC_DWORD n ;
+  OFC_DWORD ret ;
 
-  return (OFC_FALSE) ;
+  head = ring->head ;
+  ret = OFC_MIN (len, ring->count) ;
+  len = ret ;
+  while (len > 0)
+    {
+      n = OFC_MIN (len, ring->size - head) ;
+      ofc_memcpy (buffer, ring->buffer + head, n) ;
+      head = (head + n) % ring->size ;
+      buffer += n ;
+      len -= n ;
+    }
+  return (ret) ;
 }
 
-OFC_BOOL OfcFSPipeFlushFileBuffers (OFC_HANDLE hFile) 
+static OFC_DWORD pipe_ring_get (OFC_FS_PIPE_RING *ring,
+				OFC_CHAR *buffer, OFC_DWORD len)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_DWORD ret ;
 
-  return (OFC_TRUE) ;
+  ret = pipe_ring_peek (ring, buffer, len) ;
+  if (ret > 0)
+    {
+      ring->head = (ring->head + ret) % ring->size ;
+      ring->count -= ret ;
+    }
+  return (ret) ;
 }
 
-OFC_BOOL OfcFSPipeGetFileAttributesEx (OFC_LPCTSTR lpFileName,
-					 OFC_GET_FILEEX_INFO_LEVELS 
-					 fInfoLevelId,
-					 OFC_LPVOID lpFileInformation) 
+/*
+ * Release the timer and wait set of a timed wait
+ */
+static OFC_VOID pipe_timed_destroy (OFC_FS_PIPE_TIMED *timed)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  if (timed->hWaitSet != OFC_HANDLE_NULL)
+    ofc_waitset_destroy (timed->hWaitSet) ;
+  if (timed->hTimer != OFC_HANDLE_NULL)
+    ofc_timer_destroy (timed->hTimer) ;
+  timed->hWaitSet = OFC_HANDLE_NULL ;
+  timed->hTimer = OFC_HANDLE_NULL ;
+}
 
-  return (OFC_FALSE) ;
+/*
+ * Create the timer and wait set of timed on first use, for waits on
+ * hEvent.  OFC_FALSE if either can't be made.
+ */
+static OFC_BOOL pipe_timed_create (OFC_FS_PIPE_TIMED *timed,
+				   OFC_HANDLE hEvent)
+{
+  if (timed->hWaitSet == OFC_HANDLE_NULL)
+    {
+      timed->hWaitSet = ofc_waitset_create () ;
+      timed->hTimer = ofc_timer_create ("PipeTimeout") ;
+      if (timed->hWaitSet == OFC_HANDLE_NULL ||
+	  timed->hTimer == OFC_HANDLE_NULL)
+	pipe_timed_destroy (timed) ;
+      else
+	{
+	  ofc_waitset_add (timed->hWaitSet, hEvent, hEvent) ;
+	  ofc_waitset_add (timed->hWaitSet, timed->hTimer, timed->hTimer) ;
+	}
+    }
+  return (timed->hWaitSet != OFC_HANDLE_NULL) ;
 }
 
-OFC_BOOL OfcFSPipeGetFileInformationByHandleEx 
-(OFC_HANDLE hFile,
- OFC_FILE_INFO_BY_HANDLE_CLASS FileInformationClass,
- OFC_LPVOID lpFileInformation,
- OFC_DWORD dwBufferSize) 
+/*
+ * Allocate one half of a pipe.  ring_size is the capacity of the data
+ * this half will read, 0 for unbounded.
+ */
+static OFC_FS_PIPE_HALF *pipe_half_create (OFC_FS_PIPE_FILE *pipe_file,
+					   OFC_DWORD ring_size,
+					   OFC_FS_PIPE_DIRECTION_STATS *stats)
 {
-  OFC_BOOL ret ;
   OFC_FS_PIPE_HALF *half ;
 
-  ret = OFC_FALSE ;
-
-  half = ofc_handle_lock (hFile) ;
+  half = ofc_malloc (sizeof (OFC_FS_PIPE_HALF)) ;
   if (half != OFC_NULL)
     {
-      switch (FileInformationClass)
+      half->ring.buffer = OFC_NULL ;
+      half->ring.size = ring_size ;
+      half->ring.head = 0 ;
+      half->ring.count = 0 ;
+      if (ring_size > 0)
 	{
-	case OfcFileStandardInfo:
-	  {
-	    OFC_FILE_STANDARD_INFO *info ;
+	  half->ring.buffer = ofc_malloc (ring_size) ;
+	  if (half->ring.buffer == OFC_NULL)
+	    {
+	      ofc_free (half) ;
+	      half = OFC_NULL ;
+	    }
+	}
+    }
 
-	    info = lpFileInformation ;
-#if defined(OFC_64BIT_INTEGER)
-	    info->AllocationSize = 0 ;
-	    info->EndOfFile = 0 ;
-#else
-	    info->AllocationSize.low = 0 ;
-	    info->AllocationSize.high = 0 ;
-	    info->EndOfFile.low = 0 ;
-	    info->EndOfFile.high = 0 ;
+  if (half != OFC_NULL)
+    {
+      half->hWaitQ = ofc_waitq_create() ;
+      half->hSpaceQ = ofc_waitq_create() ;
+      half->pipe_file = pipe_file ;
+      half->sibling = OFC_NULL ;
+      half->nowait = pipe_file->config.nowait ;
+      half->timeout = pipe_file->config.timeout ;
+      if (half->timeout == 0)
+	half->timeout = OFC_INFINITE ;
+      ofc_memset (&half->data_timed, 0, sizeof (OFC_FS_PIPE_TIMED)) ;
+      ofc_memset (&half->space_timed, 0, sizeof (OFC_FS_PIPE_TIMED)) ;
+      half->read_mode = pipe_file->config.read_mode ;
+      half->stats = stats ;
+      half->parked = OFC_NULL ;
+      half->first = OFC_NULL ;
+      half->last = OFC_NULL ;
+      half->waiters = 0 ;
+      half->wakes = 0 ;
+      half->spin = pipe_file->config.spin_count ;
+      half->queued = 0 ;
+      half->messages = 0 ;
+      half->reads.first = OFC_NULL ;
+      half->reads.last = OFC_NULL ;
+      half->writes.first = OFC_NULL ;
+      half->writes.last = OFC_NULL ;
+      half->connects.first = OFC_NULL ;
+      half->connects.last = OFC_NULL ;
+      half->calls.first = OFC_NULL ;
+      half->calls.last = OFC_NULL ;
+      half->acquired = OFC_NULL ;
+      half->borrowed = OFC_NULL ;
+      half->watches = OFC_NULL ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+      half->shm = OFC_NULL ;
 #endif
-	    info->NumberOfLinks = 0 ;
-	    info->DeletePending = OFC_FALSE ;
-	    info->Directory = OFC_FALSE ;
-	    ret = OFC_TRUE ;
-	  }
-	  break ;
-	case OfcFileBasicInfo:
-	  {
-	    OFC_FILE_BASIC_INFO *info ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+      half->bridge = OFC_NULL ;
+#endif
+      half->connected = OFC_FALSE ;
+      half->hPipe = ofc_handle_create (OFC_HANDLE_PIPE, half) ;
+    }
 
-	    info = lpFileInformation ;
-#if defined(OFC_64BIT_INTEGER)
-	    info->CreationTime = 0 ;
-	    info->LastAccessTime = 0 ;
-	    info->LastWriteTime = 0 ;
-	    info->ChangeTime = 0 ;
-#else
-	    info->CreationTime.low = 0 ;
-	    info->CreationTime.high = 0 ;
-	    info->LastAccessTime.low = 0 ;
-	    info->LastAccessTime.high = 0 ;
-	    info->LastWriteTime.low = 0 ;
-	    info->LastWriteTime.high = 0 ;
-	    info->ChangeTime.low = 0 ;
-	    info->ChangeTime.high = 0 ;
+  return (half) ;
+}
+
+/*
+ * Queue a wait set member to be looked at.  Returns OFC_TRUE if it
+ * was not queued already.  Called with the set lock held.
+ */
+static OFC_BOOL pipe_watch_queue (OFC_FS_PIPE_WATCH *watch)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  waitset = watch->waitset ;
+  if (!watch->queued && !watch->removed)
+    {
+      watch->queued = OFC_TRUE ;
+      watch->ready_next = OFC_NULL ;
+      if (waitset->ready_last == OFC_NULL)
+	waitset->ready_first = watch ;
+      else
+	waitset->ready_last->ready_next = watch ;
+      waitset->ready_last = watch ;
+      ret = OFC_TRUE ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Something changed on a half.  Its watchers are queued for their
+ * sets to look at, and a set is only signalled when one was not
+ * queued already.  Called with the pipe lock held.
+ */
+static OFC_VOID pipe_wake_watchers (OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_WATCH *watch ;
+  OFC_BOOL signal ;
+
+  for (watch = half->watches ; watch != OFC_NULL ; watch = watch->half_next)
+    {
+      ofc_lock (watch->waitset->lock) ;
+      signal = pipe_watch_queue (watch) ;
+      ofc_unlock (watch->waitset->lock) ;
+      if (signal)
+	ofc_event_set (watch->waitset->hEvent) ;
+    }
+}
+
+/*
+ * Unlink the message at the head of a half's queue.  The caller
+ * accounts for the bytes.  Called with the pipe lock held.
+ */
+static OFC_FS_PIPE_DATA *pipe_dequeue_data (OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_DATA *data ;
+
+  data = half->first ;
+  if (data != OFC_NULL)
+    {
+      half->first = data->next ;
+      if (half->first == OFC_NULL)
+	half->last = OFC_NULL ;
+      data->next = OFC_NULL ;
+      half->messages-- ;
+    }
+  return (data) ;
+}
+
+/*
+ * Release the resources of a half.  The caller disposes of the handle
+ */
+static OFC_VOID pipe_half_destroy (OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_DATA *data ;
+  OFC_FS_PIPE_WATCH *watch ;
+
+  for (data = pipe_dequeue_data (half) ;
+       data != OFC_NULL ;
+       data = pipe_dequeue_data (half))
+    {
+      pipe_data_free (half->pipe_file, data) ;
+    }
+  /*
+   * Loans still outstanding when the handle is closed are reclaimed
+   */
+  for (data = half->acquired ; data != OFC_NULL ; data = half->acquired)
+    {
+      half->acquired = data->free_next ;
+      pipe_data_free (half->pipe_file, data) ;
+    }
+  for (data = half->borrowed ; data != OFC_NULL ; data = half->borrowed)
+    {
+      half->borrowed = data->free_next ;
+      pipe_data_free (half->pipe_file, data) ;
+    }
+  /*
+   * Wait sets drop the handle the next time they look
+   */
+  for (watch = half->watches ; watch != OFC_NULL ; watch = watch->half_next)
+    {
+      ofc_lock (watch->waitset->lock) ;
+      watch->hPipe = OFC_HANDLE_NULL ;
+      ofc_unlock (watch->waitset->lock) ;
+    }
+  pipe_wake_watchers (half) ;
+  half->watches = OFC_NULL ;
+  ofc_waitq_wake(half->hWaitQ);
+  ofc_waitq_destroy(half->hWaitQ);
+  half->hWaitQ = OFC_HANDLE_NULL;
+  ofc_waitq_wake(half->hSpaceQ);
+  ofc_waitq_destroy(half->hSpaceQ);
+  half->hSpaceQ = OFC_HANDLE_NULL;
+  pipe_timed_destroy (&half->data_timed) ;
+  pipe_timed_destroy (&half->space_timed) ;
+  half->hPipe = OFC_HANDLE_NULL;
+  if (half->ring.buffer != OFC_NULL)
+    ofc_free (half->ring.buffer) ;
+  ofc_free (half) ;
+}
+
+static OFC_VOID pipe_ovq_enqueue (OFC_FS_PIPE_OVQ *q,
+				  OFC_FS_PIPE_OVERLAPPED *ov)
+{
+  ov->next = OFC_NULL ;
+  if (q->last == OFC_NULL)
+    q->first = ov ;
+  else
+    q->last->next = ov ;
+  q->last = ov ;
+}
+
+static OFC_VOID pipe_ovq_unlink (OFC_FS_PIPE_OVQ *q,
+				 OFC_FS_PIPE_OVERLAPPED *ov)
+{
+  OFC_FS_PIPE_OVERLAPPED **prev ;
+  OFC_FS_PIPE_OVERLAPPED *last ;
+
+  last = OFC_NULL ;
+  for (prev = &q->first ; *prev != OFC_NULL && *prev != ov ;
+       prev = &(*prev)->next)
+    last = *prev ;
+
+  if (*prev == ov)
+    {
+      *prev = ov->next ;
+      if (q->last == ov)
+	q->last = last ;
+      ov->next = OFC_NULL ;
+    }
+}
+
+/*
+ * Finish an overlapped operation and signal its event.  Called with
+ * the pipe lock held.
+ */
+static OFC_VOID pipe_ov_complete (OFC_FS_PIPE_OVERLAPPED *ov,
+				  OFC_DWORD error)
+{
+  ov->half = OFC_NULL ;
+  ov->error = error ;
+  ofc_event_set (ov->hEvent) ;
+}
+
+static OFC_VOID pipe_spin_pause (OFC_VOID)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  __asm__ __volatile__ ("pause") ;
+#elif defined(__GNUC__) && defined(__aarch64__)
+  __asm__ __volatile__ ("yield") ;
 #endif
-	    info->FileAttributes = OFC_FILE_ATTRIBUTE_NORMAL ;
-	    ret = OFC_TRUE ;
-	  }
-	  break ;
+}
 
-        case OfcFileEaInfo:
-          if (dwBufferSize >= sizeof(OFC_FILE_EA_INFO))
-            {
-              OFC_FILE_EA_INFO *lpFileEaInfo =
-                (OFC_FILE_EA_INFO *) lpFileInformation;
-              lpFileEaInfo->EaSize = 0;
-              ret = OFC_TRUE;
-            }
-          break;
+/*
+ * When a call on a half allowed to wait dwMilliseconds gives up.  0 if
+ * it never does.
+ */
+static OFC_MSTIME pipe_deadline (OFC_FS_PIPE_HALF *half,
+				 OFC_DWORD dwMilliseconds)
+{
+  OFC_MSTIME ret ;
 
-	default:
-	  ofc_thread_set_variable (OfcLastError, 
-				 (OFC_DWORD_PTR) 
-				 OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
-	  break ;
+  ret = 0 ;
+  if (dwMilliseconds == OFC_FS_PIPE_WAIT_DEFAULT)
+    dwMilliseconds = half->timeout ;
+  if (dwMilliseconds != OFC_INFINITE)
+    ret = ofc_time_get_now () + dwMilliseconds ;
+  return (ret) ;
+}
+
+/*
+ * Wait for an event until a deadline.  timed is the owner's timer for
+ * the event, claimed by the caller, or OFC_NULL if another thread is
+ * using it, in which case one is made for this wait alone.  Returns
+ * OFC_ERROR_SUCCESS once the event is set, OFC_ERROR_SEM_TIMEOUT if
+ * the deadline passed first, or OFC_ERROR_NOT_ENOUGH_MEMORY if no
+ * timer could be made to bound the wait.
+ */
+static OFC_DWORD pipe_event_wait (OFC_HANDLE hEvent, OFC_FS_PIPE_TIMED *timed,
+				  OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_TIMED once ;
+  OFC_MSTIME remaining ;
+  OFC_DWORD ret ;
+
+  ret = OFC_ERROR_SUCCESS ;
+  if (deadline == 0)
+    ofc_event_wait (hEvent) ;
+  else
+    {
+      remaining = deadline - ofc_time_get_now () ;
+      ret = OFC_ERROR_SEM_TIMEOUT ;
+      once.hWaitSet = OFC_HANDLE_NULL ;
+      once.hTimer = OFC_HANDLE_NULL ;
+      if (timed == OFC_NULL)
+	timed = &once ;
+      if (remaining <= 0)
+	;
+      else if (!pipe_timed_create (timed, hEvent))
+	ret = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      else
+	{
+	  ofc_timer_set (timed->hTimer, remaining) ;
+	  if (ofc_waitset_wait (timed->hWaitSet) != timed->hTimer)
+	    ret = OFC_ERROR_SUCCESS ;
 	}
-      ofc_handle_unlock (hFile) ;
+      if (timed == &once)
+	pipe_timed_destroy (&once) ;
     }
   return (ret) ;
 }
 
-OFC_BOOL OfcFSPipeMoveFile (OFC_LPCTSTR lpExistingFileName,
-			      OFC_LPCTSTR lpNewFileName) 
+/*
+ * Drop the pipe lock and block on a wait queue of a half until it is
+ * woken or the deadline passes.  Returns as pipe_event_wait.  Called
+ * with the pipe lock held.
+ */
+static OFC_DWORD pipe_block (OFC_FS_PIPE_HALF *half, OFC_HANDLE hWaitQ,
+			     OFC_FS_PIPE_TIMED *timed, OFC_MSTIME deadline)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_DWORD ret ;
 
-  return (OFC_FALSE) ;
+  pipe_file = half->pipe_file ;
+  ret = OFC_ERROR_SUCCESS ;
+  if (deadline == 0)
+    {
+      ofc_unlock (pipe_file->lock) ;
+      ofc_waitq_block (hWaitQ) ;
+      ofc_lock (pipe_file->lock) ;
+    }
+  else
+    {
+      if (timed->busy)
+	timed = OFC_NULL ;
+      else
+	timed->busy = OFC_TRUE ;
+      ofc_unlock (pipe_file->lock) ;
+      ret = pipe_event_wait (ofc_waitq_get_event_handle (hWaitQ), timed,
+			     deadline) ;
+      ofc_lock (pipe_file->lock) ;
+      if (timed != OFC_NULL)
+	timed->busy = OFC_FALSE ;
+    }
+  return (ret) ;
 }
 
-static OFC_HANDLE OfcFSPipeCreateOverlapped (OFC_VOID)
+/*
+ * Drop the pipe lock and wait until the sibling writes, connects or
+ * closes, spinning briefly before blocking if the pipe is configured
+ * to.  Returns as pipe_event_wait, and the caller gives up with any
+ * error returned.  Called with the pipe lock held.
+ */
+static OFC_DWORD pipe_wait_data (OFC_FS_PIPE_HALF *half, OFC_MSTIME deadline)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_UINT64 start ;
+  OFC_UINT spin_count ;
+  OFC_UINT wakes ;
+  OFC_UINT i ;
+  OFC_DWORD ret ;
+
+  pipe_file = half->pipe_file ;
+  pipe_counter_add (&pipe_file->wait_stats.waits, 1) ;
+  start = pipe_now () ;
 
-  return (OFC_HANDLE_NULL) ;
+  spin_count = pipe_file->config.spin_count ;
+  if (spin_count == 0)
+    spin_count = pipes.spin_count ;
+
+  if (spin_count > 0)
+    {
+      /*
+       * A reply often arrives within microseconds, well before a sleep
+       * and wake would complete, so poll for a while first.  The budget
+       * grows while spinning pays off and shrinks while it does not.
+       */
+      if (half->spin == 0 || half->spin > spin_count)
+	half->spin = spin_count ;
+      wakes = half->wakes ;
+      pipe_counter_add (&pipe_file->wait_stats.spins, 1) ;
+      ofc_unlock (pipe_file->lock) ;
+      for (i = 0 ; i < half->spin && half->wakes == wakes ; i++)
+	pipe_spin_pause () ;
+      ofc_lock (pipe_file->lock) ;
+
+      if (half->wakes != wakes)
+	{
+	  pipe_counter_add (&pipe_file->wait_stats.spin_hits, 1) ;
+	  half->spin = OFC_MIN (half->spin * 2, spin_count) ;
+	  pipe_counter_add (&half->stats->wait_usecs, pipe_now () - start) ;
+	  return (OFC_ERROR_SUCCESS) ;
+	}
+      half->spin = OFC_MAX (half->spin / 2, 1) ;
+    }
+
+  pipe_counter_add (&pipe_file->wait_stats.parks, 1) ;
+  half->waiters++ ;
+  ret = pipe_block (half, half->hWaitQ, &half->data_timed, deadline) ;
+  half->waiters-- ;
+  pipe_counter_add (&half->stats->wait_usecs, pipe_now () - start) ;
+  return (ret) ;
 }
 
-static OFC_VOID OfcFSPipeDestroyOverlapped (OFC_HANDLE hOverlapped)
+/*
+ * Tell readers of a half that data has arrived.  A reader busy with
+ * earlier data will see it without being signalled, so the wake is
+ * only paid for when someone is actually blocked.  The reader of a
+ * bridged half is the forwarder, which never blocks here.
+ */
+static OFC_VOID pipe_wake_data (OFC_FS_PIPE_HALF *half)
 {
+  half->wakes++ ;
+  if (half->waiters > 0)
+    ofc_waitq_wake (half->hWaitQ) ;
+  if (half->watches != OFC_NULL)
+    pipe_wake_watchers (half) ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+  if (half->bridge != OFC_NULL)
+    pipe_bridge_notify (half->bridge) ;
+#endif
 }
 
-static OFC_VOID OfcFSPipeSetOverlappedOffset (OFC_HANDLE hOverlapped,
-						OFC_OFFT offset)
+/*
+ * Tell writers of a half that room has been made, or that the reader
+ * has gone.  Called with the pipe lock held.
+ */
+static OFC_VOID pipe_wake_space (OFC_FS_PIPE_HALF *half)
 {
+  ofc_waitq_wake (half->hSpaceQ) ;
+  if (half->watches != OFC_NULL)
+    pipe_wake_watchers (half) ;
 }
 
-OFC_BOOL OfcFSPipeGetOverlappedResult (OFC_HANDLE hFile,
-					 OFC_HANDLE hOverlapped,
-					 OFC_LPDWORD 
-					 lpNumberOfBytesTransferred,
-					 OFC_BOOL bWait) 
+/*
+ * Queue a message to be read by a half.  The totals let the depth of
+ * the queue be reported without walking it.  Called with the pipe lock
+ * held.
+ */
+static OFC_VOID pipe_queue_data (OFC_FS_PIPE_HALF *half,
+				 OFC_FS_PIPE_DATA *data)
+{
+  data->next = OFC_NULL ;
+  if (half->last == OFC_NULL)
+    half->first = data ;
+  else
+    half->last->next = data ;
+  half->last = data ;
+  half->queued += data->len ;
+  half->messages++ ;
+  pipe_stats_written (half->stats, data->len, 1, half->queued,
+		      half->messages) ;
+  pipe_wake_data (half) ;
+}
+
+/*
+ * Copy data straight into the buffer of a synchronous reader of the
+ * sibling blocked waiting for it.  Only done when nothing is queued
+ * ahead so ordering is kept.  Unless the pipe is bounded, and so a
+ * byte stream, the whole write must fit.  Returns OFC_TRUE with the
+ * bytes handed over if it was taken.  Called with the pipe lock held.
+ */
+static OFC_BOOL pipe_handoff (OFC_FS_PIPE_HALF *sibling,
+			      const OFC_CHAR *buffer,
+			      OFC_DWORD len,
+			      OFC_DWORD *handed)
+{
+  OFC_FS_PIPE_PARKED *parked ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  parked = sibling->parked ;
+  if (parked != OFC_NULL && !parked->done &&
+      sibling->reads.first == OFC_NULL && sibling->messages == 0 &&
+      sibling->ring.count == 0 &&
+      (len <= parked->len || sibling->ring.buffer != OFC_NULL))
+    {
+      *handed = OFC_MIN (len, parked->len) ;
+      ofc_memcpy (parked->buffer, buffer, *handed) ;
+      parked->read = *handed ;
+      parked->done = OFC_TRUE ;
+      /* Bounded pipes are byte streams and count no messages */
+      pipe_stats_written (sibling->stats, *handed,
+			  sibling->ring.buffer != OFC_NULL ? 0 : 1, 0, 0) ;
+      pipe_counter_add (&sibling->stats->bytes_read, *handed) ;
+      pipe_counter_add (&sibling->stats->handoffs, 1) ;
+      pipe_wake_data (sibling) ;
+      ret = OFC_TRUE ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Take whatever data is available to a half without blocking.  In
+ * message mode at most one message is returned and if it does not fit
+ * *error is set to OFC_ERROR_MORE_DATA with the rest left queued for the
+ * next read.  In byte mode as many queued messages as fit are coalesced
+ * into the caller's buffer.  Pipelined requests are never coalesced
+ * and always report OFC_ERROR_MORE_DATA if they do not fit.  Returns
+ * OFC_FALSE if there is nothing queued.  Called with the pipe lock
+ * held.
+ */
+static OFC_BOOL pipe_read_available (OFC_FS_PIPE_HALF *half,
+				     OFC_CHAR *buffer,
+				     OFC_DWORD len,
+				     OFC_DWORD *read,
+				     OFC_DWORD *error)
+{
+  OFC_FS_PIPE_DATA *data ;
+  OFC_BOOL ret ;
+  OFC_DWORD nBytes ;
+  OFC_UINT32 id ;
+
+  ret = OFC_FALSE ;
+  *error = OFC_ERROR_SUCCESS ;
+  data = half->first ;
+  if (half->ring.count > 0)
+    {
+      *read = pipe_ring_get (&half->ring, buffer, len) ;
+      if (half->sibling != OFC_NULL)
+	pipe_wake_space (half->sibling) ;
+      ret = OFC_TRUE ;
+    }
+  else if (data != OFC_NULL)
+    {
+      *read = 0 ;
+      do
+	{
+	  id = data->id ;
+	  nBytes = OFC_MIN(len - *read, data->len) ;
+	  ofc_memcpy (buffer + *read, data->buffer + data->offset, nBytes) ;
+	  *read += nBytes ;
+	  data->len -= nBytes ;
+	  data->offset += nBytes ;
+	  half->queued -= nBytes ;
+	  if (data->len == 0)
+	    {
+	      pipe_dequeue_data (half) ;
+	      pipe_data_free (half->pipe_file, data) ;
+	      data = half->first ;
+	    }
+	  else if (half->read_mode == OFC_FS_PIPE_READMODE_MESSAGE || id != 0)
+	    *error = OFC_ERROR_MORE_DATA ;
+	}
+      while (half->read_mode == OFC_FS_PIPE_READMODE_BYTE && id == 0 &&
+	     data != OFC_NULL && data->id == 0 && *read < len) ;
+      ret = OFC_TRUE ;
+    }
+  if (ret)
+    pipe_counter_add (&half->stats->bytes_read, *read) ;
+  return (ret) ;
+}
+
+/*
+ * Put as much data as fits into the sibling's ring.  Called with the
+ * pipe lock held on a bounded pipe.
+ */
+static OFC_DWORD pipe_write_available (OFC_FS_PIPE_HALF *half,
+				       const OFC_CHAR *buffer,
+				       OFC_DWORD len)
+{
+  OFC_DWORD n ;
+
+  n = pipe_ring_put (&half->sibling->ring, buffer, len) ;
+  if (n > 0)
+    {
+      pipe_stats_written (half->sibling->stats, n, 0,
+			  half->sibling->ring.count, 0) ;
+      pipe_wake_data (half->sibling) ;
+    }
+  return (n) ;
+}
+
+/*
+ * Advance the pending overlapped operations of one half.  Returns
+ * OFC_TRUE if any of them made progress.
+ */
+static OFC_BOOL pipe_service_half (OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_BOOL progress ;
+  OFC_DWORD n ;
+  OFC_DWORD error ;
+
+  progress = OFC_FALSE ;
+
+  for (ov = half->reads.first ;
+       ov != OFC_NULL &&
+	 pipe_read_available (half, ov->buffer, ov->len, &ov->transferred,
+			      &error) ;
+       ov = half->reads.first)
+    {
+      pipe_ovq_unlink (&half->reads, ov) ;
+      pipe_ov_complete (ov, error) ;
+      progress = OFC_TRUE ;
+    }
+
+  for (ov = half->writes.first ;
+       ov != OFC_NULL && half->sibling != OFC_NULL ;
+       ov = half->writes.first)
+    {
+      n = pipe_write_available (half, ov->buffer + ov->transferred,
+				ov->len - ov->transferred) ;
+      if (n == 0)
+	break ;
+
+      ov->transferred += n ;
+      progress = OFC_TRUE ;
+      if (ov->transferred == ov->len)
+	{
+	  pipe_ovq_unlink (&half->writes, ov) ;
+	  pipe_ov_complete (ov, OFC_ERROR_SUCCESS) ;
+	}
+    }
+
+  return (progress) ;
+}
+
+/*
+ * Complete whatever pending overlapped operations can now make
+ * progress.  Called with the pipe lock held whenever data has been
+ * queued or consumed.
+ */
+static OFC_VOID pipe_service_overlapped (OFC_FS_PIPE_FILE *pipe_file)
+{
+  OFC_BOOL progress ;
+
+  for (progress = OFC_TRUE ; progress ; )
+    {
+      progress = OFC_FALSE ;
+      if (pipe_file->server != OFC_NULL &&
+	  pipe_service_half (pipe_file->server))
+	progress = OFC_TRUE ;
+      if (pipe_file->client != OFC_NULL &&
+	  pipe_service_half (pipe_file->client))
+	progress = OFC_TRUE ;
+    }
+}
+
+/*
+ * Complete the pending overlapped connects of a server half
+ */
+static OFC_VOID pipe_complete_connects (OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+
+  for (ov = half->connects.first ; ov != OFC_NULL ;
+       ov = half->connects.first)
+    {
+      pipe_ovq_unlink (&half->connects, ov) ;
+      pipe_ov_complete (ov, OFC_ERROR_SUCCESS) ;
+    }
+}
+
+/*
+ * Fail every pending overlapped operation of a half
+ */
+static OFC_VOID pipe_abort_overlapped (OFC_FS_PIPE_HALF *half,
+				       OFC_DWORD error)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+
+  for (ov = half->reads.first ; ov != OFC_NULL ; ov = half->reads.first)
+    {
+      pipe_ovq_unlink (&half->reads, ov) ;
+      pipe_ov_complete (ov, error) ;
+    }
+  for (ov = half->writes.first ; ov != OFC_NULL ; ov = half->writes.first)
+    {
+      pipe_ovq_unlink (&half->writes, ov) ;
+      pipe_ov_complete (ov, error) ;
+    }
+  for (ov = half->connects.first ; ov != OFC_NULL ;
+       ov = half->connects.first)
+    {
+      pipe_ovq_unlink (&half->connects, ov) ;
+      pipe_ov_complete (ov, error) ;
+    }
+  for (ov = half->calls.first ; ov != OFC_NULL ; ov = half->calls.first)
+    {
+      pipe_ovq_unlink (&half->calls, ov) ;
+      pipe_ov_complete (ov, error) ;
+    }
+}
+
+/*
+ * Lock an overlapped handle and reset it for a new operation on a pipe
+ * file.  *ov is OFC_NULL if there is none.  An overlapped structure
+ * still pending on a half can't be reused until it completes, and the
+ * call fails with OFC_ERROR_INVALID_PARAMETER.  Called with the pipe
+ * lock held.
+ */
+static OFC_BOOL pipe_ov_begin (OFC_FS_PIPE_FILE *pipe_file,
+			       OFC_HANDLE hOverlapped,
+			       OFC_FS_PIPE_OVERLAPPED **ov)
+{
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  *ov = OFC_NULL ;
+  if (hOverlapped != OFC_HANDLE_NULL)
+    {
+      *ov = ofc_handle_lock (hOverlapped) ;
+      if (*ov != OFC_NULL && (*ov)->half != OFC_NULL)
+	{
+	  ofc_handle_unlock (hOverlapped) ;
+	  *ov = OFC_NULL ;
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR)
+				   OFC_ERROR_INVALID_PARAMETER) ;
+	  ret = OFC_FALSE ;
+	}
+      else if (*ov != OFC_NULL)
+	{
+	  (*ov)->pipe_file = pipe_file ;
+	  (*ov)->transferred = 0 ;
+	  (*ov)->error = OFC_ERROR_SUCCESS ;
+	  ofc_event_reset ((*ov)->hEvent) ;
+	}
+    }
+  return (ret) ;
+}
+
+/*
+ * Release an overlapped handle after an operation was posted.  An
+ * operation that failed outright is completed with its error so a
+ * waiter on the event does not hang.  Called with the pipe lock held.
+ */
+static OFC_VOID pipe_ov_end (OFC_HANDLE hOverlapped,
+			     OFC_FS_PIPE_OVERLAPPED *ov, OFC_BOOL ret)
+{
+  OFC_DWORD error ;
+
+  if (ov != OFC_NULL)
+    {
+      if (!ret)
+	{
+	  error = (OFC_DWORD) ofc_thread_get_variable (OfcLastError) ;
+	  if (error != OFC_ERROR_IO_PENDING)
+	    pipe_ov_complete (ov, error) ;
+	}
+      ofc_handle_unlock (hOverlapped) ;
+    }
+}
+
+/*
+ * Wait for a client to connect to a server half.  Called with the pipe
+ * lock held.  The lock is dropped while blocked, or if an overlapped
+ * structure is supplied the connect is left pending until a client
+ * opens the pipe.
+ */
+static OFC_BOOL pipe_connect_internal (OFC_FS_PIPE_HALF *half,
+				       OFC_FS_PIPE_OVERLAPPED *ov,
+				       OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_BOOL ret ;
+  OFC_BOOL done ;
+  OFC_DWORD wait_error ;
+  OFC_UINT64 start ;
+
+  pipe_file = half->pipe_file ;
+  ret = OFC_FALSE ;
+  wait_error = OFC_ERROR_SUCCESS ;
+  start = 0 ;
+
+  for (done = OFC_FALSE ; !done ; )
+    {
+      if (half->sibling != OFC_NULL)
+	{
+	  if (ov != OFC_NULL)
+	    pipe_ov_complete (ov, OFC_ERROR_SUCCESS) ;
+	  pipe_latency_record (pipe_file, OFC_FS_PIPE_LATENCY_CONNECT, start) ;
+	  ret = OFC_TRUE ;
+	  done = OFC_TRUE ;
+	}
+      else if (half->connected || pipe_file->server != half)
+	{
+	  /*
+	   * A client handle, or a server whose client has gone away
+	   */
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_NO_DATA) ;
+	  done = OFC_TRUE ;
+	}
+      else if (ov != OFC_NULL)
+	{
+	  ov->half = half ;
+	  pipe_ovq_enqueue (&half->connects, ov) ;
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_IO_PENDING) ;
+	  done = OFC_TRUE ;
+	}
+      else if (wait_error != OFC_ERROR_SUCCESS)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) wait_error) ;
+	  done = OFC_TRUE ;
+	}
+      else
+	{
+	  if (start == 0)
+	    start = pipe_latency_start () ;
+	  wait_error = pipe_wait_data (half, deadline) ;
+	}
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Queue data for the sibling of a half.  Called with the pipe lock
+ * held.  While the sibling's ring is full the lock is dropped and the
+ * writer blocks, unless the half is in no wait mode in which case
+ * the write returns short, or an overlapped structure is supplied in
+ * which case the remainder of the write is left pending.  A blocked
+ * write that reaches its deadline fails with what was written so far.
+ */
+static OFC_BOOL pipe_write_internal (OFC_FS_PIPE_HALF *half,
+				     const OFC_CHAR *buffer,
+				     OFC_DWORD len,
+				     OFC_DWORD *written,
+				     OFC_FS_PIPE_OVERLAPPED *ov,
+				     OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_HALF *sibling ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_BOOL ret ;
+  OFC_BOOL done ;
+  OFC_DWORD wait_error ;
+  OFC_DWORD n ;
+
+  pipe_file = half->pipe_file ;
+  *written = 0 ;
+  ret = OFC_TRUE ;
+  wait_error = OFC_ERROR_SUCCESS ;
+
+  for (done = OFC_FALSE ; !done ; )
+    {
+      sibling = half->sibling ;
+      if (sibling == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  ret = OFC_FALSE ;
+	  done = OFC_TRUE ;
+	}
+      else if (sibling->ring.buffer == OFC_NULL)
+	{
+	  /*
+	   * A reader already waiting takes the data without a message
+	   */
+	  if (!pipe_handoff (sibling, buffer, len, written))
+	    {
+	      data = pipe_data_alloc (pipe_file, len) ;
+	      if (data == OFC_NULL)
+		{
+		  ofc_thread_set_variable (OfcLastError, 
+					   (OFC_DWORD_PTR) 
+					   OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+		  ret = OFC_FALSE ;
+		}
+	      else
+		{
+		  ofc_memcpy (data->buffer, buffer, len) ;
+		  pipe_queue_data (sibling, data) ;
+		  *written = len ;
+		}
+	    }
+	  done = OFC_TRUE ;
+	}
+      else
+	{
+	  n = 0 ;
+	  /*
+	   * Overlapped writes already pending go first
+	   */
+	  if (half->writes.first == OFC_NULL &&
+	      !pipe_handoff (sibling, buffer + *written, len - *written, &n))
+	    n = pipe_write_available (half, buffer + *written,
+				      len - *written) ;
+	  *written += n ;
+
+	  if (*written == len || (n == 0 && half->nowait))
+	    done = OFC_TRUE ;
+	  else if (ov != OFC_NULL)
+	    {
+	      ov->buffer = (OFC_CHAR *) buffer ;
+	      ov->len = len ;
+	      ov->transferred = *written ;
+	      ov->half = half ;
+	      pipe_ovq_enqueue (&half->writes, ov) ;
+	      ofc_thread_set_variable (OfcLastError, 
+				       (OFC_DWORD_PTR) OFC_ERROR_IO_PENDING) ;
+	      ret = OFC_FALSE ;
+	      done = OFC_TRUE ;
+	    }
+	  else if (n == 0 && wait_error != OFC_ERROR_SUCCESS)
+	    {
+	      ofc_thread_set_variable (OfcLastError, 
+				       (OFC_DWORD_PTR) wait_error) ;
+	      ret = OFC_FALSE ;
+	      done = OFC_TRUE ;
+	    }
+	  else if (n == 0)
+	    {
+	      wait_error = pipe_block (half, half->hSpaceQ,
+				       &half->space_timed, deadline) ;
+	    }
+	}
+    }
+
+  if (*written > 0)
+    pipe_service_overlapped (pipe_file) ;
+
+  if (ret && ov != OFC_NULL)
+    {
+      ov->transferred = *written ;
+      pipe_ov_complete (ov, OFC_ERROR_SUCCESS) ;
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Return data written by the sibling.  Called with the pipe lock held.
+ * If nothing is queued the lock is dropped while blocked waiting for
+ * data, or if an overlapped structure is supplied the read is left
+ * pending until the sibling writes.
+ */
+static OFC_BOOL pipe_read_internal (OFC_FS_PIPE_HALF *half,
+				    OFC_CHAR *buffer,
+				    OFC_DWORD len,
+				    OFC_DWORD *read,
+				    OFC_FS_PIPE_OVERLAPPED *ov,
+				    OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_PARKED parked ;
+  OFC_BOOL ret ;
+  OFC_BOOL done ;
+  OFC_DWORD wait_error ;
+  OFC_DWORD error ;
+  OFC_UINT64 start ;
+
+  pipe_file = half->pipe_file ;
+  *read = 0 ;
+  ret = OFC_FALSE ;
+  wait_error = OFC_ERROR_SUCCESS ;
+  start = 0 ;
+
+  for (done = OFC_FALSE ; !done ; )
+    {
+      /*
+       * Overlapped reads already pending are satisfied first
+       */
+      if (half->reads.first == OFC_NULL &&
+	  pipe_read_available (half, buffer, len, read, &error))
+	{
+	  pipe_latency_record (pipe_file, OFC_FS_PIPE_LATENCY_READ, start) ;
+	  pipe_service_overlapped (pipe_file) ;
+	  if (ov != OFC_NULL)
+	    {
+	      ov->transferred = *read ;
+	      pipe_ov_complete (ov, error) ;
+	    }
+	  if (error == OFC_ERROR_SUCCESS)
+	    ret = OFC_TRUE ;
+	  else
+	    ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+	  done = OFC_TRUE ;
+	}
+      else if (half->sibling == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  done = OFC_TRUE ;
+	}
+      else if (ov != OFC_NULL)
+	{
+	  ov->buffer = buffer ;
+	  ov->len = len ;
+	  ov->transferred = 0 ;
+	  ov->half = half ;
+	  pipe_ovq_enqueue (&half->reads, ov) ;
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_IO_PENDING) ;
+	  done = OFC_TRUE ;
+	}
+      else if (wait_error != OFC_ERROR_SUCCESS)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) wait_error) ;
+	  done = OFC_TRUE ;
+	}
+      else if (half->parked == OFC_NULL)
+	{
+	  /*
+	   * Let the writer hand its data straight to us
+	   */
+	  parked.buffer = buffer ;
+	  parked.len = len ;
+	  parked.read = 0 ;
+	  parked.done = OFC_FALSE ;
+	  half->parked = &parked ;
+	  if (start == 0)
+	    start = pipe_latency_start () ;
+	  wait_error = pipe_wait_data (half, deadline) ;
+	  /*
+	   * A writer may have filled it just as the wait gave up
+	   */
+	  half->parked = OFC_NULL ;
+	  if (parked.done)
+	    {
+	      *read = parked.read ;
+	      pipe_latency_record (pipe_file, OFC_FS_PIPE_LATENCY_READ,
+				   start) ;
+	      pipe_service_overlapped (pipe_file) ;
+	      ret = OFC_TRUE ;
+	      done = OFC_TRUE ;
+	    }
+	}
+      else
+	{
+	  if (start == 0)
+	    start = pipe_latency_start () ;
+	  wait_error = pipe_wait_data (half, deadline) ;
+	}
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Write a list of segments as one message.  On a bounded pipe the ring
+ * holds bytes rather than messages so the segments are written in turn.
+ */
+static OFC_BOOL
+pipe_write_gather_internal (OFC_FS_PIPE_HALF *half,
+			    const OFC_FS_PIPE_SEGMENT *segments,
+			    OFC_DWORD count,
+			    OFC_DWORD *written,
+			    OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_BOOL ret ;
+  OFC_DWORD total ;
+  OFC_DWORD n ;
+  OFC_DWORD i ;
+
+  pipe_file = half->pipe_file ;
+  *written = 0 ;
+  ret = OFC_FALSE ;
+
+  /*
+   * The message length must fit a DWORD
+   */
+  for (i = 0, total = 0 ;
+       i < count && segments[i].len <= (OFC_DWORD) ~0 - total ; i++)
+    total += segments[i].len ;
+
+  if (i < count)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+  else if (half->sibling == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+  else if (half->sibling->ring.buffer == OFC_NULL)
+    {
+      data = pipe_data_alloc (pipe_file, total) ;
+      if (data == OFC_NULL)
+	ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      else
+	{
+	  for (i = 0 ; i < count ; i++)
+	    {
+	      ofc_memcpy (data->buffer + *written, segments[i].buffer,
+			  segments[i].len) ;
+	      *written += segments[i].len ;
+	    }
+	  pipe_queue_data (half->sibling, data) ;
+	  pipe_service_overlapped (pipe_file) ;
+	  ret = OFC_TRUE ;
+	}
+    }
+  else
+    {
+      /*
+       * Stop short if the pipe breaks or a nowait pipe fills
+       */
+      for (i = 0, ret = OFC_TRUE ; i < count && ret ; i++)
+	{
+	  ret = pipe_write_internal (half, segments[i].buffer,
+				     segments[i].len, &n, OFC_NULL,
+				     deadline) ;
+	  *written += n ;
+	  if (n < segments[i].len)
+	    break ;
+	}
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Read into a list of segments.  Blocks until data is available.  In
+ * message mode the segments are filled from one message and if it does
+ * not fit the read fails with OFC_ERROR_MORE_DATA.  In byte mode, or on
+ * a bounded pipe, the segments are filled with as much as is queued.
+ */
+static OFC_BOOL
+pipe_read_scatter_internal (OFC_FS_PIPE_HALF *half,
+			    const OFC_FS_PIPE_SEGMENT *segments,
+			    OFC_DWORD count,
+			    OFC_DWORD *read,
+			    OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_BOOL ret ;
+  OFC_BOOL done ;
+  OFC_DWORD wait_error ;
+  OFC_BOOL stream ;
+  OFC_DWORD error ;
+  OFC_DWORD n ;
+  OFC_DWORD i ;
+
+  pipe_file = half->pipe_file ;
+  *read = 0 ;
+  ret = OFC_FALSE ;
+  wait_error = OFC_ERROR_SUCCESS ;
+  n = 0 ;
+  error = OFC_ERROR_SUCCESS ;
+
+  for (done = OFC_FALSE ; !done ; )
+    {
+      if (half->reads.first == OFC_NULL &&
+	  pipe_read_available (half, segments[0].buffer, segments[0].len,
+			       &n, &error))
+	{
+	  ret = OFC_TRUE ;
+	  done = OFC_TRUE ;
+	}
+      else if (half->sibling == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  done = OFC_TRUE ;
+	}
+      else if (wait_error != OFC_ERROR_SUCCESS)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) wait_error) ;
+	  done = OFC_TRUE ;
+	}
+      else
+	{
+	  wait_error = pipe_wait_data (half, deadline) ;
+	}
+    }
+
+  if (ret)
+    {
+      stream = (half->read_mode == OFC_FS_PIPE_READMODE_BYTE ||
+		half->ring.buffer != OFC_NULL) ;
+      *read = n ;
+      /*
+       * Move to the next segment while the message runs on or, for a
+       * stream, while the previous segment was filled
+       */
+      for (i = 1 ;
+	   i < count &&
+	     (error == OFC_ERROR_MORE_DATA ||
+	      (stream && n == segments[i-1].len)) &&
+	     pipe_read_available (half, segments[i].buffer, segments[i].len,
+				  &n, &error) ;
+	   i++)
+	*read += n ;
+
+      pipe_service_overlapped (pipe_file) ;
+      if (error != OFC_ERROR_SUCCESS)
+	{
+	  ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+	  ret = OFC_FALSE ;
+	}
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Find the link to a lent message given the address it was lent at.
+ * Returns OFC_NULL if the address is not on the list.  Called with the
+ * pipe lock held.
+ */
+static OFC_FS_PIPE_DATA **pipe_loan_find (OFC_FS_PIPE_DATA **loans,
+					  OFC_LPCVOID buffer)
+{
+  OFC_FS_PIPE_DATA **prev ;
+
+  for (prev = loans ;
+       *prev != OFC_NULL &&
+	 (OFC_LPCVOID) ((*prev)->buffer + (*prev)->offset) != buffer ;
+       prev = &(*prev)->free_next) ;
+
+  if (*prev == OFC_NULL)
+    prev = OFC_NULL ;
+  return (prev) ;
+}
+
+/*
+ * Take the message at the head of a half's queue and lend it to the
+ * caller.  Blocks with the lock dropped until a message arrives.  Only
+ * unbounded pipes queue messages, so bounded pipes cannot lend them.
+ */
+static OFC_FS_PIPE_DATA *pipe_borrow_internal (OFC_FS_PIPE_HALF *half,
+					       OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_DATA *data ;
+  OFC_BOOL done ;
+  OFC_DWORD wait_error ;
+
+  data = OFC_NULL ;
+  wait_error = OFC_ERROR_SUCCESS ;
+
+  for (done = OFC_FALSE ; !done ; )
+    {
+      if (half->ring.buffer != OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+	  done = OFC_TRUE ;
+	}
+      else if (half->reads.first == OFC_NULL &&
+	       (data = pipe_dequeue_data (half)) != OFC_NULL)
+	{
+	  half->queued -= data->len ;
+	  pipe_counter_add (&half->stats->bytes_read, data->len) ;
+	  data->free_next = half->borrowed ;
+	  half->borrowed = data ;
+	  done = OFC_TRUE ;
+	}
+      else if (half->sibling == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  done = OFC_TRUE ;
+	}
+      else if (wait_error != OFC_ERROR_SUCCESS)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) wait_error) ;
+	  done = OFC_TRUE ;
+	}
+      else
+	{
+	  wait_error = pipe_wait_data (half, deadline) ;
+	}
+    }
+
+  return (data) ;
+}
+
+/*
+ * Copy data queued on a half without consuming it.  Returns the bytes
+ * copied, with the total queued and what remains of the head message
+ * in message mode.  Called with the pipe lock held.
+ */
+static OFC_DWORD pipe_peek_internal (OFC_FS_PIPE_HALF *half,
+				     OFC_CHAR *buffer,
+				     OFC_DWORD len,
+				     OFC_DWORD *avail,
+				     OFC_DWORD *left)
+{
+  OFC_FS_PIPE_DATA *data ;
+  OFC_DWORD nBytes ;
+  OFC_DWORD copied ;
+
+  copied = 0 ;
+  *left = 0 ;
+  if (half->ring.buffer != OFC_NULL)
+    {
+      *avail = half->ring.count ;
+      if (buffer != OFC_NULL)
+	copied = pipe_ring_peek (&half->ring, buffer, len) ;
+    }
+  else
+    {
+      *avail = half->queued ;
+      data = half->first ;
+      if (data != OFC_NULL && half->read_mode == OFC_FS_PIPE_READMODE_MESSAGE)
+	{
+	  if (buffer != OFC_NULL)
+	    {
+	      copied = OFC_MIN (len, data->len) ;
+	      ofc_memcpy (buffer, data->buffer + data->offset, copied) ;
+	    }
+	  *left = data->len - copied ;
+	}
+      else if (buffer != OFC_NULL)
+	{
+	  for ( ; data != OFC_NULL && copied < len ;
+		data = data->next)
+	    {
+	      nBytes = OFC_MIN (len - copied, data->len) ;
+	      ofc_memcpy (buffer + copied, data->buffer + data->offset,
+			  nBytes) ;
+	      copied += nBytes ;
+	    }
+	}
+    }
+  return (copied) ;
+}
+
+static OFC_FS_PIPE_OVERLAPPED *pipe_call_find (OFC_FS_PIPE_HALF *half,
+					       OFC_UINT32 id)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+
+  for (ov = half->calls.first ; ov != OFC_NULL && ov->id != id ;
+       ov = ov->next) ;
+  return (ov) ;
+}
+
+/*
+ * Send a request tagged with a correlation id and leave the overlapped
+ * structure waiting on the half for the reply.  Always returns
+ * OFC_FALSE, with OFC_ERROR_IO_PENDING once the request is queued.
+ * Called with the pipe lock held.
+ */
+static OFC_BOOL pipe_post_internal (OFC_FS_PIPE_HALF *half,
+				    OFC_FS_PIPE_OVERLAPPED *ov,
+				    OFC_UINT32 id,
+				    const OFC_CHAR *request,
+				    OFC_DWORD request_len,
+				    OFC_CHAR *reply,
+				    OFC_DWORD reply_len)
+{
+  OFC_FS_PIPE_DATA *data ;
+  OFC_DWORD error ;
+
+  data = OFC_NULL ;
+  if (half->sibling == OFC_NULL)
+    error = OFC_ERROR_BROKEN_PIPE ;
+  else if (half->sibling->ring.buffer != OFC_NULL)
+    error = OFC_ERROR_NOT_SUPPORTED ;
+  else if (id == 0 || pipe_call_find (half, id) != OFC_NULL)
+    error = OFC_ERROR_INVALID_PARAMETER ;
+  else if ((data = pipe_data_alloc (half->pipe_file,
+				    request_len)) == OFC_NULL)
+    error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+  else
+    {
+      ofc_memcpy (data->buffer, request, request_len) ;
+      data->id = id ;
+
+      ov->buffer = reply ;
+      ov->len = reply_len ;
+      ov->transferred = 0 ;
+      ov->id = id ;
+      ov->half = half ;
+      pipe_ovq_enqueue (&half->calls, ov) ;
+
+      pipe_queue_data (half->sibling, data) ;
+      pipe_service_overlapped (half->pipe_file) ;
+      error = OFC_ERROR_IO_PENDING ;
+    }
+
+  ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+  return (OFC_FALSE) ;
+}
+
+/*
+ * Read the next message on a half along with its correlation id.
+ * Blocks with the lock dropped until one arrives.
+ */
+static OFC_BOOL pipe_read_request_internal (OFC_FS_PIPE_HALF *half,
+					    OFC_CHAR *buffer,
+					    OFC_DWORD len,
+					    OFC_DWORD *read,
+					    OFC_UINT32 *id,
+					    OFC_MSTIME deadline)
+{
+  OFC_FS_PIPE_DATA *data ;
+  OFC_BOOL ret ;
+  OFC_BOOL done ;
+  OFC_DWORD wait_error ;
+  OFC_DWORD error ;
+
+  *read = 0 ;
+  *id = 0 ;
+  ret = OFC_FALSE ;
+  wait_error = OFC_ERROR_SUCCESS ;
+
+  for (done = OFC_FALSE ; !done ; )
+    {
+      data = OFC_NULL ;
+      if (half->reads.first == OFC_NULL)
+	data = half->first ;
+
+      if (half->ring.buffer != OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+	  done = OFC_TRUE ;
+	}
+      else if (data != OFC_NULL)
+	{
+	  *id = data->id ;
+	  pipe_read_available (half, buffer, len, read, &error) ;
+	  if (error == OFC_ERROR_SUCCESS)
+	    ret = OFC_TRUE ;
+	  else
+	    ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+	  done = OFC_TRUE ;
+	}
+      else if (half->sibling == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  done = OFC_TRUE ;
+	}
+      else if (wait_error != OFC_ERROR_SUCCESS)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) wait_error) ;
+	  done = OFC_TRUE ;
+	}
+      else
+	{
+	  wait_error = pipe_wait_data (half, deadline) ;
+	}
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Copy a reply straight into the buffer of the pipelined transact
+ * waiting for it on the sibling and complete it.  A reply longer than
+ * the buffer completes the call with OFC_ERROR_MORE_DATA and the rest
+ * is dropped.  Called with the pipe lock held.
+ */
+static OFC_BOOL pipe_write_reply_internal (OFC_FS_PIPE_HALF *half,
+					   OFC_UINT32 id,
+					   const OFC_CHAR *reply,
+					   OFC_DWORD len)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  if (half->sibling == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+  else
+    {
+      /*
+       * The caller may have cancelled the request, in which case there
+       * is no one to deliver the reply to
+       */
+      ov = pipe_call_find (half->sibling, id) ;
+      if (ov != OFC_NULL)
+	{
+	  ov->transferred = OFC_MIN (len, ov->len) ;
+	  ofc_memcpy (ov->buffer, reply, ov->transferred) ;
+	  pipe_stats_written (half->sibling->stats, ov->transferred, 1, 0, 0) ;
+	  pipe_counter_add (&half->sibling->stats->bytes_read,
+			    ov->transferred) ;
+	  pipe_ovq_unlink (&half->sibling->calls, ov) ;
+	  pipe_ov_complete (ov, ov->transferred < len ?
+			    OFC_ERROR_MORE_DATA : OFC_ERROR_SUCCESS) ;
+	}
+      ret = OFC_TRUE ;
+    }
+
+  return (ret) ;
+}
+
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+/*
+ * Key a name is published under in the shared registry.  Folded the
+ * way names are compared so every process agrees on it.
+ */
+static OFC_CHAR *pipe_shm_key (OFC_LPCTSTR name)
+{
+  OFC_TCHAR *folded ;
+  OFC_TCHAR *p ;
+  OFC_CHAR *key ;
+
+  key = OFC_NULL ;
+  folded = ofc_tstrdup (pipe_name_skip (name)) ;
+  if (folded != OFC_NULL)
+    {
+      for (p = folded ; *p != TCHAR_EOS ; p++)
+	*p = pipe_fold (*p) ;
+      key = ofc_tstr2cstr (folded) ;
+      ofc_free (folded) ;
+    }
+  return (key) ;
+}
+
+static OFC_UINT pipe_shm_spin_count (OFC_FS_PIPE_FILE *pipe_file)
+{
+  return (pipe_file->config.spin_count != 0 ?
+	  pipe_file->config.spin_count : pipes.spin_count) ;
+}
+
+/*
+ * Publish a new server instance in the shared registry
+ */
+static OFC_BOOL pipe_shm_listen_half (OFC_FS_PIPE_HALF *half,
+				      OFC_LPCTSTR name)
+{
+  OFC_CHAR *key ;
+
+  key = pipe_shm_key (name) ;
+  if (key == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+  else
+    {
+      half->shm = pipe_shm_listen (key, half->pipe_file->config.in_buffer_size,
+				   pipe_shm_spin_count (half->pipe_file)) ;
+      ofc_free (key) ;
+    }
+  return (half->shm != OFC_NULL) ;
+}
+
+/*
+ * Hold the shared instance of a half for a call made without the pipe
+ * lock.  Closing the half detaches the instance under the lock, so
+ * this fails once the half is closing.  Called with the pipe lock
+ * held.
+ */
+static OFC_FS_PIPE_SHM *pipe_shm_hold_half (OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_SHM *shm ;
+
+  shm = half->shm ;
+  if (shm == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else
+    pipe_shm_hold (shm) ;
+  return (shm) ;
+}
+
+/*
+ * Wait for a client in another process.  The wait is on the shared
+ * segment so it is made without the pipe lock.  The half may be closed
+ * meanwhile, so afterwards it is looked up again through its handle.
+ */
+static OFC_BOOL pipe_shm_accept_half (OFC_FS_PIPE_HALF *half,
+				      OFC_HANDLE hOverlapped)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_SHM *shm ;
+  OFC_HANDLE hPipe ;
+  OFC_UINT64 start ;
+  OFC_BOOL ret ;
+
+  pipe_file = half->pipe_file ;
+  hPipe = half->hPipe ;
+  shm = OFC_NULL ;
+  ret = OFC_FALSE ;
+  if (hOverlapped != OFC_HANDLE_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+  else
+    {
+      ofc_lock (pipe_file->lock) ;
+      if (half->connected)
+	ofc_thread_set_variable (OfcLastError,
+				 (OFC_DWORD_PTR) OFC_ERROR_NO_DATA) ;
+      else
+	shm = pipe_shm_hold_half (half) ;
+      ofc_unlock (pipe_file->lock) ;
+    }
+
+  if (shm != OFC_NULL)
+    {
+      start = pipe_latency_start () ;
+      ret = pipe_shm_accept (shm) ;
+      pipe_shm_release (shm) ;
+      if (ofc_handle_lock (hPipe) != half)
+	{
+	  if (ret)
+	    ofc_thread_set_variable (OfcLastError,
+				     (OFC_DWORD_PTR)
+				     OFC_ERROR_INVALID_HANDLE) ;
+	  ret = OFC_FALSE ;
+	}
+      else
+	{
+	  ofc_lock (pipe_file->lock) ;
+	  half->connected = ret ;
+	  pipe_latency_record (pipe_file, OFC_FS_PIPE_LATENCY_CONNECT, start) ;
+	  ofc_unlock (pipe_file->lock) ;
+	  ofc_handle_unlock (hPipe) ;
+	}
+      if (ret)
+	{
+	  ofc_pipe_lock () ;
+	  pipes.stats.connects++ ;
+	  ofc_pipe_unlock () ;
+	}
+    }
+  return (ret) ;
+}
+
+/*
+ * Open the client end of an instance published by another process.
+ * The client gets a pipe file of its own that is not registered
+ * locally.
+ */
+static OFC_HANDLE pipe_shm_open_client (OFC_LPCTSTR name)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_HALF *client ;
+  OFC_FS_PIPE_SHM *shm ;
+  OFC_CHAR *key ;
+  OFC_HANDLE ret ;
+
+  ret = OFC_HANDLE_NULL ;
+  shm = OFC_NULL ;
+  key = pipe_shm_key (name) ;
+  if (key != OFC_NULL)
+    {
+      shm = pipe_shm_connect (key, pipes.spin_count) ;
+      ofc_free (key) ;
+    }
+
+  pipe_file = OFC_NULL ;
+  if (shm != OFC_NULL)
+    pipe_file = ofc_malloc (sizeof (OFC_FS_PIPE_FILE)) ;
+
+  if (pipe_file != OFC_NULL)
+    {
+      ofc_memset (pipe_file, 0, sizeof (OFC_FS_PIPE_FILE)) ;
+      pipe_file->name = ofc_tstrdup (name) ;
+      pipe_file->hash = pipe_hash (name) ;
+      pipe_file->lock = ofc_lock_init () ;
+      pipe_pool_init (&pipe_file->pool) ;
+      client = pipe_half_create (pipe_file, 0, &pipe_file->outbound) ;
+      if (client == OFC_NULL)
+	{
+	  ofc_lock_destroy (pipe_file->lock) ;
+	  ofc_free (pipe_file->name) ;
+	  ofc_free (pipe_file) ;
+	  pipe_file = OFC_NULL ;
+	}
+      else
+	{
+	  client->shm = shm ;
+	  client->connected = OFC_TRUE ;
+	  pipe_file->client = client ;
+	  ret = client->hPipe ;
+	}
+    }
+
+  if (shm != OFC_NULL && pipe_file == OFC_NULL)
+    {
+      pipe_shm_close (shm) ;
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Traffic a shared end writes is read in the other process so it is
+ * counted against the direction it leaves in
+ */
+static OFC_BOOL pipe_shm_write_half (OFC_FS_PIPE_HALF *half,
+				     OFC_LPCVOID buffer, OFC_DWORD len,
+				     OFC_DWORD *written,
+				     OFC_HANDLE hOverlapped)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_SHM *shm ;
+  OFC_HANDLE hPipe ;
+  OFC_BOOL ret ;
+
+  pipe_file = half->pipe_file ;
+  hPipe = half->hPipe ;
+  *written = 0 ;
+  shm = OFC_NULL ;
+  ret = OFC_FALSE ;
+  if (hOverlapped != OFC_HANDLE_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+  else
+    {
+      ofc_lock (pipe_file->lock) ;
+      shm = pipe_shm_hold_half (half) ;
+      ofc_unlock (pipe_file->lock) ;
+    }
+
+  if (shm != OFC_NULL)
+    {
+      ret = pipe_shm_write (shm, buffer, len, written) ;
+      pipe_shm_release (shm) ;
+      if (ret && ofc_handle_lock (hPipe) == half)
+	{
+	  ofc_lock (pipe_file->lock) ;
+	  pipe_stats_written (pipe_file->server == half ?
+			      &pipe_file->outbound : &pipe_file->inbound,
+			      *written, 1, 0, 0) ;
+	  ofc_unlock (pipe_file->lock) ;
+	  ofc_handle_unlock (hPipe) ;
+	}
+    }
+  return (ret) ;
+}
+
+static OFC_BOOL pipe_shm_read_half (OFC_FS_PIPE_HALF *half,
+				    OFC_LPVOID buffer, OFC_DWORD len,
+				    OFC_DWORD *read,
+				    OFC_HANDLE hOverlapped)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_SHM *shm ;
+  OFC_HANDLE hPipe ;
+  OFC_BOOL byte_mode ;
+  OFC_DWORD error ;
+  OFC_BOOL ret ;
+
+  pipe_file = half->pipe_file ;
+  hPipe = half->hPipe ;
+  *read = 0 ;
+  shm = OFC_NULL ;
+  byte_mode = OFC_FALSE ;
+  ret = OFC_FALSE ;
+  if (hOverlapped != OFC_HANDLE_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+  else
+    {
+      ofc_lock (pipe_file->lock) ;
+      shm = pipe_shm_hold_half (half) ;
+      byte_mode = half->read_mode == OFC_FS_PIPE_READMODE_BYTE ;
+      ofc_unlock (pipe_file->lock) ;
+    }
+
+  if (shm != OFC_NULL)
+    {
+      ret = pipe_shm_read (shm, buffer, len, read, byte_mode) ;
+      error = (OFC_DWORD) ofc_thread_get_variable (OfcLastError) ;
+      pipe_shm_release (shm) ;
+      if (ofc_handle_lock (hPipe) == half)
+	{
+	  pipe_counter_add (&half->stats->bytes_read, *read) ;
+	  ofc_handle_unlock (hPipe) ;
+	}
+      ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+    }
+  return (ret) ;
+}
+#endif
+
+/*
+ * Fail calls that work on the local queues of a half.  A shared
+ * instance has none, only its rings.
+ */
+static OFC_BOOL pipe_local_only (OFC_FS_PIPE_HALF *half)
+{
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  if (half->shm != OFC_NULL)
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+      ret = OFC_FALSE ;
+    }
+#endif
+  return (ret) ;
+}
+
+static OFC_BOOL OfcFSPipeCloseHandle (OFC_HANDLE hFile) ;
+
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+/*
+ * Copy of the socket a name is bridged to, if any.  Called with
+ * pipes.lock held.
+ */
+static OFC_CHAR *pipe_bridge_path (OFC_LPCTSTR name)
+{
+  OFC_FS_PIPE_CONFIG_ENTRY *entry ;
+  OFC_CHAR *path ;
+
+  path = OFC_NULL ;
+  entry = pipe_config_lookup (name) ;
+  if (entry != OFC_NULL && entry->bridge != OFC_NULL)
+    path = ofc_strdup (entry->bridge) ;
+  return (path) ;
+}
+
+/*
+ * The forwarder is the reader of the server half of a bridged pipe.
+ * The pipe is in byte mode so everything the client has queued comes
+ * out in one piece.
+ */
+static OFC_DWORD pipe_bridge_drain (OFC_VOID *context, OFC_CHAR *buffer,
+				    OFC_DWORD len, OFC_BOOL *closed)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_DWORD nread ;
+  OFC_DWORD error ;
+
+  half = context ;
+  pipe_file = half->pipe_file ;
+  ofc_lock (pipe_file->lock) ;
+  if (!pipe_read_available (half, buffer, len, &nread, &error))
+    nread = 0 ;
+  *closed = half->sibling == OFC_NULL && half->first == OFC_NULL ;
+  ofc_unlock (pipe_file->lock) ;
+  return (nread) ;
+}
+
+/*
+ * And the writer.  Both directions are unbounded so this never blocks.
+ */
+static OFC_BOOL pipe_bridge_fill (OFC_VOID *context, const OFC_CHAR *buffer,
+				  OFC_DWORD len)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_DWORD written ;
+  OFC_BOOL ret ;
+
+  half = context ;
+  pipe_file = half->pipe_file ;
+  ofc_lock (pipe_file->lock) ;
+  ret = pipe_write_internal (half, buffer, len, &written, OFC_NULL, 0) ;
+  ofc_unlock (pipe_file->lock) ;
+  return (ret) ;
+}
+
+/*
+ * The socket or the client has gone.  Closing the server half breaks
+ * the pipe for a client still reading once it has drained what was
+ * forwarded.
+ */
+static OFC_VOID pipe_bridge_close (OFC_VOID *context)
+{
+  OFC_FS_PIPE_HALF *half ;
+
+  half = context ;
+  ofc_lock (half->pipe_file->lock) ;
+  half->bridge = OFC_NULL ;
+  ofc_unlock (half->pipe_file->lock) ;
+  OfcFSPipeCloseHandle (half->hPipe) ;
+}
+
+static const OFC_FS_PIPE_BRIDGE_OPS pipe_bridge_ops =
+  {
+    pipe_bridge_drain,
+    pipe_bridge_fill,
+    pipe_bridge_close
+  } ;
+
+/*
+ * Open a name bridged to a socket.  The pipe is a local instance like
+ * any other, except its server half is read and written by the
+ * forwarder rather than by a server thread.
+ */
+static OFC_HANDLE pipe_bridge_open_client (OFC_LPCTSTR name,
+					   const OFC_CHAR *path)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_CONFIG_ENTRY *config ;
+  OFC_FS_PIPE_HALF *server ;
+  OFC_FS_PIPE_HALF *client ;
+  OFC_FS_PIPE_BRIDGE *bridge ;
+  OFC_HANDLE ret ;
+  OFC_DWORD error ;
+
+  ret = OFC_HANDLE_NULL ;
+  server = OFC_NULL ;
+  client = OFC_NULL ;
+  pipe_file = ofc_malloc (sizeof (OFC_FS_PIPE_FILE)) ;
+  if (pipe_file != OFC_NULL)
+    {
+      ofc_memset (pipe_file, 0, sizeof (OFC_FS_PIPE_FILE)) ;
+      pipe_file->name = ofc_tstrdup (name) ;
+      pipe_file->hash = pipe_hash (name) ;
+      pipe_file->lock = ofc_lock_init () ;
+      pipe_pool_init (&pipe_file->pool) ;
+
+      ofc_pipe_lock () ;
+      config = pipe_config_lookup (name) ;
+      if (config != OFC_NULL)
+	pipe_file->config = config->config ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+      pipe_file->histogram = pipe_histogram_get (name) ;
+#endif
+      ofc_pipe_unlock () ;
+      /*
+       * A socket is a byte stream, and the forwarder must never wait
+       * for room in a ring
+       */
+      pipe_file->config.read_mode = OFC_FS_PIPE_READMODE_BYTE ;
+      pipe_file->config.in_buffer_size = 0 ;
+      pipe_file->config.out_buffer_size = 0 ;
+      pipe_file->config.shared = OFC_FALSE ;
+
+      server = pipe_half_create (pipe_file, 0, &pipe_file->inbound) ;
+      client = pipe_half_create (pipe_file, 0, &pipe_file->outbound) ;
+    }
+
+  if (server != OFC_NULL && client != OFC_NULL)
+    {
+      server->sibling = client ;
+      client->sibling = server ;
+      server->connected = OFC_TRUE ;
+      client->connected = OFC_TRUE ;
+      pipe_file->server = server ;
+      pipe_file->client = client ;
+
+      ofc_pipe_lock () ;
+      pipe_enqueue_internal (pipe_file) ;
+      pipe_unlisten_internal (pipe_file) ;
+      pipes.stats.connects++ ;
+      ofc_pipe_unlock () ;
+
+      bridge = pipe_bridge_connect (path, server) ;
+      if (bridge != OFC_NULL)
+	{
+	  ofc_lock (pipe_file->lock) ;
+	  server->bridge = bridge ;
+	  ofc_unlock (pipe_file->lock) ;
+	  if (!pipe_bridge_start (bridge))
+	    {
+	      ofc_lock (pipe_file->lock) ;
+	      server->bridge = OFC_NULL ;
+	      ofc_unlock (pipe_file->lock) ;
+	      bridge = OFC_NULL ;
+	    }
+	}
+
+      if (bridge != OFC_NULL)
+	ret = client->hPipe ;
+      else
+	{
+	  error = (OFC_DWORD) ofc_thread_get_variable (OfcLastError) ;
+	  OfcFSPipeCloseHandle (client->hPipe) ;
+	  OfcFSPipeCloseHandle (server->hPipe) ;
+	  ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+	}
+    }
+  else
+    {
+      if (server != OFC_NULL)
+	{
+	  ofc_handle_destroy (server->hPipe) ;
+	  pipe_half_destroy (server) ;
+	}
+      if (client != OFC_NULL)
+	{
+	  ofc_handle_destroy (client->hPipe) ;
+	  pipe_half_destroy (client) ;
+	}
+      if (pipe_file != OFC_NULL)
+	{
+	  pipe_pool_destroy (&pipe_file->pool) ;
+	  ofc_lock_destroy (pipe_file->lock) ;
+	  ofc_free (pipe_file->name) ;
+	  ofc_free (pipe_file) ;
+	}
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+    }
+  return (ret) ;
+}
+#endif
+
+static OFC_HANDLE OfcFSPipeCreateFile (OFC_LPCTSTR lpFileName,
+					 OFC_DWORD dwDesiredAccess,
+					 OFC_DWORD dwShareMode,
+					 OFC_LPSECURITY_ATTRIBUTES 
+					 lpSecAttributes,
+					 OFC_DWORD dwCreationDisposition,
+					 OFC_DWORD dwFlagsAndAttributes,
+					 OFC_HANDLE hTemplateFile)
+{
+  OFC_HANDLE ret ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_HALF *client ;
+  OFC_FS_PIPE_HALF *server ;
+  OFC_FS_PIPE_CONFIG_ENTRY *config ;
+  OFC_DWORD error ;
+  OFC_BOOL connected ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+  OFC_CHAR *bridge ;
+#endif
+
+  ret = OFC_HANDLE_NULL ;
+  error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+
+  /*
+   * If it's create always, we create the pipe (even if there's other pipes
+   * with the same name) and add it to the pipe list.  Unless the pipe is
+   * opened for overlapped I/O, we will then wait for a connection before
+   * we return.  An overlapped server returns immediately and accepts
+   * clients with OfcFSPipeConnect.
+   */
+  if (dwCreationDisposition == OFC_CREATE_ALWAYS ||
+      dwCreationDisposition == OFC_CREATE_NEW)
+    {
+      pipe_file = ofc_malloc(sizeof (OFC_FS_PIPE_FILE)) ;
+      if (pipe_file != OFC_NULL)
+	{
+	  /*
+	   * We're creating the server
+	   */
+	  pipe_file->name = ofc_tstrdup(lpFileName) ;
+	  pipe_file->hash = pipe_hash (lpFileName) ;
+	  pipe_file->registered = OFC_FALSE ;
+	  pipe_file->listening = OFC_FALSE ;
+	  pipe_file->lock = ofc_lock_init() ;
+	  pipe_pool_init (&pipe_file->pool) ;
+	  ofc_memset (&pipe_file->wait_stats, 0,
+		      sizeof (OFC_FS_PIPE_WAIT_STATS)) ;
+	  ofc_memset (&pipe_file->inbound, 0,
+		      sizeof (OFC_FS_PIPE_DIRECTION_STATS)) ;
+	  ofc_memset (&pipe_file->outbound, 0,
+		      sizeof (OFC_FS_PIPE_DIRECTION_STATS)) ;
+
+	  ofc_pipe_lock () ;
+	  config = pipe_config_lookup (lpFileName) ;
+	  if (config == OFC_NULL)
+	    ofc_memset (&pipe_file->config, 0, sizeof (OFC_FS_PIPE_CONFIG)) ;
+	  else
+	    pipe_file->config = config->config ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+	  pipe_file->histogram = pipe_histogram_get (lpFileName) ;
+#endif
+	  ofc_pipe_unlock () ;
+
+	  server = pipe_half_create (pipe_file,
+				     pipe_file->config.in_buffer_size,
+				     &pipe_file->inbound) ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+	  if (server != OFC_NULL && pipe_file->config.shared &&
+	      !pipe_shm_listen_half (server, lpFileName))
+	    {
+	      error = (OFC_DWORD) ofc_thread_get_variable (OfcLastError) ;
+	      ofc_handle_destroy (server->hPipe) ;
+	      pipe_half_destroy (server) ;
+	      server = OFC_NULL ;
+	    }
+#endif
+	  if (server != OFC_NULL)
+	    {
+	      pipe_file->server = server ;
+	      pipe_file->client = OFC_NULL ;
+
+	      ofc_pipe_lock () ;
+	      if (pipe_file->config.backlog != 0 &&
+		  pipe_listen_count (pipe_file->name, pipe_file->hash) >=
+		  pipe_file->config.backlog)
+		{
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+		  /*
+		   * Give up the shared slot so it is not left listening
+		   */
+		  if (server->shm != OFC_NULL)
+		    {
+		      pipe_shm_close (server->shm) ;
+		      server->shm = OFC_NULL ;
+		    }
+#endif
+		  ofc_handle_destroy (server->hPipe) ;
+		  pipe_half_destroy (server) ;
+		  pipe_pool_destroy (&pipe_file->pool) ;
+		  pipe_wait_stats_add (&pipes.wait_stats,
+				       &pipe_file->wait_stats) ;
+		  ofc_pipe_unlock () ;
+		  ofc_lock_destroy (pipe_file->lock) ;
+		  ofc_free (pipe_file->name) ;
+		  ofc_free (pipe_file) ;
+		  ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) 
+					   OFC_ERROR_PIPE_BUSY) ;
+		}
+	      else
+		{
+		  pipe_enqueue_internal (pipe_file) ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+		  /*
+		   * A shared instance is listed with the others but clients
+		   * in this process find it through the shared registry too
+		   */
+		  if (server->shm != OFC_NULL)
+		    pipe_unlisten_internal (pipe_file) ;
+#endif
+		  ofc_pipe_unlock() ;
+
+		  ret = server->hPipe ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+		  if (server->shm != OFC_NULL)
+		    {
+		      if (!(dwFlagsAndAttributes & OFC_FILE_FLAG_OVERLAPPED) &&
+			  !pipe_shm_accept_half (server, OFC_HANDLE_NULL))
+			{
+			  error = (OFC_DWORD) 
+			    ofc_thread_get_variable (OfcLastError) ;
+			  OfcFSPipeCloseHandle (ret) ;
+			  ret = OFC_HANDLE_NULL ;
+			  ofc_thread_set_variable (OfcLastError, 
+						   (OFC_DWORD_PTR) error) ;
+			}
+		    }
+		  else
+#endif
+		  if (!(dwFlagsAndAttributes & OFC_FILE_FLAG_OVERLAPPED))
+		    {
+		      error = OFC_ERROR_SEM_TIMEOUT ;
+		      ofc_lock (pipe_file->lock) ;
+		      if (!pipe_connect_internal (server, OFC_NULL,
+						  pipe_deadline
+						  (server,
+						   OFC_FS_PIPE_WAIT_DEFAULT)))
+			error = (OFC_DWORD) 
+			  ofc_thread_get_variable (OfcLastError) ;
+		      connected = server->connected ;
+		      ofc_unlock (pipe_file->lock) ;
+		      /*
+		       * No client came in time, or the wait could not be
+		       * made.  The instance is closed so it can't be
+		       * connected to later.
+		       */
+		      if (!connected)
+			{
+			  OfcFSPipeCloseHandle (ret) ;
+			  ret = OFC_HANDLE_NULL ;
+			  ofc_thread_set_variable (OfcLastError, 
+						   (OFC_DWORD_PTR) error) ;
+			}
+		    }
+		}
+	    }
+	  else
+	    {
+	      ofc_lock_destroy(pipe_file->lock) ;
+	      ofc_free(pipe_file->name) ;
+	      ofc_free(pipe_file) ;
+	      ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+	    }
+	}
+    }
+  else
+    {
+      /*
+       * We are opening the pipe from the client side.  We look for a pipe
+       * that has no client
+       */
+      ofc_pipe_lock () ;
+      pipe_file = pipe_lookup_internal (lpFileName) ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+      bridge = OFC_NULL ;
+      if (pipe_file == OFC_NULL)
+	bridge = pipe_bridge_path (lpFileName) ;
+#endif
+
+      if (pipe_file == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) 
+				 OFC_ERROR_FILE_NOT_FOUND) ;
+	}
+      else
+	{
+	  client = pipe_half_create (pipe_file,
+				     pipe_file->config.out_buffer_size,
+				     &pipe_file->outbound) ;
+	  if (client != OFC_NULL)
+	    {
+	      pipe_file->client = client ;
+	      pipe_unlisten_internal (pipe_file) ;
+	      server = pipe_file->server ;
+
+	      ofc_lock(pipe_file->lock) ;
+	      client->sibling = pipe_file->server ;
+	      server->sibling = client ;
+	      client->connected = OFC_TRUE ;
+	      server->connected = OFC_TRUE ;
+	      pipes.stats.connects++ ;
+	      pipe_complete_connects (server) ;
+	      /*
+	       * Set the event
+	       */
+	      pipe_wake_data (server) ;
+	      ofc_unlock(pipe_file->lock) ;
+
+	      ret = client->hPipe ;
+	    }
+	  else
+	    {
+	      ofc_thread_set_variable 
+		(OfcLastError, 
+		 (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	    }
+	}
+      ofc_pipe_unlock () ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+      /*
+       * No instance in this process but the name is served by a
+       * daemon on a socket
+       */
+      if (bridge != OFC_NULL)
+	{
+	  ret = pipe_bridge_open_client (lpFileName, bridge) ;
+	  ofc_free (bridge) ;
+	}
+#endif
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+      /*
+       * No instance in this process.  Look for one another process
+       * has published.
+       */
+      if (pipe_file == OFC_NULL && ret == OFC_HANDLE_NULL)
+	ret = pipe_shm_open_client (lpFileName) ;
+#endif
+    }
+  return (ret) ;
+}
+
+static OFC_BOOL 
+OfcFSPipeCreateDirectory (OFC_LPCTSTR lpPathName,
+			   OFC_LPSECURITY_ATTRIBUTES lpSecurityAttr) 
+{
+  ofc_thread_set_variable (OfcLastError, 
+			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+
+  return (OFC_FALSE) ;
+}
+
+static OFC_BOOL OfcFSPipeWriteFile (OFC_HANDLE hFile,
+				      OFC_LPCVOID lpBuffer,
+				      OFC_DWORD nNumberOfBytesToWrite,
+				      OFC_LPDWORD lpNumberOfBytesWritten,
+				      OFC_HANDLE hOverlapped)
+{
+  OFC_BOOL ret ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_DWORD nBytes ;
+  OFC_MSTIME deadline ;
+
+  ret = OFC_FALSE ;
+
+  half = ofc_handle_lock (hFile) ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  if (half != OFC_NULL && half->shm != OFC_NULL)
+    {
+      ret = pipe_shm_write_half (half, lpBuffer, nNumberOfBytesToWrite,
+				 &nBytes, hOverlapped) ;
+      if (ret && lpNumberOfBytesWritten != OFC_NULL)
+	*lpNumberOfBytesWritten = nBytes ;
+      ofc_handle_unlock (hFile) ;
+      half = OFC_NULL ;
+    }
+#endif
+  if (half != OFC_NULL)
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock(pipe_file->lock) ;
+      if (pipe_ov_begin (pipe_file, hOverlapped, &ov))
+	{
+	  deadline = pipe_deadline (half, OFC_FS_PIPE_WAIT_DEFAULT) ;
+	  ret = pipe_write_internal (half, lpBuffer, nNumberOfBytesToWrite,
+				     &nBytes, ov, deadline) ;
+	  if (ret && lpNumberOfBytesWritten != OFC_NULL)
+	    *lpNumberOfBytesWritten = nBytes ;
+	  pipe_ov_end (hOverlapped, ov, ret) ;
+	}
+      ofc_unlock(pipe_file->lock) ;
+      ofc_handle_unlock (hFile) ;
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Shared memory halves are not timed
+ */
+static OFC_BOOL pipe_read_handle (OFC_HANDLE hFile,
+				  OFC_LPVOID lpBuffer,
+				  OFC_DWORD nNumberOfBytesToRead,
+				  OFC_LPDWORD lpNumberOfBytesRead,
+				  OFC_HANDLE hOverlapped,
+				  OFC_DWORD dwMilliseconds)
+{
+  OFC_BOOL ret ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_DWORD nBytes ;
+
+  ret = OFC_FALSE ;
+
+  half = ofc_handle_lock (hFile) ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  if (half != OFC_NULL && half->shm != OFC_NULL)
+    {
+      ret = pipe_shm_read_half (half, lpBuffer, nNumberOfBytesToRead,
+				&nBytes, hOverlapped) ;
+      if (lpNumberOfBytesRead != OFC_NULL)
+	*lpNumberOfBytesRead = nBytes ;
+      ofc_handle_unlock (hFile) ;
+      half = OFC_NULL ;
+    }
+#endif
+  if (half != OFC_NULL)
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock(pipe_file->lock) ;
+      if (pipe_ov_begin (pipe_file, hOverlapped, &ov))
+	{
+	  ret = pipe_read_internal (half, lpBuffer, nNumberOfBytesToRead,
+				    &nBytes, ov,
+				    pipe_deadline (half, dwMilliseconds)) ;
+	  /*
+	   * A message that did not fit still returns the part that did
+	   */
+	  if (lpNumberOfBytesRead != OFC_NULL)
+	    *lpNumberOfBytesRead = nBytes ;
+	  pipe_ov_end (hOverlapped, ov, ret) ;
+	}
+      ofc_unlock(pipe_file->lock) ;
+      ofc_handle_unlock (hFile) ;
+    }
+  return (ret) ;
+}
+
+static OFC_BOOL OfcFSPipeReadFile (OFC_HANDLE hFile,
+				     OFC_LPVOID lpBuffer,
+				     OFC_DWORD nNumberOfBytesToRead,
+				     OFC_LPDWORD lpNumberOfBytesRead,
+				     OFC_HANDLE hOverlapped)
+{
+  return (pipe_read_handle (hFile, lpBuffer, nNumberOfBytesToRead,
+			    lpNumberOfBytesRead, hOverlapped,
+			    OFC_FS_PIPE_WAIT_DEFAULT)) ;
+}
+
+static OFC_BOOL OfcFSPipeCloseHandle (OFC_HANDLE hFile)
+{
+  OFC_BOOL ret ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_HALF *sibling ;
+  OFC_BOOL registry ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  OFC_FS_PIPE_SHM *shm ;
+#endif
+
+  ret = OFC_FALSE ;
+
+  half = ofc_handle_lock (hFile) ;
+  if (half != OFC_NULL)
+    {
+      pipe_file = half->pipe_file ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+      /*
+       * The other end is in another process.  Locally the half is
+       * alone so the pipe file goes with it.  The instance is detached
+       * under the lock so calls that have not held it yet fail, and
+       * those blocked on it are released by the close.
+       */
+      ofc_lock (pipe_file->lock) ;
+      shm = half->shm ;
+      half->shm = OFC_NULL ;
+      ofc_unlock (pipe_file->lock) ;
+      if (shm != OFC_NULL)
+	pipe_shm_close (shm) ;
+#endif
+      /*
+       * A half that closes without a sibling holds the last reference
+       * to the pipe file and must unlink it from the registry.  That
+       * requires pipes.lock ahead of the pipe lock so if we find
+       * ourselves alone, back out and take both in order.
+       */
+      registry = OFC_FALSE ;
+      ofc_lock (pipe_file->lock) ;
+      if (half->sibling == OFC_NULL)
+	{
+	  ofc_unlock (pipe_file->lock) ;
+	  registry = OFC_TRUE ;
+	  ofc_pipe_lock () ;
+	  ofc_lock (pipe_file->lock) ;
+	}
+
+      pipe_abort_overlapped (half, OFC_ERROR_OPERATION_ABORTED) ;
+      if (pipe_file->server == half)
+	pipe_file->server = OFC_NULL ;
+      if (pipe_file->client == half)
+	pipe_file->client = OFC_NULL ;
+      sibling = half->sibling ;
+      pipe_half_destroy (half) ;
+
+      if (sibling != OFC_NULL)
+	{
+	  /*
+	   * Either we were connected all along or a client connected
+	   * while we were acquiring the registry lock.
+	   */
+	  sibling->sibling = OFC_NULL ;
+	  pipe_wake_data (sibling) ;
+	  pipe_wake_space (sibling) ;
+	  /*
+	   * Pending reads may still drain what we wrote.  Anything left
+	   * after that can never complete.
+	   */
+	  pipe_service_overlapped (pipe_file) ;
+	  pipe_abort_overlapped (sibling, OFC_ERROR_BROKEN_PIPE) ;
+	  ofc_unlock (pipe_file->lock) ;
+	}
+      else
+	{
+	  pipe_unlink_internal (pipe_file) ;
+	  pipe_pool_destroy (&pipe_file->pool) ;
+	  pipe_wait_stats_add (&pipes.wait_stats, &pipe_file->wait_stats) ;
+	  pipe_direction_stats_add (&pipes.stats, &pipe_file->inbound) ;
+	  pipe_direction_stats_add (&pipes.stats, &pipe_file->outbound) ;
+	  ofc_unlock (pipe_file->lock) ;
+	  ofc_lock_destroy (pipe_file->lock) ;
+	  ofc_free (pipe_file->name) ;
+	  ofc_free (pipe_file) ;
+	}
+
+      if (registry)
+	ofc_pipe_unlock () ;
+
+      ofc_handle_destroy (hFile) ;
+      ofc_handle_unlock (hFile) ;
+      
+      ret = OFC_TRUE ;
+    }
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeDeleteFile (OFC_LPCTSTR lpFileName) 
+{
+  ofc_thread_set_variable (OfcLastError, 
+			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+
+  return (OFC_TRUE) ;
+}
+
+OFC_BOOL OfcFSPipeRemoveDirectory (OFC_LPCTSTR lpPathName) 
+{
+  ofc_thread_set_variable (OfcLastError, 
+			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+
+  return (OFC_TRUE) ;
+}
+
+/*
+ * Copy the registry's names and instance counts.  The registry lock is
+ * held only while the names are copied.  Sorting and folding instances
+ * of the same name together happen after it is released.
+ */
+static OFC_FS_PIPE_FIND *pipe_find_snapshot (OFC_LPCTSTR pattern)
+{
+  OFC_FS_PIPE_FIND *find ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_FIND_ENTRY *copies ;
+  OFC_FS_PIPE_FIND_ENTRY *entry ;
+  OFC_FS_PIPE_FIND_ENTRY copy ;
+  OFC_UINT ncopies ;
+  OFC_UINT lo ;
+  OFC_UINT hi ;
+  OFC_UINT mid ;
+  OFC_UINT i ;
+  OFC_INT cmp ;
+  OFC_BOOL all ;
+
+  /*
+   * Listing the root of the file system lists every name
+   */
+  all = (*pipe_name_skip (pattern) == TCHAR_EOS) ;
+  find = ofc_malloc (sizeof (OFC_FS_PIPE_FIND)) ;
+  if (find != OFC_NULL)
+    {
+      ncopies = 0 ;
+      ofc_pipe_lock () ;
+      copies = ofc_malloc (sizeof (OFC_FS_PIPE_FIND_ENTRY) *
+			   OFC_MAX (pipes.stats.instances, 1)) ;
+      for (pipe_file = pipes.first ;
+	   copies != OFC_NULL && pipe_file != OFC_NULL ;
+	   pipe_file = pipe_file->next)
+	{
+	  if (all || pipe_name_match (pattern, pipe_file->name))
+	    {
+	      copies[ncopies].name = ofc_tstrdup (pipe_file->name) ;
+	      copies[ncopies].instances = 1 ;
+	      copies[ncopies].listening = pipe_file->listening ? 1 : 0 ;
+	      if (copies[ncopies].name != OFC_NULL)
+		ncopies++ ;
+	    }
+	}
+      ofc_pipe_unlock () ;
+
+      if (copies == OFC_NULL)
+	{
+	  ofc_free (find) ;
+	  find = OFC_NULL ;
+	}
+      else
+	{
+	  /*
+	   * Fold the copies into a sorted array of names in place.  The
+	   * sorted names are never more than the copies looked at so far.
+	   */
+	  find->entries = copies ;
+	  find->count = 0 ;
+	  find->next = 0 ;
+	  for (i = 0 ; i < ncopies ; i++)
+	    {
+	      entry = &copies[i] ;
+	      lo = 0 ;
+	      hi = find->count ;
+	      cmp = 1 ;
+	      while (lo < hi && cmp != 0)
+		{
+		  mid = (lo + hi) / 2 ;
+		  cmp = pipe_name_compare (entry->name,
+					   find->entries[mid].name) ;
+		  if (cmp < 0)
+		    hi = mid ;
+		  else if (cmp > 0)
+		    lo = mid + 1 ;
+		  else
+		    lo = mid ;
+		}
+	      if (cmp == 0)
+		{
+		  find->entries[lo].instances++ ;
+		  find->entries[lo].listening += entry->listening ;
+		  ofc_free (entry->name) ;
+		}
+	      else
+		{
+		  copy = *entry ;
+		  for (mid = find->count ; mid > lo ; mid--)
+		    find->entries[mid] = find->entries[mid - 1] ;
+		  find->entries[lo] = copy ;
+		  find->count++ ;
+		}
+	    }
+	}
+    }
+
+  if (find == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+  return (find) ;
+}
+
+static OFC_VOID pipe_find_free (OFC_FS_PIPE_FIND *find)
+{
+  OFC_UINT i ;
+
+  for (i = 0 ; i < find->count ; i++)
+    ofc_free (find->entries[i].name) ;
+  ofc_free (find->entries) ;
+  ofc_free (find) ;
+}
+
+/*
+ * Return the next name of a listing.  Like a named pipe file system,
+ * the size of an entry is the number of instances of the name.
+ */
+static OFC_BOOL pipe_find_next (OFC_FS_PIPE_FIND *find,
+				OFC_LPWIN32_FIND_DATAW lpFindFileData,
+				OFC_BOOL *more)
+{
+  OFC_FS_PIPE_FIND_ENTRY *entry ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  if (find->next < find->count)
+    {
+      entry = &find->entries[find->next++] ;
+      ofc_memset (lpFindFileData, 0, sizeof (OFC_WIN32_FIND_DATAW)) ;
+      lpFindFileData->dwFileAttributes = OFC_FILE_ATTRIBUTE_NORMAL ;
+      lpFindFileData->nFileSizeLow = entry->instances ;
+      ofc_tstrncpy (lpFindFileData->cFileName, pipe_name_skip (entry->name),
+		    sizeof (lpFindFileData->cFileName) /
+		    sizeof (OFC_TCHAR) - 1) ;
+      ret = OFC_TRUE ;
+    }
+  else
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_NO_MORE_FILES) ;
+
+  if (more != OFC_NULL)
+    *more = (find->next < find->count) ;
+  return (ret) ;
+}
+
+OFC_HANDLE OfcFSPipeFindFirstFile (OFC_LPCTSTR lpFileName,
+				     OFC_LPWIN32_FIND_DATAW lpFindFileData,
+				     OFC_BOOL *more) 
+{
+  OFC_FS_PIPE_FIND *find ;
+  OFC_HANDLE ret ;
+
+  ret = OFC_HANDLE_NULL ;
+  find = pipe_find_snapshot (lpFileName) ;
+  if (find != OFC_NULL)
+    {
+      if (find->count == 0)
+	{
+	  pipe_find_free (find) ;
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) OFC_ERROR_FILE_NOT_FOUND) ;
+	}
+      else
+	{
+	  pipe_find_next (find, lpFindFileData, more) ;
+	  ret = ofc_handle_create (OFC_HANDLE_PIPE, find) ;
+	}
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeFindNextFile (OFC_HANDLE hFindFile,
+				  OFC_LPWIN32_FIND_DATAW lpFindFileData,
+				  OFC_BOOL *more) 
+{
+  OFC_FS_PIPE_FIND *find ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  find = ofc_handle_lock (hFindFile) ;
+  if (find == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else
+    {
+      ret = pipe_find_next (find, lpFindFileData, more) ;
+      ofc_handle_unlock (hFindFile) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeFindClose (OFC_HANDLE hFindFile) 
+{
+  OFC_FS_PIPE_FIND *find ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  find = ofc_handle_lock (hFindFile) ;
+  if (find == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else
+    {
+      ofc_handle_destroy (hFindFile) ;
+      ofc_handle_unlock (hFindFile) ;
+      pipe_find_free (find) ;
+      ret = OFC_TRUE ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeFlushFileBuffers (OFC_HANDLE hFile) 
+{
+  ofc_thread_set_variable (OfcLastError, 
+			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+
+  return (OFC_TRUE) ;
+}
+
+OFC_BOOL OfcFSPipeGetFileAttributesEx (OFC_LPCTSTR lpFileName,
+					 OFC_GET_FILEEX_INFO_LEVELS 
+					 fInfoLevelId,
+					 OFC_LPVOID lpFileInformation) 
+{
+  ofc_thread_set_variable (OfcLastError, 
+			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+
+  return (OFC_FALSE) ;
+}
+
+/*
+ * Fill in the local information of one end of a pipe.  Counting the
+ * instances of the name walks every open pipe so this is meant for
+ * occasional queries rather than the data path.
+ */
+static OFC_VOID pipe_local_info (OFC_FS_PIPE_HALF *half,
+				 OFC_FS_PIPE_LOCAL_INFO *info)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_FILE *instance ;
+  OFC_FS_PIPE_HALF *sibling ;
+
+  pipe_file = half->pipe_file ;
+
+  ofc_lock (pipes.lock) ;
+  info->current_instances = 0 ;
+  for (instance = pipes.first ; instance != OFC_NULL ;
+       instance = instance->next)
+    {
+      if (instance->hash == pipe_file->hash &&
+	  pipe_name_equal (instance->name, pipe_file->name))
+	info->current_instances++ ;
+    }
+  info->listening_instances =
+    pipe_listen_count (pipe_file->name, pipe_file->hash) ;
+
+  ofc_lock (pipe_file->lock) ;
+  info->server_end = (pipe_file->server == half) ;
+  info->read_mode = half->read_mode ;
+  if (info->server_end)
+    {
+      info->inbound_quota = pipe_file->config.in_buffer_size ;
+      info->outbound_quota = pipe_file->config.out_buffer_size ;
+    }
+  else
+    {
+      info->inbound_quota = pipe_file->config.out_buffer_size ;
+      info->outbound_quota = pipe_file->config.in_buffer_size ;
+    }
+
+  if (half->ring.buffer != OFC_NULL)
+    {
+      info->read_data_available = half->ring.count ;
+      info->read_messages = 0 ;
+    }
+  else
+    {
+      info->read_data_available = half->queued ;
+      info->read_messages = half->messages ;
+    }
+
+  sibling = half->sibling ;
+  info->write_quota_available = 0 ;
+  if (sibling != OFC_NULL && sibling->ring.buffer != OFC_NULL)
+    info->write_quota_available = sibling->ring.size - sibling->ring.count ;
+
+  if (!half->connected)
+    info->state = OFC_FS_PIPE_STATE_LISTENING ;
+  else if (sibling != OFC_NULL)
+    info->state = OFC_FS_PIPE_STATE_CONNECTED ;
+  else
+    info->state = OFC_FS_PIPE_STATE_CLOSING ;
+  ofc_unlock (pipe_file->lock) ;
+  ofc_unlock (pipes.lock) ;
+}
+
+OFC_BOOL OfcFSPipeGetFileInformationByHandleEx 
+(OFC_HANDLE hFile,
+ OFC_FILE_INFO_BY_HANDLE_CLASS FileInformationClass,
+ OFC_LPVOID lpFileInformation,
+ OFC_DWORD dwBufferSize) 
+{
+  OFC_BOOL ret ;
+  OFC_FS_PIPE_HALF *half ;
+
+  ret = OFC_FALSE ;
+
+  half = ofc_handle_lock (hFile) ;
+  if (half != OFC_NULL)
+    {
+      /*
+       * Pipe classes are outside the range of the generic enumeration
+       */
+      switch ((OFC_INT) FileInformationClass)
+	{
+	case OfcFSPipeModeInfo:
+	  if (dwBufferSize >= sizeof (OFC_FS_PIPE_MODE_INFO))
+	    {
+	      OFC_FS_PIPE_MODE_INFO *info ;
+
+	      info = lpFileInformation ;
+	      ofc_lock (half->pipe_file->lock) ;
+	      info->read_mode = half->read_mode ;
+	      ofc_unlock (half->pipe_file->lock) ;
+	      ret = OFC_TRUE ;
+	    }
+	  else
+	    ofc_thread_set_variable (OfcLastError, 
+				     (OFC_DWORD_PTR) 
+				     OFC_ERROR_INSUFFICIENT_BUFFER) ;
+	  break ;
+
+	case OfcFSPipeLocalInfo:
+	  if (!pipe_local_only (half))
+	    ;
+	  else if (dwBufferSize >= sizeof (OFC_FS_PIPE_LOCAL_INFO))
+	    {
+	      pipe_local_info (half, lpFileInformation) ;
+	      ret = OFC_TRUE ;
+	    }
+	  else
+	    ofc_thread_set_variable (OfcLastError, 
+				     (OFC_DWORD_PTR) 
+				     OFC_ERROR_INSUFFICIENT_BUFFER) ;
+	  break ;
+
+	case OfcFileStandardInfo:
+	  {
+	    OFC_FILE_STANDARD_INFO *info ;
+
+	    info = lpFileInformation ;
+#if defined(OFC_64BIT_INTEGER)
+	    info->AllocationSize = 0 ;
+	    info->EndOfFile = 0 ;
+#else
+	    info->AllocationSize.low = 0 ;
+	    info->AllocationSize.high = 0 ;
+	    info->EndOfFile.low = 0 ;
+	    info->EndOfFile.high = 0 ;
+#endif
+	    info->NumberOfLinks = 0 ;
+	    info->DeletePending = OFC_FALSE ;
+	    info->Directory = OFC_FALSE ;
+	    ret = OFC_TRUE ;
+	  }
+	  break ;
+	case OfcFileBasicInfo:
+	  {
+	    OFC_FILE_BASIC_INFO *info ;
+
+	    info = lpFileInformation ;
+#if defined(OFC_64BIT_INTEGER)
+	    info->CreationTime = 0 ;
+	    info->LastAccessTime = 0 ;
+	    info->LastWriteTime = 0 ;
+	    info->ChangeTime = 0 ;
+#else
+	    info->CreationTime.low = 0 ;
+	    info->CreationTime.high = 0 ;
+	    info->LastAccessTime.low = 0 ;
+	    info->LastAccessTime.high = 0 ;
+	    info->LastWriteTime.low = 0 ;
+	    info->LastWriteTime.high = 0 ;
+	    info->ChangeTime.low = 0 ;
+	    info->ChangeTime.high = 0 ;
+#endif
+	    info->FileAttributes = OFC_FILE_ATTRIBUTE_NORMAL ;
+	    ret = OFC_TRUE ;
+	  }
+	  break ;
+
+        case OfcFileEaInfo:
+          if (dwBufferSize >= sizeof(OFC_FILE_EA_INFO))
+            {
+              OFC_FILE_EA_INFO *lpFileEaInfo =
+                (OFC_FILE_EA_INFO *) lpFileInformation;
+              lpFileEaInfo->EaSize = 0;
+              ret = OFC_TRUE;
+            }
+          break;
+
+	default:
+	  ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) 
+				 OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+	  break ;
+	}
+      ofc_handle_unlock (hFile) ;
+    }
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeMoveFile (OFC_LPCTSTR lpExistingFileName,
+			      OFC_LPCTSTR lpNewFileName) 
+{
+  ofc_thread_set_variable (OfcLastError, 
+			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+
+  return (OFC_FALSE) ;
+}
+
+static OFC_HANDLE OfcFSPipeCreateOverlapped (OFC_VOID)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_HANDLE ret ;
+
+  ret = OFC_HANDLE_NULL ;
+  ov = ofc_malloc (sizeof (OFC_FS_PIPE_OVERLAPPED)) ;
+  if (ov == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+  else
+    {
+      ov->next = OFC_NULL ;
+      ov->hEvent = ofc_event_create (OFC_EVENT_MANUAL) ;
+      ov->offset = 0 ;
+      ov->half = OFC_NULL ;
+      ov->pipe_file = OFC_NULL ;
+      ov->buffer = OFC_NULL ;
+      ov->len = 0 ;
+      ov->transferred = 0 ;
+      ov->error = OFC_ERROR_SUCCESS ;
+      /*
+       * of_core has no handle type for pipe overlapped structures.  They
+       * share the pipe type, and only the pipe handler ever locks them.
+       */
+      ret = ofc_handle_create (OFC_HANDLE_PIPE, ov) ;
+    }
+
+  return (ret) ;
+}
+
+static OFC_VOID OfcFSPipeDestroyOverlapped (OFC_HANDLE hOverlapped)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+
+  ov = ofc_handle_lock (hOverlapped) ;
+  if (ov != OFC_NULL)
+    {
+      /*
+       * Destroying an overlapped structure cancels its operation.  The
+       * half may be closed and freed under its pipe lock at any time,
+       * so it is only looked at with that lock held.  Pipe files are
+       * freed under pipes.lock, which keeps the one the operation was
+       * begun on alive until we have its lock.
+       */
+      ofc_pipe_lock () ;
+      pipe_file = ov->pipe_file ;
+      if (ov->half != OFC_NULL && pipe_file != OFC_NULL)
+	{
+	  ofc_lock (pipe_file->lock) ;
+	  half = ov->half ;
+	  if (half != OFC_NULL && half->pipe_file == pipe_file)
+	    {
+	      pipe_ovq_unlink (&half->reads, ov) ;
+	      pipe_ovq_unlink (&half->writes, ov) ;
+	      pipe_ovq_unlink (&half->connects, ov) ;
+	      pipe_ovq_unlink (&half->calls, ov) ;
+	      ov->half = OFC_NULL ;
+	    }
+	  ofc_unlock (pipe_file->lock) ;
+	}
+      ofc_pipe_unlock () ;
+      ofc_event_destroy (ov->hEvent) ;
+      ofc_free (ov) ;
+      ofc_handle_destroy (hOverlapped) ;
+      ofc_handle_unlock (hOverlapped) ;
+    }
+}
+
+static OFC_VOID OfcFSPipeSetOverlappedOffset (OFC_HANDLE hOverlapped,
+						OFC_OFFT offset)
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+
+  ov = ofc_handle_lock (hOverlapped) ;
+  if (ov != OFC_NULL)
+    {
+      ov->offset = offset ;
+      ofc_handle_unlock (hOverlapped) ;
+    }
+}
+
+OFC_BOOL OfcFSPipeGetOverlappedResult (OFC_HANDLE hFile,
+					 OFC_HANDLE hOverlapped,
+					 OFC_LPDWORD 
+					 lpNumberOfBytesTransferred,
+					 OFC_BOOL bWait) 
+{
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  ov = ofc_handle_lock (hOverlapped) ;
+  if (ov == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else
+    {
+      if (bWait)
+	ofc_event_wait (ov->hEvent) ;
+
+      if (!ofc_event_test (ov->hEvent))
+	ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) OFC_ERROR_IO_INCOMPLETE) ;
+      else
+	{
+	  /*
+	   * Reads failing with OFC_ERROR_MORE_DATA still transferred data
+	   */
+	  if (lpNumberOfBytesTransferred != OFC_NULL)
+	    *lpNumberOfBytesTransferred = ov->transferred ;
+	  if (ov->error != OFC_ERROR_SUCCESS)
+	    ofc_thread_set_variable (OfcLastError, 
+				     (OFC_DWORD_PTR) ov->error) ;
+	  else
+	    ret = OFC_TRUE ;
+	}
+      ofc_handle_unlock (hOverlapped) ;
+    }
+
+  return (ret) ;
+}
+
+static OFC_BOOL pipe_connect_handle (OFC_HANDLE hPipe,
+				     OFC_HANDLE hOverlapped,
+				     OFC_DWORD dwMilliseconds)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  else if (half->shm != OFC_NULL)
+    {
+      ret = pipe_shm_accept_half (half, hOverlapped) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+#endif
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      if (pipe_ov_begin (pipe_file, hOverlapped, &ov))
+	{
+	  ret = pipe_connect_internal (half, ov,
+				       pipe_deadline (half, dwMilliseconds)) ;
+	  pipe_ov_end (hOverlapped, ov, ret) ;
+	}
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeConnect (OFC_HANDLE hPipe, OFC_HANDLE hOverlapped)
+{
+  return (pipe_connect_handle (hPipe, hOverlapped,
+			       OFC_FS_PIPE_WAIT_DEFAULT)) ;
+}
+
+OFC_BOOL OfcFSPipeConnectTimeout (OFC_HANDLE hPipe, OFC_DWORD dwMilliseconds)
+{
+  return (pipe_connect_handle (hPipe, OFC_HANDLE_NULL, dwMilliseconds)) ;
+}
+
+OFC_BOOL OfcFSPipeReadFileTimeout (OFC_HANDLE hPipe,
+				   OFC_LPVOID lpBuffer,
+				   OFC_DWORD nNumberOfBytesToRead,
+				   OFC_LPDWORD lpNumberOfBytesRead,
+				   OFC_DWORD dwMilliseconds)
+{
+  return (pipe_read_handle (hPipe, lpBuffer, nNumberOfBytesToRead,
+			    lpNumberOfBytesRead, OFC_HANDLE_NULL,
+			    dwMilliseconds)) ;
+}
+
+OFC_BOOL OfcFSPipeSetTimeout (OFC_HANDLE hPipe, OFC_DWORD dwMilliseconds)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (dwMilliseconds == OFC_FS_PIPE_WAIT_DEFAULT)
+    {
+      ofc_thread_set_variable (OfcLastError, 
+			       (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+  else
+    {
+      ofc_lock (half->pipe_file->lock) ;
+      half->timeout = dwMilliseconds ;
+      ofc_unlock (half->pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+      ret = OFC_TRUE ;
+    }
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeTransactPost (OFC_HANDLE hPipe,
+				OFC_HANDLE hOverlapped,
+				OFC_UINT32 id,
+				OFC_LPVOID lpInBuffer,
+				OFC_DWORD nInBufferSize,
+				OFC_LPVOID lpOutBuffer,
+				OFC_DWORD nOutBufferSize)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      if (!pipe_ov_begin (pipe_file, hOverlapped, &ov))
+	;
+      else if (ov == OFC_NULL)
+	ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+      else
+	{
+	  ret = pipe_post_internal (half, ov, id, lpInBuffer, nInBufferSize,
+				    lpOutBuffer, nOutBufferSize) ;
+	  pipe_ov_end (hOverlapped, ov, ret) ;
+	}
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeReadRequest (OFC_HANDLE hPipe,
+			       OFC_LPVOID lpBuffer,
+			       OFC_DWORD nNumberOfBytesToRead,
+			       OFC_LPDWORD lpNumberOfBytesRead,
+			       OFC_UINT32 *lpId)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_DWORD nBytes ;
+  OFC_UINT32 id ;
+  OFC_BOOL ret ;
+  OFC_MSTIME deadline ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      deadline = pipe_deadline (half, OFC_FS_PIPE_WAIT_DEFAULT) ;
+      ret = pipe_read_request_internal (half, lpBuffer, nNumberOfBytesToRead,
+					&nBytes, &id, deadline) ;
+      if (lpNumberOfBytesRead != OFC_NULL)
+	*lpNumberOfBytesRead = nBytes ;
+      if (lpId != OFC_NULL)
+	*lpId = id ;
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeWriteReply (OFC_HANDLE hPipe,
+			      OFC_UINT32 id,
+			      OFC_LPVOID lpBuffer,
+			      OFC_DWORD nNumberOfBytesToWrite)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      ret = pipe_write_reply_internal (half, id, lpBuffer,
+				       nNumberOfBytesToWrite) ;
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_LPVOID OfcFSPipeAcquire (OFC_HANDLE hPipe, OFC_DWORD nBytes)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_LPVOID buffer ;
+
+  buffer = OFC_NULL ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      data = pipe_data_alloc (pipe_file, nBytes) ;
+      if (data == OFC_NULL)
+	ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      else
+	{
+	  data->free_next = half->acquired ;
+	  half->acquired = data ;
+	  buffer = data->buffer ;
+	}
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (buffer) ;
+}
+
+OFC_BOOL OfcFSPipeCommit (OFC_HANDLE hPipe, OFC_LPVOID lpBuffer,
+			  OFC_DWORD nBytes)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_DATA **prev ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_DWORD nWritten ;
+  OFC_BOOL ret ;
+  OFC_MSTIME deadline ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      prev = pipe_loan_find (&half->acquired, lpBuffer) ;
+      if (prev == OFC_NULL || nBytes > (*prev)->len)
+	ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+      else
+	{
+	  data = *prev ;
+	  *prev = data->free_next ;
+	  data->free_next = OFC_NULL ;
+	  data->len = nBytes ;
+
+	  if (nBytes == 0)
+	    {
+	      pipe_data_free (pipe_file, data) ;
+	      ret = OFC_TRUE ;
+	    }
+	  else if (half->sibling == OFC_NULL)
+	    {
+	      pipe_data_free (pipe_file, data) ;
+	      ofc_thread_set_variable (OfcLastError, 
+				       (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	    }
+	  else if (half->sibling->ring.buffer == OFC_NULL)
+	    {
+	      /*
+	       * The buffer is queued to the reader as it stands
+	       */
+	      pipe_queue_data (half->sibling, data) ;
+	      pipe_service_overlapped (pipe_file) ;
+	      ret = OFC_TRUE ;
+	    }
+	  else
+	    {
+	      /*
+	       * A bounded pipe holds bytes rather than messages so the
+	       * buffer is written into the ring like any other
+	       */
+	      deadline = pipe_deadline (half, OFC_FS_PIPE_WAIT_DEFAULT) ;
+	      ret = pipe_write_internal (half, data->buffer, nBytes,
+					 &nWritten, OFC_NULL, deadline) ;
+	      pipe_data_free (pipe_file, data) ;
+	    }
+	}
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_LPVOID OfcFSPipeBorrow (OFC_HANDLE hPipe, OFC_LPDWORD lpNumberOfBytes)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_LPVOID buffer ;
+
+  buffer = OFC_NULL ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      data = pipe_borrow_internal (half,
+				   pipe_deadline (half,
+						  OFC_FS_PIPE_WAIT_DEFAULT)) ;
+      if (data != OFC_NULL)
+	{
+	  buffer = data->buffer + data->offset ;
+	  if (lpNumberOfBytes != OFC_NULL)
+	    *lpNumberOfBytes = data->len ;
+	}
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (buffer) ;
+}
+
+OFC_BOOL OfcFSPipeRelease (OFC_HANDLE hPipe, OFC_LPVOID lpBuffer)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_DATA **prev ;
+  OFC_FS_PIPE_DATA *data ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      prev = pipe_loan_find (&half->borrowed, lpBuffer) ;
+      if (prev == OFC_NULL)
+	ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+      else
+	{
+	  data = *prev ;
+	  *prev = data->free_next ;
+	  pipe_data_free (pipe_file, data) ;
+	  ret = OFC_TRUE ;
+	}
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipePeek (OFC_HANDLE hPipe,
+			OFC_LPVOID lpBuffer,
+			OFC_DWORD nBufferSize,
+			OFC_LPDWORD lpBytesRead,
+			OFC_LPDWORD lpTotalBytesAvail,
+			OFC_LPDWORD lpBytesLeftThisMessage)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_DWORD nBytes ;
+  OFC_DWORD avail ;
+  OFC_DWORD left ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      nBytes = pipe_peek_internal (half, lpBuffer, nBufferSize,
+				   &avail, &left) ;
+      /*
+       * Data left behind by a closed sibling can still be read
+       */
+      if (avail == 0 && half->connected && half->sibling == OFC_NULL)
+	ofc_thread_set_variable (OfcLastError, 
+				 (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+      else
+	{
+	  if (lpBytesRead != OFC_NULL)
+	    *lpBytesRead = nBytes ;
+	  if (lpTotalBytesAvail != OFC_NULL)
+	    *lpTotalBytesAvail = avail ;
+	  if (lpBytesLeftThisMessage != OFC_NULL)
+	    *lpBytesLeftThisMessage = left ;
+	  ret = OFC_TRUE ;
+	}
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeWriteFileGather (OFC_HANDLE hPipe,
+				   const OFC_FS_PIPE_SEGMENT *segments,
+				   OFC_DWORD count,
+				   OFC_LPDWORD lpNumberOfBytesWritten)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_DWORD nBytes ;
+  OFC_BOOL ret ;
+  OFC_MSTIME deadline ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      deadline = pipe_deadline (half, OFC_FS_PIPE_WAIT_DEFAULT) ;
+      ret = pipe_write_gather_internal (half, segments, count, &nBytes,
+					deadline) ;
+      if (lpNumberOfBytesWritten != OFC_NULL)
+	*lpNumberOfBytesWritten = nBytes ;
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeReadFileScatter (OFC_HANDLE hPipe,
+				   const OFC_FS_PIPE_SEGMENT *segments,
+				   OFC_DWORD count,
+				   OFC_LPDWORD lpNumberOfBytesRead)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_DWORD nBytes ;
+  OFC_BOOL ret ;
+  OFC_MSTIME deadline ;
+
+  ret = OFC_FALSE ;
+  half = ofc_handle_lock (hPipe) ;
+  if (half == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (!pipe_local_only (half))
+    ofc_handle_unlock (hPipe) ;
+  else if (count == 0)
+    {
+      ofc_thread_set_variable (OfcLastError, 
+			       (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+  else
+    {
+      pipe_file = half->pipe_file ;
+      ofc_lock (pipe_file->lock) ;
+      deadline = pipe_deadline (half, OFC_FS_PIPE_WAIT_DEFAULT) ;
+      ret = pipe_read_scatter_internal (half, segments, count, &nBytes,
+					deadline) ;
+      if (lpNumberOfBytesRead != OFC_NULL)
+	*lpNumberOfBytesRead = nBytes ;
+      ofc_unlock (pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Conditions that hold on a half.  Called with the pipe lock held.
+ */
+static OFC_DWORD pipe_ready_events (OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_HALF *sibling ;
+  OFC_DWORD events ;
+
+  events = 0 ;
+  sibling = half->sibling ;
+  if (half->messages > 0 || half->ring.count > 0)
+    events |= OFC_FS_PIPE_READABLE ;
+  if (sibling != OFC_NULL)
+    {
+      events |= OFC_FS_PIPE_CONNECTED ;
+      if (sibling->ring.buffer == OFC_NULL ||
+	  sibling->ring.count < sibling->ring.size)
+	events |= OFC_FS_PIPE_WRITABLE ;
+    }
+  else if (half->connected)
+    events |= OFC_FS_PIPE_BROKEN ;
+  return (events) ;
+}
+
+static OFC_FS_PIPE_WATCH *pipe_watch_find (OFC_FS_PIPE_WAITSET *waitset,
+					   OFC_HANDLE hPipe)
+{
+  OFC_FS_PIPE_WATCH *watch ;
+
+  for (watch = waitset->members ;
+       watch != OFC_NULL && watch->hPipe != hPipe ;
+       watch = watch->next) ;
+  return (watch) ;
+}
+
+/*
+ * Take a member out of its set.  It is freed straight away unless
+ * someone is waiting on the set.  Called with the set lock held and,
+ * if the half still exists, its pipe lock.
+ */
+static OFC_VOID pipe_watch_remove (OFC_FS_PIPE_WATCH *watch,
+				   OFC_FS_PIPE_HALF *half)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_FS_PIPE_WATCH **prev ;
+  OFC_FS_PIPE_WATCH *last ;
+
+  waitset = watch->waitset ;
+  if (half != OFC_NULL)
+    {
+      for (prev = &half->watches ; *prev != OFC_NULL && *prev != watch ;
+	   prev = &(*prev)->half_next) ;
+      if (*prev != OFC_NULL)
+	*prev = watch->half_next ;
+    }
+
+  for (prev = &waitset->members ; *prev != watch ; prev = &(*prev)->next) ;
+  *prev = watch->next ;
+
+  if (watch->queued)
+    {
+      last = OFC_NULL ;
+      for (prev = &waitset->ready_first ; *prev != watch ;
+	   prev = &(*prev)->ready_next)
+	last = *prev ;
+      *prev = watch->ready_next ;
+      if (waitset->ready_last == watch)
+	waitset->ready_last = last ;
+      watch->queued = OFC_FALSE ;
+    }
+
+  watch->removed = OFC_TRUE ;
+  if (waitset->waiters > 0)
+    {
+      watch->next = waitset->removed ;
+      waitset->removed = watch ;
+    }
+  else
+    ofc_free (watch) ;
+}
+
+static OFC_BOOL pipe_waitset_remove (OFC_FS_PIPE_WAITSET *waitset,
+				     OFC_HANDLE hPipe)
+{
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_WATCH *watch ;
+
+  /*
+   * The handle may already be closed, in which case the half has
+   * dropped its watchers
+   */
+  half = ofc_handle_lock (hPipe) ;
+  if (half != OFC_NULL)
+    ofc_lock (half->pipe_file->lock) ;
+  ofc_lock (waitset->lock) ;
+  watch = pipe_watch_find (waitset, hPipe) ;
+  if (watch != OFC_NULL)
+    pipe_watch_remove (watch, half) ;
+  ofc_unlock (waitset->lock) ;
+  if (half != OFC_NULL)
+    {
+      ofc_unlock (half->pipe_file->lock) ;
+      ofc_handle_unlock (hPipe) ;
+    }
+
+  if (watch == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+  return (watch != OFC_NULL) ;
+}
+
+OFC_HANDLE OfcFSPipeCreateWaitSet (OFC_VOID)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_HANDLE ret ;
+
+  ret = OFC_HANDLE_NULL ;
+  waitset = ofc_malloc (sizeof (OFC_FS_PIPE_WAITSET)) ;
+  if (waitset == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+  else
+    {
+      waitset->lock = ofc_lock_init () ;
+      waitset->hEvent = ofc_event_create (OFC_EVENT_AUTO) ;
+      waitset->members = OFC_NULL ;
+      waitset->ready_first = OFC_NULL ;
+      waitset->ready_last = OFC_NULL ;
+      waitset->removed = OFC_NULL ;
+      waitset->waiters = 0 ;
+      waitset->pass = 0 ;
+      waitset->interrupted = OFC_FALSE ;
+      ofc_memset (&waitset->timed, 0, sizeof (OFC_FS_PIPE_TIMED)) ;
+      ret = ofc_handle_create (OFC_HANDLE_PIPE, waitset) ;
+    }
+  return (ret) ;
+}
+
+OFC_VOID OfcFSPipeDestroyWaitSet (OFC_HANDLE hWaitSet)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_FS_PIPE_WATCH *watch ;
+  OFC_HANDLE hPipe ;
+  OFC_BOOL done ;
+
+  waitset = ofc_handle_lock (hWaitSet) ;
+  if (waitset != OFC_NULL)
+    {
+      for (done = OFC_FALSE ; !done ; )
+	{
+	  hPipe = OFC_HANDLE_NULL ;
+	  ofc_lock (waitset->lock) ;
+	  watch = waitset->members ;
+	  done = watch == OFC_NULL ;
+	  if (watch != OFC_NULL)
+	    {
+	      /* Members whose handle has closed have no half to unlink */
+	      if (watch->hPipe == OFC_HANDLE_NULL)
+		pipe_watch_remove (watch, OFC_NULL) ;
+	      else
+		hPipe = watch->hPipe ;
+	    }
+	  ofc_unlock (waitset->lock) ;
+	  if (hPipe != OFC_HANDLE_NULL)
+	    pipe_waitset_remove (waitset, hPipe) ;
+	}
+
+      for (watch = waitset->removed ; watch != OFC_NULL ;
+	   watch = waitset->removed)
+	{
+	  waitset->removed = watch->next ;
+	  ofc_free (watch) ;
+	}
+      pipe_timed_destroy (&waitset->timed) ;
+      ofc_event_destroy (waitset->hEvent) ;
+      ofc_lock_destroy (waitset->lock) ;
+      ofc_free (waitset) ;
+      ofc_handle_destroy (hWaitSet) ;
+      ofc_handle_unlock (hWaitSet) ;
+    }
+}
+
+OFC_BOOL OfcFSPipeWaitSetAdd (OFC_HANDLE hWaitSet, OFC_HANDLE hPipe,
+			      OFC_DWORD dwEvents, OFC_VOID *context)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_WATCH *watch ;
+  OFC_FS_PIPE_WATCH *fresh ;
+  OFC_BOOL signal ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  waitset = ofc_handle_lock (hWaitSet) ;
+  if (waitset == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else
+    {
+      half = ofc_handle_lock (hPipe) ;
+      fresh = ofc_malloc (sizeof (OFC_FS_PIPE_WATCH)) ;
+      if (half == OFC_NULL)
+	ofc_thread_set_variable (OfcLastError,
+				 (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+      else if (half->shm != OFC_NULL)
+	ofc_thread_set_variable (OfcLastError,
+				 (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+#endif
+      else if (fresh == OFC_NULL)
+	ofc_thread_set_variable (OfcLastError,
+				 (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      else
+	{
+	  ofc_lock (half->pipe_file->lock) ;
+	  ofc_lock (waitset->lock) ;
+	  watch = pipe_watch_find (waitset, hPipe) ;
+	  if (watch == OFC_NULL)
+	    {
+	      watch = fresh ;
+	      fresh = OFC_NULL ;
+	      watch->waitset = waitset ;
+	      watch->hPipe = hPipe ;
+	      watch->pass = 0 ;
+	      watch->queued = OFC_FALSE ;
+	      watch->removed = OFC_FALSE ;
+	      watch->next = waitset->members ;
+	      waitset->members = watch ;
+	      watch->half_next = half->watches ;
+	      half->watches = watch ;
+	    }
+	  watch->events = dwEvents ;
+	  watch->context = context ;
+	  /*
+	   * Whatever already holds is found by the next wait
+	   */
+	  signal = pipe_watch_queue (watch) ;
+	  ofc_unlock (waitset->lock) ;
+	  ofc_unlock (half->pipe_file->lock) ;
+	  if (signal)
+	    ofc_event_set (waitset->hEvent) ;
+	  ret = OFC_TRUE ;
+	}
+      if (fresh != OFC_NULL)
+	ofc_free (fresh) ;
+      if (half != OFC_NULL)
+	ofc_handle_unlock (hPipe) ;
+      ofc_handle_unlock (hWaitSet) ;
+    }
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeWaitSetRemove (OFC_HANDLE hWaitSet, OFC_HANDLE hPipe)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  waitset = ofc_handle_lock (hWaitSet) ;
+  if (waitset == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else
+    {
+      ret = pipe_waitset_remove (waitset, hPipe) ;
+      ofc_handle_unlock (hWaitSet) ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Look once at each queued member.  A member found ready is queued
+ * again since with level triggering it stays ready until the caller
+ * acts on it, and the pass ends when it comes round again.  One found
+ * not ready drops off until its half wakes it.
+ */
+static OFC_DWORD pipe_waitset_pass (OFC_FS_PIPE_WAITSET *waitset,
+				    OFC_FS_PIPE_READY *lpReady,
+				    OFC_DWORD nCount)
+{
+  OFC_FS_PIPE_WATCH *watch ;
+  OFC_FS_PIPE_HALF *half ;
+  OFC_HANDLE hPipe ;
+  OFC_DWORD events ;
+  OFC_DWORD n ;
+  OFC_UINT pass ;
+
+  n = 0 ;
+  ofc_lock (waitset->lock) ;
+  pass = ++waitset->pass ;
+  for (watch = waitset->ready_first ;
+       watch != OFC_NULL && watch->pass != pass && n < nCount ;
+       watch = waitset->ready_first)
+    {
+      waitset->ready_first = watch->ready_next ;
+      if (waitset->ready_first == OFC_NULL)
+	waitset->ready_last = OFC_NULL ;
+      watch->queued = OFC_FALSE ;
+      watch->pass = pass ;
+      hPipe = watch->hPipe ;
+      ofc_unlock (waitset->lock) ;
+
+      events = 0 ;
+      half = ofc_handle_lock (hPipe) ;
+      if (half != OFC_NULL)
+	{
+	  ofc_lock (half->pipe_file->lock) ;
+	  events = pipe_ready_events (half) ;
+	  ofc_unlock (half->pipe_file->lock) ;
+	  ofc_handle_unlock (hPipe) ;
+	}
+
+      ofc_lock (waitset->lock) ;
+      if (half == OFC_NULL)
+	{
+	  /* Closed.  Its half has already let go of it. */
+	  if (!watch->removed)
+	    pipe_watch_remove (watch, OFC_NULL) ;
+	}
+      else if (!watch->removed && (events & watch->events) != 0)
+	{
+	  lpReady[n].hPipe = hPipe ;
+	  lpReady[n].events = events & watch->events ;
+	  lpReady[n].context = watch->context ;
+	  n++ ;
+	  pipe_watch_queue (watch) ;
+	}
+    }
+  ofc_unlock (waitset->lock) ;
+  return (n) ;
+}
+
+OFC_BOOL OfcFSPipeWaitSetWait (OFC_HANDLE hWaitSet,
+			       OFC_FS_PIPE_READY *lpReady,
+			       OFC_DWORD nCount,
+			       OFC_LPDWORD lpReadyCount,
+			       OFC_DWORD dwMilliseconds)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+  OFC_FS_PIPE_WATCH *removed ;
+  OFC_FS_PIPE_WATCH *watch ;
+  OFC_FS_PIPE_TIMED *timed ;
+  OFC_MSTIME deadline ;
+  OFC_DWORD wait_error ;
+  OFC_DWORD n ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  n = 0 ;
+  waitset = ofc_handle_lock (hWaitSet) ;
+  if (waitset == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+  else if (lpReady == OFC_NULL || nCount == 0)
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+      ofc_handle_unlock (hWaitSet) ;
+    }
+  else
+    {
+      timed = OFC_NULL ;
+      ofc_lock (waitset->lock) ;
+      waitset->waiters++ ;
+      if (!waitset->timed.busy)
+	{
+	  waitset->timed.busy = OFC_TRUE ;
+	  timed = &waitset->timed ;
+	}
+      ofc_unlock (waitset->lock) ;
+
+      deadline = 0 ;
+      if (dwMilliseconds != OFC_INFINITE)
+	deadline = ofc_time_get_now () + dwMilliseconds ;
+      /*
+       * A wait that times out still looks once more, for what became
+       * ready as it gave up
+       */
+      wait_error = OFC_ERROR_SUCCESS ;
+      for (n = pipe_waitset_pass (waitset, lpReady, nCount) ;
+	   n == 0 && wait_error == OFC_ERROR_SUCCESS &&
+	     !waitset->interrupted ;
+	   n = pipe_waitset_pass (waitset, lpReady, nCount))
+	wait_error = pipe_event_wait (waitset->hEvent, timed, deadline) ;
+
+      removed = OFC_NULL ;
+      ofc_lock (waitset->lock) ;
+      waitset->waiters-- ;
+      if (timed != OFC_NULL)
+	timed->busy = OFC_FALSE ;
+      if (waitset->waiters == 0)
+	{
+	  removed = waitset->removed ;
+	  waitset->removed = OFC_NULL ;
+	}
+      ofc_unlock (waitset->lock) ;
+      for (watch = removed ; watch != OFC_NULL ; watch = removed)
+	{
+	  removed = watch->next ;
+	  ofc_free (watch) ;
+	}
+      ofc_handle_unlock (hWaitSet) ;
+      /*
+       * Running out of time is not a failure, only of nothing ready
+       */
+      if (n == 0 && wait_error != OFC_ERROR_SUCCESS &&
+	  wait_error != OFC_ERROR_SEM_TIMEOUT)
+	ofc_thread_set_variable (OfcLastError,
+				 (OFC_DWORD_PTR) wait_error) ;
+      else
+	ret = OFC_TRUE ;
+    }
+
+  if (lpReadyCount != OFC_NULL)
+    *lpReadyCount = n ;
+  return (ret) ;
+}
+
+/*
+ * Release whoever is waiting on a set, and anyone who waits on it
+ * later, even though nothing is ready
+ */
+static OFC_VOID pipe_waitset_interrupt (OFC_HANDLE hWaitSet)
+{
+  OFC_FS_PIPE_WAITSET *waitset ;
+
+  waitset = ofc_handle_lock (hWaitSet) ;
+  if (waitset != OFC_NULL)
+    {
+      waitset->interrupted = OFC_TRUE ;
+      ofc_event_set (waitset->hEvent) ;
+      ofc_handle_unlock (hWaitSet) ;
+    }
+}
+
+/*
+ * Pipe Services
+ *
+ * A service owns the listening instances of a name and a fixed set of
+ * workers.  Every instance, listening or connected, is in one wait
+ * set.  Whichever worker runs out of work first becomes the poller: it
+ * waits on the set, disarms what comes back so no one else is handed
+ * it, and pushes it on its own deque.  It then wakes an idle worker
+ * which either steals from that deque or takes over polling.
+ *
+ * A worker pops its own deque from the bottom so the connection it
+ * just saw ready is handled while still warm, and steals from the top
+ * of the others.  A connection is only ever on one deque and handled
+ * by one worker at a time, and is armed again once its request has
+ * been answered.
+ *
+ * A listening instance that can't be replaced when its client arrives
+ * is owed.  The poller tries again each time it polls, and polls with
+ * a timeout while any are owed.
+ */
+#define OFC_FS_PIPE_DEQUE_SIZE 64
+#define OFC_FS_PIPE_SERVICE_BATCH 32
+#define OFC_FS_PIPE_SERVICE_REQUEST 4096
+#define OFC_FS_PIPE_SERVICE_RETRY 1000
+
+typedef struct _OFC_FS_PIPE_CONNECTION
+{
+  struct _OFC_FS_PIPE_CONNECTION *next ;
+  struct _OFC_FS_PIPE_CONNECTION *prev ;
+  OFC_HANDLE hPipe ;
+  /* Still waiting for a client */
+  OFC_BOOL listening ;
+  /* What the poller found ready */
+  OFC_DWORD events ;
+} OFC_FS_PIPE_CONNECTION ;
+
+/*
+ * The owner pushes and pops at bottom, thieves take from top.  Must
+ * hold at least a batch.
+ */
+typedef struct
+{
+  OFC_LOCK lock ;
+  OFC_UINT top ;
+  OFC_UINT bottom ;
+  OFC_FS_PIPE_CONNECTION *tasks[OFC_FS_PIPE_DEQUE_SIZE] ;
+} OFC_FS_PIPE_DEQUE ;
+
+typedef struct
+{
+  struct _OFC_FS_PIPE_SERVICE *service ;
+  OFC_HANDLE hThread ;
+  OFC_UINT index ;
+  OFC_FS_PIPE_DEQUE deque ;
+  /* Grown to the largest request seen */
+  OFC_CHAR *request ;
+  OFC_DWORD request_size ;
+  OFC_CHAR *reply ;
+  OFC_FS_PIPE_READY ready[OFC_FS_PIPE_SERVICE_BATCH] ;
+} OFC_FS_PIPE_SERVICE_WORKER ;
+
+/*
+ * The lock guards the connection list, the poller flag and the count
+ * of listening instances owed.
+ */
+typedef struct _OFC_FS_PIPE_SERVICE
+{
+  OFC_LOCK lock ;
+  OFC_TCHAR *name ;
+  OFC_FS_PIPE_SERVICE_HANDLER handler ;
+  OFC_VOID *context ;
+  OFC_HANDLE hWaitSet ;
+  /* Idle workers wait here for work to steal or to poll */
+  OFC_HANDLE hIdle ;
+  OFC_FS_PIPE_CONNECTION *connections ;
+  OFC_BOOL polling ;
+  OFC_UINT owed ;
+  volatile OFC_BOOL stopping ;
+  OFC_UINT count ;
+  OFC_FS_PIPE_SERVICE_WORKER *workers ;
+} OFC_FS_PIPE_SERVICE ;
+
+static OFC_BOOL pipe_deque_push (OFC_FS_PIPE_DEQUE *deque,
+				 OFC_FS_PIPE_CONNECTION *connection)
+{
+  OFC_BOOL ret ;
+
+  ofc_lock (deque->lock) ;
+  ret = deque->bottom - deque->top < OFC_FS_PIPE_DEQUE_SIZE ;
+  if (ret)
+    {
+      deque->tasks[deque->bottom % OFC_FS_PIPE_DEQUE_SIZE] = connection ;
+      deque->bottom++ ;
+    }
+  ofc_unlock (deque->lock) ;
+  return (ret) ;
+}
+
+static OFC_FS_PIPE_CONNECTION *pipe_deque_pop (OFC_FS_PIPE_DEQUE *deque)
+{
+  OFC_FS_PIPE_CONNECTION *connection ;
+
+  connection = OFC_NULL ;
+  ofc_lock (deque->lock) ;
+  if (deque->bottom != deque->top)
+    {
+      deque->bottom-- ;
+      connection = deque->tasks[deque->bottom % OFC_FS_PIPE_DEQUE_SIZE] ;
+    }
+  ofc_unlock (deque->lock) ;
+  return (connection) ;
+}
+
+/*
+ * Take from the top of a deque if take is set.  A thief gives up on a
+ * deque that is busy rather than queue behind its owner.  *more is set
+ * if the deque still has work, and otherwise left alone.
+ */
+static OFC_FS_PIPE_CONNECTION *pipe_deque_steal (OFC_FS_PIPE_DEQUE *deque,
+						 OFC_BOOL take,
+						 OFC_BOOL *more)
+{
+  OFC_FS_PIPE_CONNECTION *connection ;
+
+  connection = OFC_NULL ;
+  if (ofc_trylock (deque->lock))
+    {
+      if (take && deque->bottom != deque->top)
+	{
+	  connection = deque->tasks[deque->top % OFC_FS_PIPE_DEQUE_SIZE] ;
+	  deque->top++ ;
+	}
+      if (deque->bottom != deque->top)
+	*more = OFC_TRUE ;
+      ofc_unlock (deque->lock) ;
+    }
+  return (connection) ;
+}
+
+/*
+ * Create a listening instance and wait for its client
+ */
+static OFC_BOOL pipe_dispatch_listen (OFC_FS_PIPE_SERVICE *service)
+{
+  OFC_FS_PIPE_CONNECTION *connection ;
+  OFC_HANDLE hPipe ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  connection = ofc_malloc (sizeof (OFC_FS_PIPE_CONNECTION)) ;
+  if (connection == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+  else
+    {
+      hPipe = OfcFSPipeCreateFile (service->name,
+				   OFC_GENERIC_READ | OFC_GENERIC_WRITE,
+				   OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+				   OFC_NULL, OFC_CREATE_ALWAYS,
+				   OFC_FILE_FLAG_OVERLAPPED,
+				   OFC_HANDLE_NULL) ;
+      if (hPipe == OFC_HANDLE_NULL)
+	ofc_free (connection) ;
+      else
+	{
+	  connection->hPipe = hPipe ;
+	  connection->listening = OFC_TRUE ;
+	  connection->events = 0 ;
+	  ofc_lock (service->lock) ;
+	  connection->prev = OFC_NULL ;
+	  connection->next = service->connections ;
+	  if (service->connections != OFC_NULL)
+	    service->connections->prev = connection ;
+	  service->connections = connection ;
+	  ofc_unlock (service->lock) ;
+
+	  ret = OfcFSPipeWaitSetAdd (service->hWaitSet, hPipe,
+				     OFC_FS_PIPE_CONNECTED |
+				     OFC_FS_PIPE_BROKEN,
+				     connection) ;
+	}
+    }
+  return (ret) ;
+}
+
+/*
+ * Closing the instance takes it out of the wait set
+ */
+static OFC_VOID pipe_dispatch_close (OFC_FS_PIPE_SERVICE *service,
+				     OFC_FS_PIPE_CONNECTION *connection)
+{
+  ofc_lock (service->lock) ;
+  if (connection->prev == OFC_NULL)
+    service->connections = connection->next ;
+  else
+    connection->prev->next = connection->next ;
+  if (connection->next != OFC_NULL)
+    connection->next->prev = connection->prev ;
+  ofc_unlock (service->lock) ;
+
+  OfcFSPipeCloseHandle (connection->hPipe) ;
+  ofc_free (connection) ;
+}
+
+/*
+ * Read one request, hand it to the handler and write back its reply.
+ * OFC_FALSE if the connection should be closed.
+ */
+static OFC_BOOL pipe_dispatch_request (OFC_FS_PIPE_SERVICE_WORKER *worker,
+				       OFC_FS_PIPE_CONNECTION *connection)
+{
+  OFC_FS_PIPE_SERVICE *service ;
+  OFC_CHAR *grown ;
+  OFC_DWORD len ;
+  OFC_DWORD nBytes ;
+  OFC_DWORD reply_len ;
+  OFC_BOOL more ;
+  OFC_BOOL ret ;
+
+  service = worker->service ;
+  ret = OFC_FALSE ;
+  len = 0 ;
+  /*
+   * A message larger than the buffer is read in pieces while the
+   * buffer grows to fit it
+   */
+  for (more = OFC_TRUE ; more ; )
+    {
+      more = OFC_FALSE ;
+      if (len == worker->request_size)
+	{
+	  grown = ofc_realloc (worker->request, worker->request_size * 2) ;
+	  if (grown == OFC_NULL)
+	    break ;
+	  worker->request = grown ;
+	  worker->request_size *= 2 ;
+	}
+      nBytes = 0 ;
+      ret = OfcFSPipeReadFile (connection->hPipe, worker->request + len,
+			       worker->request_size - len, &nBytes,
+			       OFC_HANDLE_NULL) ;
+      len += nBytes ;
+      if (!ret)
+	more = (OFC_DWORD) ofc_thread_get_variable (OfcLastError) ==
+	  OFC_ERROR_MORE_DATA ;
+    }
+
+  if (ret)
+    {
+      reply_len = 0 ;
+      ret = (*service->handler) (service->context, worker->request, len,
+				 worker->reply,
+				 OFC_FS_PIPE_SERVICE_REPLY_MAX,
+				 &reply_len) ;
+      /*
+       * A reply longer than the buffer can't have been written whole.
+       * The client would rather lose the connection than get part.
+       */
+      if (ret && reply_len > OFC_FS_PIPE_SERVICE_REPLY_MAX)
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR)
+				   OFC_ERROR_INSUFFICIENT_BUFFER) ;
+	  ret = OFC_FALSE ;
+	}
+      else if (ret && reply_len > 0)
+	ret = OfcFSPipeWriteFile (connection->hPipe, worker->reply,
+				  reply_len, &nBytes, OFC_HANDLE_NULL) ;
+    }
+  return (ret) ;
+}
+
+static OFC_VOID pipe_dispatch (OFC_FS_PIPE_SERVICE_WORKER *worker,
+			       OFC_FS_PIPE_CONNECTION *connection)
+{
+  OFC_FS_PIPE_SERVICE *service ;
+  OFC_BOOL keep ;
+
+  service = worker->service ;
+  if (connection->listening)
+    {
+      /*
+       * Put another instance up for the next client before serving
+       * this one
+       */
+      connection->listening = OFC_FALSE ;
+      if (!pipe_dispatch_listen (service))
+	{
+	  ofc_log (OFC_LOG_WARN,
+		   "Pipe service couldn't replace a listening instance, "
+		   "error %lu.  Retrying\n",
+		   (unsigned long) ofc_thread_get_variable (OfcLastError)) ;
+	  ofc_lock (service->lock) ;
+	  service->owed++ ;
+	  ofc_unlock (service->lock) ;
+	}
+    }
+
+  keep = OFC_TRUE ;
+  if (connection->events & OFC_FS_PIPE_READABLE)
+    keep = pipe_dispatch_request (worker, connection) ;
+  else if (connection->events & OFC_FS_PIPE_BROKEN)
+    keep = OFC_FALSE ;
+
+  /*
+   * Requests already queued behind this one bring it straight back
+   */
+  if (keep)
+    keep = OfcFSPipeWaitSetAdd (service->hWaitSet, connection->hPipe,
+				OFC_FS_PIPE_READABLE | OFC_FS_PIPE_BROKEN,
+				connection) ;
+  if (!keep)
+    pipe_dispatch_close (service, connection) ;
+}
+
+static OFC_FS_PIPE_CONNECTION *
+pipe_dispatch_steal (OFC_FS_PIPE_SERVICE_WORKER *worker)
+{
+  OFC_FS_PIPE_SERVICE *service ;
+  OFC_FS_PIPE_CONNECTION *connection ;
+  OFC_FS_PIPE_DEQUE *deque ;
+  OFC_UINT i ;
+  OFC_BOOL more ;
+
+  service = worker->service ;
+  connection = OFC_NULL ;
+  more = OFC_FALSE ;
+  /*
+   * Once we have one, the rest are only looked at for more work
+   */
+  for (i = 1 ; i < service->count && !more ; i++)
+    {
+      deque = &service->workers[(worker->index + i) % service->count].deque ;
+      if (connection == OFC_NULL)
+	connection = pipe_deque_steal (deque, OFC_TRUE, &more) ;
+      else
+	pipe_deque_steal (deque, OFC_FALSE, &more) ;
+    }
+  /*
+   * Pass the wake along while there is more to take
+   */
+  if (more)
+    ofc_event_set (service->hIdle) ;
+  return (connection) ;
+}
+
+/*
+ * Become the poller unless another worker is.  OFC_FALSE if one is.
+ */
+static OFC_BOOL pipe_dispatch_poll (OFC_FS_PIPE_SERVICE_WORKER *worker)
+{
+  OFC_FS_PIPE_SERVICE *service ;
+  OFC_FS_PIPE_CONNECTION *connection ;
+  OFC_DWORD count ;
+  OFC_DWORD timeout ;
+  OFC_DWORD i ;
+  OFC_UINT owed ;
+  OFC_BOOL busy ;
+
+  service = worker->service ;
+  ofc_lock (service->lock) ;
+  busy = service->polling ;
+  service->polling = OFC_TRUE ;
+  owed = service->owed ;
+  service->owed = 0 ;
+  ofc_unlock (service->lock) ;
+
+  if (!busy)
+    {
+      for ( ; owed > 0 && pipe_dispatch_listen (service) ; owed--) ;
+      timeout = OFC_INFINITE ;
+      if (owed > 0)
+	{
+	  ofc_lock (service->lock) ;
+	  service->owed += owed ;
+	  ofc_unlock (service->lock) ;
+	  timeout = OFC_FS_PIPE_SERVICE_RETRY ;
+	}
+
+      count = 0 ;
+      OfcFSPipeWaitSetWait (service->hWaitSet, worker->ready,
+			    OFC_FS_PIPE_SERVICE_BATCH, &count, timeout) ;
+      for (i = 0 ; i < count ; i++)
+	{
+	  connection = worker->ready[i].context ;
+	  connection->events = worker->ready[i].events ;
+	  OfcFSPipeWaitSetAdd (service->hWaitSet, connection->hPipe, 0,
+			       connection) ;
+	  /* Our deque was empty so this only fails if it is too small */
+	  if (!pipe_deque_push (&worker->deque, connection))
+	    pipe_dispatch (worker, connection) ;
+	}
+
+      ofc_lock (service->lock) ;
+      service->polling = OFC_FALSE ;
+      ofc_unlock (service->lock) ;
+      /*
+       * Someone idle either steals from us or takes over polling
+       */
+      ofc_event_set (service->hIdle) ;
+    }
+  return (!busy) ;
+}
+
+static OFC_DWORD pipe_dispatch_thread (OFC_HANDLE hThread, OFC_VOID *context)
+{
+  OFC_FS_PIPE_SERVICE_WORKER *worker ;
+  OFC_FS_PIPE_SERVICE *service ;
+  OFC_FS_PIPE_CONNECTION *connection ;
+
+  worker = context ;
+  service = worker->service ;
+  while (!service->stopping)
+    {
+      connection = pipe_deque_pop (&worker->deque) ;
+      if (connection == OFC_NULL)
+	connection = pipe_dispatch_steal (worker) ;
+      if (connection != OFC_NULL)
+	pipe_dispatch (worker, connection) ;
+      else if (!pipe_dispatch_poll (worker))
+	ofc_event_wait (service->hIdle) ;
+    }
+  /* Pass the stop on to the next idle worker */
+  ofc_event_set (service->hIdle) ;
+  return (0) ;
+}
+
+/*
+ * Free a service whose workers have all been stopped
+ */
+static OFC_VOID pipe_dispatch_free (OFC_FS_PIPE_SERVICE *service)
+{
+  OFC_UINT i ;
+
+  while (service->connections != OFC_NULL)
+    pipe_dispatch_close (service, service->connections) ;
+  if (service->hWaitSet != OFC_HANDLE_NULL)
+    OfcFSPipeDestroyWaitSet (service->hWaitSet) ;
+  if (service->hIdle != OFC_HANDLE_NULL)
+    ofc_event_destroy (service->hIdle) ;
+  if (service->workers != OFC_NULL)
+    {
+      for (i = 0 ; i < service->count ; i++)
+	{
+	  ofc_lock_destroy (service->workers[i].deque.lock) ;
+	  if (service->workers[i].request != OFC_NULL)
+	    ofc_free (service->workers[i].request) ;
+	  if (service->workers[i].reply != OFC_NULL)
+	    ofc_free (service->workers[i].reply) ;
+	}
+      ofc_free (service->workers) ;
+    }
+  if (service->name != OFC_NULL)
+    ofc_free (service->name) ;
+  ofc_lock_destroy (service->lock) ;
+  ofc_free (service) ;
+}
+
+/*
+ * Stop the workers that were started.  Workers only look at the flag
+ * between requests, so one in a handler finishes it first.
+ */
+static OFC_VOID pipe_dispatch_stop (OFC_FS_PIPE_SERVICE *service)
+{
+  OFC_UINT i ;
+
+  service->stopping = OFC_TRUE ;
+  if (service->hWaitSet != OFC_HANDLE_NULL)
+    pipe_waitset_interrupt (service->hWaitSet) ;
+  if (service->hIdle != OFC_HANDLE_NULL)
+    ofc_event_set (service->hIdle) ;
+  for (i = 0 ; i < service->count ; i++)
+    {
+      if (service->workers[i].hThread != OFC_HANDLE_NULL)
+	{
+	  ofc_thread_delete (service->workers[i].hThread) ;
+	  ofc_thread_wait (service->workers[i].hThread) ;
+	}
+    }
+}
+
+OFC_HANDLE OfcFSPipeServiceStart (OFC_LPCTSTR lpPipeName,
+				  OFC_FS_PIPE_SERVICE_HANDLER handler,
+				  OFC_VOID *context,
+				  OFC_UINT workers)
+{
+  OFC_FS_PIPE_SERVICE *service ;
+  OFC_FS_PIPE_SERVICE_WORKER *worker ;
+  OFC_HANDLE ret ;
+  OFC_BOOL ok ;
+  OFC_UINT i ;
+
+  ret = OFC_HANDLE_NULL ;
+  service = OFC_NULL ;
+  ok = OFC_FALSE ;
+  if (lpPipeName == OFC_NULL || handler == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+  else
+    service = ofc_malloc (sizeof (OFC_FS_PIPE_SERVICE)) ;
+
+  if (service != OFC_NULL)
+    {
+      if (workers == 0)
+	workers = 1 ;
+      service->lock = ofc_lock_init () ;
+      service->name = ofc_tstrdup (lpPipeName) ;
+      service->handler = handler ;
+      service->context = context ;
+      service->hWaitSet = OfcFSPipeCreateWaitSet () ;
+      service->hIdle = ofc_event_create (OFC_EVENT_AUTO) ;
+      service->connections = OFC_NULL ;
+      service->polling = OFC_FALSE ;
+      service->owed = 0 ;
+      service->stopping = OFC_FALSE ;
+      service->count = 0 ;
+      service->workers =
+	ofc_malloc (sizeof (OFC_FS_PIPE_SERVICE_WORKER) * workers) ;
+      ok = service->name != OFC_NULL &&
+	service->hWaitSet != OFC_HANDLE_NULL &&
+	service->hIdle != OFC_HANDLE_NULL && service->workers != OFC_NULL ;
+    }
+
+  for (i = 0 ; ok && i < workers ; i++)
+    {
+      worker = &service->workers[i] ;
+      worker->service = service ;
+      worker->hThread = OFC_HANDLE_NULL ;
+      worker->index = i ;
+      worker->deque.lock = ofc_lock_init () ;
+      worker->deque.top = 0 ;
+      worker->deque.bottom = 0 ;
+      worker->request_size = OFC_FS_PIPE_SERVICE_REQUEST ;
+      worker->request = ofc_malloc (worker->request_size) ;
+      worker->reply = ofc_malloc (OFC_FS_PIPE_SERVICE_REPLY_MAX) ;
+      service->count++ ;
+      ok = worker->request != OFC_NULL && worker->reply != OFC_NULL ;
+    }
+
+  if (lpPipeName != OFC_NULL && handler != OFC_NULL && !ok)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+
+  /*
+   * One listening instance per worker so a burst of clients finds
+   * somewhere to connect while replacements are put up
+   */
+  for (i = 0 ; ok && i < workers ; i++)
+    ok = pipe_dispatch_listen (service) ;
+
+  for (i = 0 ; ok && i < workers ; i++)
+    {
+      service->workers[i].hThread =
+	ofc_thread_create (&pipe_dispatch_thread, "PipeService", i,
+			   &service->workers[i], OFC_THREAD_JOIN,
+			   OFC_HANDLE_NULL) ;
+      ok = service->workers[i].hThread != OFC_HANDLE_NULL ;
+      if (!ok)
+	ofc_thread_set_variable (OfcLastError,
+				 (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+    }
+
+  if (ok)
+    ret = ofc_handle_create (OFC_HANDLE_PIPE, service) ;
+
+  if (ret == OFC_HANDLE_NULL && service != OFC_NULL)
+    {
+      pipe_dispatch_stop (service) ;
+      pipe_dispatch_free (service) ;
+    }
+  return (ret) ;
+}
+
+OFC_VOID OfcFSPipeServiceStop (OFC_HANDLE hService)
+{
+  OFC_FS_PIPE_SERVICE *service ;
+
+  service = ofc_handle_lock (hService) ;
+  if (service != OFC_NULL)
+    {
+      pipe_dispatch_stop (service) ;
+      pipe_dispatch_free (service) ;
+      ofc_handle_destroy (hService) ;
+      ofc_handle_unlock (hService) ;
+    }
+}
+
+/*
+ * Return the event that is set when an operation posted on a pipe
+ * overlapped handle completes
+ */
+OFC_HANDLE OfcFSPipeGetOverlappedEvent (OFC_HANDLE hOverlapped)
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_HANDLE hEvent ;
 
-  return (OFC_FALSE) ;
+  hEvent = OFC_HANDLE_NULL ;
+  ov = ofc_handle_lock (hOverlapped) ;
+  if (ov != OFC_NULL)
+    {
+      hEvent = ov->hEvent ;
+      ofc_handle_unlock (hOverlapped) ;
+    }
+  return (hEvent) ;
 }
 
 OFC_BOOL OfcFSPipeSetEndOfFile (OFC_HANDLE hFile) 
@@ -609,10 +5770,51 @@ OFC_BOOL OfcFSPipeSetFileInformationByHandle (OFC_HANDLE hFile,
 						OFC_LPVOID lpFileInformation,
 						OFC_DWORD dwBufferSize) 
 {
-  ofc_thread_set_variable (OfcLastError, 
-			 (OFC_DWORD_PTR) OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+  OFC_BOOL ret ;
+  OFC_FS_PIPE_HALF *half ;
+  OFC_FS_PIPE_MODE_INFO *info ;
 
-  return (OFC_FALSE) ;
+  ret = OFC_FALSE ;
+
+  half = ofc_handle_lock (hFile) ;
+  if (half != OFC_NULL)
+    {
+      switch ((OFC_INT) FileInformationClass)
+	{
+	case OfcFSPipeModeInfo:
+	  info = lpFileInformation ;
+	  if (dwBufferSize < sizeof (OFC_FS_PIPE_MODE_INFO) ||
+	      (info->read_mode != OFC_FS_PIPE_READMODE_MESSAGE &&
+	       info->read_mode != OFC_FS_PIPE_READMODE_BYTE))
+	    ofc_thread_set_variable (OfcLastError, 
+				     (OFC_DWORD_PTR) 
+				     OFC_ERROR_INVALID_PARAMETER) ;
+	  else
+	    {
+	      /*
+	       * Takes effect from the next read.  A message partially
+	       * read in byte mode is finished in message mode.
+	       */
+	      ofc_lock (half->pipe_file->lock) ;
+	      half->read_mode = info->read_mode ;
+	      ofc_unlock (half->pipe_file->lock) ;
+	      ret = OFC_TRUE ;
+	    }
+	  break ;
+
+	default:
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) 
+				   OFC_ERROR_CALL_NOT_IMPLEMENTED) ;
+	  break ;
+	}
+      ofc_handle_unlock (hFile) ;
+    }
+  else
+    ofc_thread_set_variable (OfcLastError, 
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+
+  return (ret) ;
 }
 
 OFC_DWORD OfcFSPipeSetFilePointer (OFC_HANDLE hFile,
@@ -623,61 +5825,112 @@ OFC_DWORD OfcFSPipeSetFilePointer (OFC_HANDLE hFile,
   return (OFC_TRUE) ;
 }
 
-static OFC_BOOL 
-OfcFSPipeTransactNamedPipe (OFC_HANDLE hFile,
-			     OFC_LPVOID lpInBuffer,
-			     OFC_DWORD nInBufferSize,
-			     OFC_LPVOID lpOutBuffer,
-			     OFC_DWORD nOutBufferSize,
-			     OFC_LPDWORD lpBytesRead,
-			     OFC_HANDLE hOverlapped)
+/*
+ * The request and the reply share one deadline
+ */
+static OFC_BOOL pipe_transact_handle (OFC_HANDLE hFile,
+				      OFC_LPVOID lpInBuffer,
+				      OFC_DWORD nInBufferSize,
+				      OFC_LPVOID lpOutBuffer,
+				      OFC_DWORD nOutBufferSize,
+				      OFC_LPDWORD lpBytesRead,
+				      OFC_HANDLE hOverlapped,
+				      OFC_DWORD dwMilliseconds)
 {
   OFC_BOOL ret ;
-  OFC_FS_PIPE_DATA *data ;
+  OFC_FS_PIPE_FILE *pipe_file ;
   OFC_FS_PIPE_HALF *half ;
-  OFC_FS_PIPE_HALF *sibling ;
-  OFC_INT nBytes ;
+  OFC_FS_PIPE_OVERLAPPED *ov ;
+  OFC_DWORD nBytes ;
+  OFC_UINT64 start ;
+  OFC_MSTIME deadline ;
 
   ret = OFC_FALSE ;
 
   half = ofc_handle_lock (hFile) ;
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  if (half != OFC_NULL && half->shm != OFC_NULL)
+    {
+      start = pipe_latency_start () ;
+      ret = pipe_shm_write_half (half, lpInBuffer, nInBufferSize, &nBytes,
+				 hOverlapped) &&
+	pipe_shm_read_half (half, lpOutBuffer, nOutBufferSize, &nBytes,
+			    hOverlapped) ;
+      if (ret)
+	pipe_latency_record (half->pipe_file, OFC_FS_PIPE_LATENCY_TRANSACT,
+			     start) ;
+      if (lpBytesRead != OFC_NULL)
+	*lpBytesRead = ret ? nBytes : 0 ;
+      ofc_handle_unlock (hFile) ;
+      half = OFC_NULL ;
+    }
+#endif
   if (half != OFC_NULL)
     {
-      if (half->sibling != OFC_NULL)
-	{
-	  sibling = half->sibling ;
-	  data = ofc_malloc (sizeof (OFC_FS_PIPE_DATA) +
-			     nInBufferSize - 1) ;
-	  data->len = nInBufferSize ;
-	  data->offset = 0 ;
-	  ofc_memcpy (data->buffer, lpInBuffer, nInBufferSize) ;
-
-	  ofc_waitq_enqueue(sibling->hWaitQ, data);
-
-	  for (data = ofc_waitq_dequeue (half->hWaitQ) ;
-	       data == OFC_NULL ;
-	       data = ofc_waitq_dequeue (half->hWaitQ))
-	    {
-	      ofc_waitq_block(half->hWaitQ);
-	    }
-
-	  nBytes = OFC_MIN(nOutBufferSize, data->len) ;
-	  ofc_memcpy (lpOutBuffer, data->buffer, nBytes) ;
-	  *lpBytesRead = nBytes ;
-	  ofc_free (data) ;
-	  ret = OFC_TRUE ;
-	}
-      else
+      pipe_file = half->pipe_file ;
+      /*
+       * An overlapped transact completes elsewhere so only blocking
+       * ones are timed
+       */
+      start = 0 ;
+      if (hOverlapped == OFC_HANDLE_NULL)
+	start = pipe_latency_start () ;
+      ofc_lock (pipe_file->lock) ;
+      if (pipe_ov_begin (pipe_file, hOverlapped, &ov))
 	{
-	  ofc_thread_set_variable (OfcLastError, 
-				 (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  /*
+	   * The request is always written synchronously.  Only the wait
+	   * for the reply is overlapped.
+	   */
+	  deadline = pipe_deadline (half, dwMilliseconds) ;
+	  ret = pipe_write_internal (half, lpInBuffer, nInBufferSize,
+				     &nBytes, OFC_NULL, deadline) ;
+	  if (ret)
+	    ret = pipe_read_internal (half, lpOutBuffer, nOutBufferSize,
+				      &nBytes, ov, deadline) ;
+	  else
+	    nBytes = 0 ;
+	  if (ret)
+	    pipe_latency_record (pipe_file, OFC_FS_PIPE_LATENCY_TRANSACT,
+				 start) ;
+	  if (lpBytesRead != OFC_NULL)
+	    *lpBytesRead = nBytes ;
+	  pipe_ov_end (hOverlapped, ov, ret) ;
 	}
+      ofc_unlock (pipe_file->lock) ;
       ofc_handle_unlock (hFile) ;
     }
 
   return (ret) ;
 }
 
+static OFC_BOOL 
+OfcFSPipeTransactNamedPipe (OFC_HANDLE hFile,
+			     OFC_LPVOID lpInBuffer,
+			     OFC_DWORD nInBufferSize,
+			     OFC_LPVOID lpOutBuffer,
+			     OFC_DWORD nOutBufferSize,
+			     OFC_LPDWORD lpBytesRead,
+			     OFC_HANDLE hOverlapped)
+{
+  return (pipe_transact_handle (hFile, lpInBuffer, nInBufferSize,
+				lpOutBuffer, nOutBufferSize, lpBytesRead,
+				hOverlapped, OFC_FS_PIPE_WAIT_DEFAULT)) ;
+}
+
+OFC_BOOL OfcFSPipeTransactTimeout (OFC_HANDLE hPipe,
+				   OFC_LPVOID lpInBuffer,
+				   OFC_DWORD nInBufferSize,
+				   OFC_LPVOID lpOutBuffer,
+				   OFC_DWORD nOutBufferSize,
+				   OFC_LPDWORD lpBytesRead,
+				   OFC_DWORD dwMilliseconds)
+{
+  return (pipe_transact_handle (hPipe, lpInBuffer, nInBufferSize,
+				lpOutBuffer, nOutBufferSize, lpBytesRead,
+				OFC_HANDLE_NULL, dwMilliseconds)) ;
+}
+
 static OFC_BOOL 
 OfcFSPipeGetDiskFreeSpace (OFC_LPCTSTR lpRootPathName,
 			    OFC_LPDWORD lpSectorsPerCluster,
@@ -801,6 +6054,350 @@ static OFC_FILE_FSINFO OfcFSPipeInfo =
     OFC_NULL
   } ;
 
+OFC_BOOL OfcFSPipeSetConfig (OFC_LPCTSTR lpPipeName,
+			     const OFC_FS_PIPE_CONFIG *config)
+{
+  OFC_FS_PIPE_CONFIG_ENTRY *entry ;
+  OFC_FS_PIPE_CONFIG_ENTRY **prev ;
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  ofc_pipe_lock () ;
+  for (prev = &pipes.configs ;
+       *prev != OFC_NULL && !pipe_name_equal ((*prev)->name, lpPipeName) ;
+       prev = &(*prev)->next) ;
+
+  entry = *prev ;
+  if (config == OFC_NULL)
+    {
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+      /*
+       * A bridged name keeps its entry for the socket
+       */
+      if (entry != OFC_NULL && entry->bridge != OFC_NULL)
+	ofc_memset (&entry->config, 0, sizeof (OFC_FS_PIPE_CONFIG)) ;
+      else
+#endif
+      if (entry != OFC_NULL)
+	{
+	  *prev = entry->next ;
+	  ofc_free (entry->name) ;
+	  ofc_free (entry) ;
+	}
+    }
+  else
+    {
+      if (entry == OFC_NULL)
+	{
+	  entry = ofc_malloc (sizeof (OFC_FS_PIPE_CONFIG_ENTRY)) ;
+	  if (entry != OFC_NULL)
+	    {
+	      entry->name = ofc_tstrdup (lpPipeName) ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+	      entry->bridge = OFC_NULL ;
+#endif
+	      entry->next = pipes.configs ;
+	      pipes.configs = entry ;
+	    }
+	}
+
+      if (entry == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR) 
+				   OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	  ret = OFC_FALSE ;
+	}
+      else
+	entry->config = *config ;
+    }
+  ofc_pipe_unlock () ;
+
+  return (ret) ;
+}
+
+OFC_BOOL OfcFSPipeSetBridge (OFC_LPCTSTR lpPipeName, const OFC_CHAR *path)
+{
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+  OFC_FS_PIPE_CONFIG_ENTRY *entry ;
+  OFC_CHAR *bridge ;
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  bridge = OFC_NULL ;
+  if (path != OFC_NULL)
+    {
+      bridge = ofc_strdup (path) ;
+      if (bridge == OFC_NULL)
+	ret = OFC_FALSE ;
+    }
+
+  ofc_pipe_lock () ;
+  entry = pipe_config_lookup (lpPipeName) ;
+  if (ret && entry == OFC_NULL && bridge != OFC_NULL)
+    {
+      entry = ofc_malloc (sizeof (OFC_FS_PIPE_CONFIG_ENTRY)) ;
+      if (entry == OFC_NULL)
+	ret = OFC_FALSE ;
+      else
+	{
+	  entry->name = ofc_tstrdup (lpPipeName) ;
+	  ofc_memset (&entry->config, 0, sizeof (OFC_FS_PIPE_CONFIG)) ;
+	  entry->bridge = OFC_NULL ;
+	  entry->next = pipes.configs ;
+	  pipes.configs = entry ;
+	}
+    }
+
+  if (ret && entry != OFC_NULL)
+    {
+      if (entry->bridge != OFC_NULL)
+	ofc_free (entry->bridge) ;
+      entry->bridge = bridge ;
+      bridge = OFC_NULL ;
+    }
+  ofc_pipe_unlock () ;
+
+  if (bridge != OFC_NULL)
+    ofc_free (bridge) ;
+  if (!ret)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+  return (ret) ;
+#else
+  ofc_thread_set_variable (OfcLastError,
+			   (OFC_DWORD_PTR) OFC_ERROR_NOT_SUPPORTED) ;
+  return (OFC_FALSE) ;
+#endif
+}
+
+OFC_VOID OfcFSPipeGetPoolStats (OFC_FS_PIPE_POOL_STATS *stats)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+
+  /*
+   * The counters are read as they are bumped.  pipes.lock only keeps
+   * the pipe files from going away.
+   */
+  ofc_pipe_lock () ;
+  *stats = pipes.pool_stats ;
+  for (pipe_file = pipes.first ;
+       pipe_file != OFC_NULL ;
+       pipe_file = pipe_file->next)
+    pipe_pool_stats_add (stats, &pipe_file->pool.stats) ;
+  ofc_pipe_unlock () ;
+}
+
+OFC_VOID OfcFSPipeGetWaitStats (OFC_FS_PIPE_WAIT_STATS *stats)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+
+  ofc_pipe_lock () ;
+  *stats = pipes.wait_stats ;
+  for (pipe_file = pipes.first ;
+       pipe_file != OFC_NULL ;
+       pipe_file = pipe_file->next)
+    pipe_wait_stats_add (stats, &pipe_file->wait_stats) ;
+  ofc_pipe_unlock () ;
+}
+
+/*
+ * Copy the statistics of the direction a half reads along with its
+ * current queue depth.  The counters are read as they are bumped.
+ * The pipe lock is held for the queue depth.
+ */
+static OFC_VOID pipe_direction_snapshot (OFC_FS_PIPE_DIRECTION_STATS *out,
+					 OFC_FS_PIPE_DIRECTION_STATS *stats,
+					 OFC_FS_PIPE_HALF *half)
+{
+  out->bytes_written = pipe_counter_get (&stats->bytes_written) ;
+  out->messages_written = pipe_counter_get (&stats->messages_written) ;
+  out->bytes_read = pipe_counter_get (&stats->bytes_read) ;
+  out->handoffs = pipe_counter_get (&stats->handoffs) ;
+  out->wait_usecs = pipe_counter_get (&stats->wait_usecs) ;
+  out->queued_bytes_hwm = pipe_hwm_get (&stats->queued_bytes_hwm) ;
+  out->queued_messages_hwm = pipe_hwm_get (&stats->queued_messages_hwm) ;
+  out->queued_bytes = 0 ;
+  out->queued_messages = 0 ;
+  if (half != OFC_NULL)
+    {
+      if (half->ring.buffer != OFC_NULL)
+	out->queued_bytes = half->ring.count ;
+      else
+	{
+	  out->queued_bytes = half->queued ;
+	  out->queued_messages = half->messages ;
+	}
+    }
+}
+
+OFC_BOOL OfcFSPipeGetStats (OFC_FS_PIPE_GLOBAL_STATS *global,
+			    OFC_FS_PIPE_INSTANCE_STATS **instances,
+			    OFC_UINT *count)
+{
+  OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_INSTANCE_STATS *instance ;
+  OFC_BOOL ret ;
+  OFC_UINT i ;
+
+  ret = OFC_TRUE ;
+  ofc_pipe_lock () ;
+  if (global != OFC_NULL)
+    *global = pipes.stats ;
+
+  i = 0 ;
+  instance = OFC_NULL ;
+  if (instances != OFC_NULL)
+    {
+      instance = ofc_malloc (sizeof (OFC_FS_PIPE_INSTANCE_STATS) *
+			     OFC_MAX (pipes.stats.instances, 1)) ;
+      if (instance == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError, 
+				   (OFC_DWORD_PTR)
+				   OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	  ret = OFC_FALSE ;
+	}
+    }
+
+  for (pipe_file = pipes.first ;
+       ret && pipe_file != OFC_NULL ;
+       pipe_file = pipe_file->next)
+    {
+      if (global != OFC_NULL)
+	{
+	  pipe_direction_stats_add (global, &pipe_file->inbound) ;
+	  pipe_direction_stats_add (global, &pipe_file->outbound) ;
+	}
+      if (instance != OFC_NULL)
+	{
+	  /*
+	   * Each pipe is held only long enough to read its state and
+	   * queue depth
+	   */
+	  ofc_lock (pipe_file->lock) ;
+	  instance[i].name = ofc_tstrdup (pipe_file->name) ;
+	  if (pipe_file->server != OFC_NULL &&
+	      !pipe_file->server->connected)
+	    instance[i].state = OFC_FS_PIPE_STATE_LISTENING ;
+	  else if (pipe_file->server != OFC_NULL &&
+		   pipe_file->client != OFC_NULL)
+	    instance[i].state = OFC_FS_PIPE_STATE_CONNECTED ;
+	  else
+	    instance[i].state = OFC_FS_PIPE_STATE_CLOSING ;
+	  pipe_direction_snapshot (&instance[i].inbound, &pipe_file->inbound,
+				   pipe_file->server) ;
+	  pipe_direction_snapshot (&instance[i].outbound,
+				   &pipe_file->outbound, pipe_file->client) ;
+	  ofc_unlock (pipe_file->lock) ;
+	  i++ ;
+	}
+    }
+  ofc_pipe_unlock () ;
+
+  if (instances != OFC_NULL)
+    *instances = instance ;
+  if (count != OFC_NULL)
+    *count = i ;
+
+  return (ret) ;
+}
+
+OFC_VOID OfcFSPipeFreeStats (OFC_FS_PIPE_INSTANCE_STATS *instances,
+			     OFC_UINT count)
+{
+  OFC_UINT i ;
+
+  if (instances != OFC_NULL)
+    {
+      for (i = 0 ; i < count ; i++)
+	ofc_free (instances[i].name) ;
+      ofc_free (instances) ;
+    }
+}
+
+OFC_VOID OfcFSPipeSetSpinCount (OFC_UINT spin_count)
+{
+  pipes.spin_count = spin_count ;
+}
+
+OFC_VOID OfcFSPipeSetHistograms (OFC_BOOL enable)
+{
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  pipes.histograms = enable ;
+#endif
+}
+
+OFC_BOOL OfcFSPipeGetPercentiles (OFC_LPCTSTR lpPipeName,
+				  OFC_FS_PIPE_LATENCY latency,
+				  OFC_FS_PIPE_PERCENTILES *percentiles)
+{
+  OFC_BOOL ret ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  OFC_FS_PIPE_HISTOGRAM *histogram ;
+#endif
+
+  ret = OFC_FALSE ;
+  ofc_memset (percentiles, 0, sizeof (OFC_FS_PIPE_PERCENTILES)) ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  if (latency < OFC_FS_PIPE_LATENCY_MAX)
+    {
+      ofc_pipe_lock () ;
+      histogram = pipe_histogram_lookup (lpPipeName) ;
+      ofc_pipe_unlock () ;
+      /*
+       * Histograms are never freed before shutdown
+       */
+      if (histogram != OFC_NULL)
+	{
+	  pipe_percentiles (histogram, latency, percentiles) ;
+	  ret = OFC_TRUE ;
+	}
+    }
+#endif
+  return (ret) ;
+}
+
+OFC_VOID OfcFSPipeDumpHistograms (OFC_VOID)
+{
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  static const OFC_CHAR *latency_names[OFC_FS_PIPE_LATENCY_MAX] =
+    {
+      "connect",
+      "read",
+      "transact"
+    } ;
+  OFC_FS_PIPE_HISTOGRAM *histogram ;
+  OFC_FS_PIPE_PERCENTILES percentiles ;
+  OFC_INT latency ;
+  OFC_CHAR *name ;
+
+  ofc_pipe_lock () ;
+  for (histogram = pipes.histogram_list ;
+       histogram != OFC_NULL ;
+       histogram = histogram->next)
+    {
+      name = ofc_tstr2cstr (histogram->name) ;
+      for (latency = 0 ; latency < OFC_FS_PIPE_LATENCY_MAX ; latency++)
+	{
+	  pipe_percentiles (histogram, (OFC_FS_PIPE_LATENCY) latency,
+			    &percentiles) ;
+	  if (percentiles.count > 0)
+	    ofc_log (OFC_LOG_INFO,
+		     "%s %s: count %llu p50 %llu p90 %llu p99 %llu "
+		     "max %llu usecs\n",
+		     name == OFC_NULL ? "" : name, latency_names[latency],
+		     percentiles.count, percentiles.p50_usecs,
+		     percentiles.p90_usecs, percentiles.p99_usecs,
+		     percentiles.max_usecs) ;
+	}
+      if (name != OFC_NULL)
+	ofc_free (name) ;
+    }
+  ofc_pipe_unlock () ;
+#endif
+}
+
 OFC_VOID OfcFSPipeStartup (OFC_VOID)
 {
   OFC_PATH *path ;
@@ -809,7 +6406,23 @@ OFC_VOID OfcFSPipeStartup (OFC_VOID)
 
   pipes.first = OFC_NULL ;
   pipes.last = OFC_NULL ;
+  ofc_memset (pipes.listening, 0, sizeof (pipes.listening)) ;
+  ofc_memset (&pipes.pool_stats, 0, sizeof (pipes.pool_stats)) ;
+  ofc_memset (&pipes.wait_stats, 0, sizeof (pipes.wait_stats)) ;
+  ofc_memset (&pipes.stats, 0, sizeof (pipes.stats)) ;
+  pipes.spin_count = 0 ;
+  pipes.configs = OFC_NULL ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  pipes.histograms = OFC_FALSE ;
+  pipes.histogram_list = OFC_NULL ;
+#endif
 
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  pipe_shm_startup () ;
+#endif
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+  pipe_bridge_startup (&pipe_bridge_ops) ;
+#endif
   ofc_fs_register (OFC_FST_PIPE, &OfcFSPipeInfo) ;
   /*
    * Create a path for the IPC service
@@ -825,39 +6438,73 @@ OFC_VOID OfcFSPipeStartup (OFC_VOID)
 OFC_VOID OfcFSPipeShutdown (OFC_VOID)
 {
   OFC_FS_PIPE_FILE *pipe_file ;
+  OFC_FS_PIPE_CONFIG_ENTRY *entry ;
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  OFC_FS_PIPE_HISTOGRAM *histogram ;
+#endif
+  OFC_HANDLE hClient ;
+  OFC_HANDLE hServer ;
 
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+  /*
+   * The forwarder owns the server halves of bridged pipes.  It closes
+   * them on the way out.
+   */
+  pipe_bridge_shutdown () ;
+#endif
   ofc_lock(pipes.lock);
   for (pipe_file = pipes.first ;
        pipe_file != OFC_NULL;
        pipe_file = pipes.first)
     {
-      pipes.first = pipe_file->next;
-      ofc_unlock(pipes.lock);
-
+      pipe_unlink_internal (pipe_file) ;
+      /*
+       * Closing a half may free the pipe file and the half so collect
+       * the handles first
+       */
+      ofc_lock (pipe_file->lock) ;
+      hClient = OFC_HANDLE_NULL ;
       if (pipe_file->client != OFC_NULL)
-	{
-	  OFC_FS_PIPE_HALF *client ;
-	  client = pipe_file->client ;
-	  if (client->hPipe != OFC_HANDLE_NULL)
-	    {
-	      OfcFSPipeCloseHandle(client->hPipe);
-	      client->hPipe = OFC_HANDLE_NULL;
-	    }
-	}
+	hClient = pipe_file->client->hPipe ;
+      hServer = OFC_HANDLE_NULL ;
       if (pipe_file->server != OFC_NULL)
-	{
-	  OFC_FS_PIPE_HALF *server ;
-	  server = pipe_file->server ;
-	  if (server->hPipe != OFC_HANDLE_NULL)
-	    {
-	      OfcFSPipeCloseHandle(server->hPipe);
-	      server->hPipe = OFC_HANDLE_NULL;
-	    }
-	}
+	hServer = pipe_file->server->hPipe ;
+      ofc_unlock (pipe_file->lock) ;
+      ofc_unlock(pipes.lock);
+
+      if (hClient != OFC_HANDLE_NULL)
+	OfcFSPipeCloseHandle(hClient);
+      if (hServer != OFC_HANDLE_NULL)
+	OfcFSPipeCloseHandle(hServer);
+
       ofc_lock(pipes.lock);
     }
+
+  for (entry = pipes.configs ; entry != OFC_NULL ; entry = pipes.configs)
+    {
+      pipes.configs = entry->next ;
+#if defined(OFC_FS_PIPE_SOCKET_BRIDGE)
+      if (entry->bridge != OFC_NULL)
+	ofc_free (entry->bridge) ;
+#endif
+      ofc_free (entry->name) ;
+      ofc_free (entry) ;
+    }
+#if defined(OFC_FS_PIPE_HISTOGRAMS)
+  for (histogram = pipes.histogram_list ;
+       histogram != OFC_NULL ;
+       histogram = pipes.histogram_list)
+    {
+      pipes.histogram_list = histogram->next ;
+      ofc_free (histogram->name) ;
+      ofc_free (histogram) ;
+    }
+#endif
   ofc_unlock (pipes.lock);
   ofc_lock_destroy(pipes.lock);
+#if defined(OFC_FS_PIPE_SHARED_MEMORY)
+  pipe_shm_shutdown () ;
+#endif
 
   ofc_path_delete_mapW (TSTR("IPC"));
 }
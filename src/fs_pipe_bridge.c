@@ -0,0 +1,550 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ofc/types.h"
+#include "ofc/libc.h"
+#include "ofc/heap.h"
+#include "ofc/lock.h"
+#include "ofc/thread.h"
+#include "ofc/file.h"
+
+#include "fs_pipe_bridge.h"
+
+/**
+ * \defgroup pipe_bridge Pipe Socket Bridge
+ * \ingroup pipe
+ */
+
+/** \{ */
+
+/*
+ * Most bytes moved in one read or write.  The pipe side coalesces
+ * everything queued up to this much into one send.
+ */
+#define PIPE_BRIDGE_BATCH (64 * 1024)
+/*
+ * Batches moved for one bridge before the others get a turn
+ */
+#define PIPE_BRIDGE_BURST 16
+#define PIPE_BRIDGE_EVENTS 64
+
+struct _OFC_FS_PIPE_BRIDGE
+{
+  /* Link on the list of open bridges */
+  struct _OFC_FS_PIPE_BRIDGE *next ;
+  struct _OFC_FS_PIPE_BRIDGE *prev ;
+  /* Link on the list of bridges with data to drain */
+  struct _OFC_FS_PIPE_BRIDGE *ready_next ;
+  OFC_BOOL ready ;
+  OFC_VOID *context ;
+  int sock ;
+  /* Drained from the pipe and not yet accepted by the socket */
+  OFC_CHAR *out ;
+  OFC_DWORD out_len ;
+  OFC_DWORD out_offset ;
+  /* Waiting for the socket to drain before sending more */
+  OFC_BOOL blocked ;
+  /* The user has closed and everything it wrote has been drained */
+  OFC_BOOL closed ;
+  /* Torn down but not yet freed */
+  OFC_BOOL dead ;
+} ;
+
+/*
+ * The lock guards the lists.  Its place in the lock ordering is
+ * described in fs_pipe.c.
+ */
+static struct
+{
+  OFC_LOCK lock ;
+  const OFC_FS_PIPE_BRIDGE_OPS *ops ;
+  OFC_HANDLE hThread ;
+  int epoll ;
+  /* Signalled when a bridge is made ready and to stop the forwarder */
+  int wake ;
+  OFC_FS_PIPE_BRIDGE *first ;
+  OFC_FS_PIPE_BRIDGE *ready ;
+  /* Torn down during the current pass of the forwarder */
+  OFC_FS_PIPE_BRIDGE *dead ;
+  /* Socket reads land here.  Only used by the forwarder. */
+  OFC_CHAR *in ;
+} bridges ;
+
+static OFC_VOID pipe_bridge_error (OFC_DWORD error)
+{
+  ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) error) ;
+}
+
+static OFC_VOID pipe_bridge_signal (OFC_VOID)
+{
+  uint64_t one ;
+
+  one = 1 ;
+  if (write (bridges.wake, &one, sizeof (one)) < 0)
+    {
+      /* Only fails if the counter is saturated, which wakes anyway */
+    }
+}
+
+static OFC_VOID pipe_bridge_arm (OFC_FS_PIPE_BRIDGE *bridge,
+				 OFC_BOOL blocked)
+{
+  struct epoll_event event ;
+
+  if (bridge->blocked != blocked)
+    {
+      bridge->blocked = blocked ;
+      event.events = EPOLLIN | EPOLLRDHUP | (blocked ? EPOLLOUT : 0) ;
+      event.data.ptr = bridge ;
+      epoll_ctl (bridges.epoll, EPOLL_CTL_MOD, bridge->sock, &event) ;
+    }
+}
+
+/*
+ * Close a bridge.  The pipe handler is told first so it stops
+ * notifying, then the bridge is unlinked.  It is freed at the end of
+ * the forwarder's pass since later events of the pass may name it.
+ */
+static OFC_VOID pipe_bridge_teardown (OFC_FS_PIPE_BRIDGE *bridge)
+{
+  OFC_FS_PIPE_BRIDGE **prev ;
+
+  if (!bridge->dead)
+    {
+      bridge->dead = OFC_TRUE ;
+      bridges.ops->close (bridge->context) ;
+
+      epoll_ctl (bridges.epoll, EPOLL_CTL_DEL, bridge->sock, OFC_NULL) ;
+      close (bridge->sock) ;
+      bridge->sock = -1 ;
+
+      ofc_lock (bridges.lock) ;
+      if (bridge->prev == OFC_NULL)
+	bridges.first = bridge->next ;
+      else
+	bridge->prev->next = bridge->next ;
+      if (bridge->next != OFC_NULL)
+	bridge->next->prev = bridge->prev ;
+      if (bridge->ready)
+	{
+	  for (prev = &bridges.ready ; *prev != bridge ;
+	       prev = &(*prev)->ready_next) ;
+	  *prev = bridge->ready_next ;
+	  bridge->ready = OFC_FALSE ;
+	}
+      bridge->next = bridges.dead ;
+      bridges.dead = bridge ;
+      ofc_unlock (bridges.lock) ;
+    }
+}
+
+static OFC_VOID pipe_bridge_reap (OFC_VOID)
+{
+  OFC_FS_PIPE_BRIDGE *bridge ;
+  OFC_FS_PIPE_BRIDGE *next ;
+
+  ofc_lock (bridges.lock) ;
+  bridge = bridges.dead ;
+  bridges.dead = OFC_NULL ;
+  ofc_unlock (bridges.lock) ;
+
+  for ( ; bridge != OFC_NULL ; bridge = next)
+    {
+      next = bridge->next ;
+      ofc_free (bridge->out) ;
+      ofc_free (bridge) ;
+    }
+}
+
+/*
+ * Move what the user wrote to the socket.  Everything queued is
+ * drained into one buffer so a burst of small messages costs one send.
+ * If the socket fills, the rest waits in the buffer until it drains.
+ */
+static OFC_VOID pipe_bridge_forward_out (OFC_FS_PIPE_BRIDGE *bridge)
+{
+  ssize_t n ;
+  OFC_INT burst ;
+  OFC_BOOL done ;
+
+  for (burst = 0, done = OFC_FALSE ; !done && !bridge->dead ; )
+    {
+      if (bridge->out_offset == bridge->out_len)
+	{
+	  bridge->out_offset = 0 ;
+	  bridge->out_len = 0 ;
+	  if (bridge->closed)
+	    pipe_bridge_teardown (bridge) ;
+	  else if (burst == PIPE_BRIDGE_BURST)
+	    {
+	      /* Let the other bridges in, and come back next pass */
+	      pipe_bridge_notify (bridge) ;
+	      done = OFC_TRUE ;
+	    }
+	  else
+	    {
+	      bridge->out_len =
+		bridges.ops->drain (bridge->context, bridge->out,
+				    PIPE_BRIDGE_BATCH, &bridge->closed) ;
+	      burst++ ;
+	      if (bridge->out_len == 0 && !bridge->closed)
+		done = OFC_TRUE ;
+	    }
+	}
+      else
+	{
+	  n = send (bridge->sock, bridge->out + bridge->out_offset,
+		    bridge->out_len - bridge->out_offset,
+		    MSG_DONTWAIT | MSG_NOSIGNAL) ;
+	  if (n >= 0)
+	    bridge->out_offset += (OFC_DWORD) n ;
+	  else if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    {
+	      pipe_bridge_arm (bridge, OFC_TRUE) ;
+	      done = OFC_TRUE ;
+	    }
+	  else if (errno != EINTR)
+	    pipe_bridge_teardown (bridge) ;
+	}
+    }
+
+  if (!bridge->dead && bridge->out_offset == bridge->out_len)
+    pipe_bridge_arm (bridge, OFC_FALSE) ;
+}
+
+/*
+ * Move what the socket sent to the user.  The pipe is unbounded so
+ * filling it never blocks the forwarder.
+ */
+static OFC_VOID pipe_bridge_forward_in (OFC_FS_PIPE_BRIDGE *bridge)
+{
+  ssize_t n ;
+  OFC_INT burst ;
+
+  for (burst = 0 ; burst < PIPE_BRIDGE_BURST && !bridge->dead ; burst++)
+    {
+      n = recv (bridge->sock, bridges.in, PIPE_BRIDGE_BATCH, MSG_DONTWAIT) ;
+      if (n > 0)
+	{
+	  /*
+	   * Once the user has closed there is no one to read it.  The
+	   * bridge is closed when what the user wrote has been sent.
+	   */
+	  bridges.ops->fill (bridge->context, bridges.in, (OFC_DWORD) n) ;
+	  if (n < PIPE_BRIDGE_BATCH)
+	    break ;
+	}
+      else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	break ;
+      else if (n == 0 || errno != EINTR)
+	pipe_bridge_teardown (bridge) ;
+    }
+}
+
+/*
+ * Drain the bridges the user has written to.  The list is taken whole
+ * so a bridge that used up its burst and notified itself again waits
+ * for the next pass.
+ */
+static OFC_VOID pipe_bridge_forward_ready (OFC_VOID)
+{
+  OFC_FS_PIPE_BRIDGE *bridge ;
+  OFC_FS_PIPE_BRIDGE *next ;
+  uint64_t count ;
+
+  if (read (bridges.wake, &count, sizeof (count)) < 0)
+    {
+      /* Nothing pending.  The list is checked regardless */
+    }
+
+  ofc_lock (bridges.lock) ;
+  bridge = bridges.ready ;
+  bridges.ready = OFC_NULL ;
+  for ( ; bridge != OFC_NULL ; bridge = next)
+    {
+      next = bridge->ready_next ;
+      bridge->ready = OFC_FALSE ;
+      ofc_unlock (bridges.lock) ;
+      /*
+       * A blocked bridge is sent the rest when the socket drains
+       */
+      if (!bridge->blocked)
+	pipe_bridge_forward_out (bridge) ;
+      ofc_lock (bridges.lock) ;
+    }
+  ofc_unlock (bridges.lock) ;
+}
+
+static OFC_DWORD pipe_bridge_thread (OFC_HANDLE hThread, OFC_VOID *context)
+{
+  struct epoll_event events[PIPE_BRIDGE_EVENTS] ;
+  OFC_FS_PIPE_BRIDGE *bridge ;
+  int count ;
+  int i ;
+
+  while (!ofc_thread_is_deleting (hThread))
+    {
+      count = epoll_wait (bridges.epoll, events, PIPE_BRIDGE_EVENTS, -1) ;
+      for (i = 0 ; i < count ; i++)
+	{
+	  bridge = events[i].data.ptr ;
+	  if (bridge == OFC_NULL)
+	    pipe_bridge_forward_ready () ;
+	  else
+	    {
+	      if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP |
+				      EPOLLERR))
+		pipe_bridge_forward_in (bridge) ;
+	      if (!bridge->dead && (events[i].events & EPOLLOUT))
+		pipe_bridge_forward_out (bridge) ;
+	    }
+	}
+      pipe_bridge_reap () ;
+    }
+  return (0) ;
+}
+
+/*
+ * Start the forwarder the first time a bridge is opened.  Called with
+ * the lock held.
+ */
+static OFC_BOOL pipe_bridge_run (OFC_VOID)
+{
+  struct epoll_event event ;
+
+  if (bridges.hThread == OFC_HANDLE_NULL)
+    {
+      bridges.epoll = epoll_create1 (EPOLL_CLOEXEC) ;
+      bridges.wake = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+      bridges.in = ofc_malloc (PIPE_BRIDGE_BATCH) ;
+      event.events = EPOLLIN ;
+      event.data.ptr = OFC_NULL ;
+      if (bridges.epoll >= 0 && bridges.wake >= 0 && bridges.in != OFC_NULL &&
+	  epoll_ctl (bridges.epoll, EPOLL_CTL_ADD, bridges.wake, &event) == 0)
+	bridges.hThread = ofc_thread_create (&pipe_bridge_thread,
+					     "PipeBridge",
+					     OFC_THREAD_SINGLETON,
+					     OFC_NULL, OFC_THREAD_JOIN,
+					     OFC_HANDLE_NULL) ;
+
+      if (bridges.hThread == OFC_HANDLE_NULL)
+	{
+	  if (bridges.epoll >= 0)
+	    close (bridges.epoll) ;
+	  if (bridges.wake >= 0)
+	    close (bridges.wake) ;
+	  if (bridges.in != OFC_NULL)
+	    ofc_free (bridges.in) ;
+	  bridges.epoll = -1 ;
+	  bridges.wake = -1 ;
+	  bridges.in = OFC_NULL ;
+	}
+    }
+  return (bridges.hThread != OFC_HANDLE_NULL) ;
+}
+
+OFC_VOID pipe_bridge_startup (const OFC_FS_PIPE_BRIDGE_OPS *ops)
+{
+  bridges.lock = ofc_lock_init () ;
+  bridges.ops = ops ;
+  bridges.hThread = OFC_HANDLE_NULL ;
+  bridges.epoll = -1 ;
+  bridges.wake = -1 ;
+  bridges.first = OFC_NULL ;
+  bridges.ready = OFC_NULL ;
+  bridges.dead = OFC_NULL ;
+  bridges.in = OFC_NULL ;
+}
+
+OFC_VOID pipe_bridge_shutdown (OFC_VOID)
+{
+  OFC_FS_PIPE_BRIDGE *bridge ;
+
+  if (bridges.hThread != OFC_HANDLE_NULL)
+    {
+      ofc_thread_delete (bridges.hThread) ;
+      pipe_bridge_signal () ;
+      ofc_thread_wait (bridges.hThread) ;
+      bridges.hThread = OFC_HANDLE_NULL ;
+    }
+
+  /*
+   * The forwarder is gone so what is left can be torn down here
+   */
+  ofc_lock (bridges.lock) ;
+  for (bridge = bridges.first ; bridge != OFC_NULL ; bridge = bridges.first)
+    {
+      ofc_unlock (bridges.lock) ;
+      pipe_bridge_teardown (bridge) ;
+      ofc_lock (bridges.lock) ;
+    }
+  ofc_unlock (bridges.lock) ;
+  pipe_bridge_reap () ;
+
+  if (bridges.epoll >= 0)
+    close (bridges.epoll) ;
+  if (bridges.wake >= 0)
+    close (bridges.wake) ;
+  if (bridges.in != OFC_NULL)
+    ofc_free (bridges.in) ;
+  bridges.epoll = -1 ;
+  bridges.wake = -1 ;
+  bridges.in = OFC_NULL ;
+  ofc_lock_destroy (bridges.lock) ;
+}
+
+OFC_FS_PIPE_BRIDGE *pipe_bridge_connect (const OFC_CHAR *path,
+					 OFC_VOID *context)
+{
+  OFC_FS_PIPE_BRIDGE *bridge ;
+  struct sockaddr_un addr ;
+  int sock ;
+
+  bridge = OFC_NULL ;
+  if (strlen (path) >= sizeof (addr.sun_path))
+    pipe_bridge_error (OFC_ERROR_INVALID_PARAMETER) ;
+  else
+    {
+      memset (&addr, 0, sizeof (addr)) ;
+      addr.sun_family = AF_UNIX ;
+      strcpy (addr.sun_path, path) ;
+
+      sock = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) ;
+      if (sock < 0)
+	pipe_bridge_error (OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      else if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+	{
+	  /*
+	   * A local connect completes at once unless the listener's
+	   * backlog is full
+	   */
+	  if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    pipe_bridge_error (OFC_ERROR_PIPE_BUSY) ;
+	  else
+	    pipe_bridge_error (OFC_ERROR_FILE_NOT_FOUND) ;
+	  close (sock) ;
+	}
+      else
+	{
+	  bridge = ofc_malloc (sizeof (OFC_FS_PIPE_BRIDGE)) ;
+	  if (bridge != OFC_NULL)
+	    {
+	      bridge->out = ofc_malloc (PIPE_BRIDGE_BATCH) ;
+	      if (bridge->out == OFC_NULL)
+		{
+		  ofc_free (bridge) ;
+		  bridge = OFC_NULL ;
+		}
+	    }
+
+	  if (bridge == OFC_NULL)
+	    {
+	      pipe_bridge_error (OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	      close (sock) ;
+	    }
+	  else
+	    {
+	      bridge->next = OFC_NULL ;
+	      bridge->prev = OFC_NULL ;
+	      bridge->ready_next = OFC_NULL ;
+	      bridge->ready = OFC_FALSE ;
+	      bridge->context = context ;
+	      bridge->sock = sock ;
+	      bridge->out_len = 0 ;
+	      bridge->out_offset = 0 ;
+	      bridge->blocked = OFC_FALSE ;
+	      bridge->closed = OFC_FALSE ;
+	      bridge->dead = OFC_FALSE ;
+	    }
+	}
+    }
+  return (bridge) ;
+}
+
+OFC_BOOL pipe_bridge_start (OFC_FS_PIPE_BRIDGE *bridge)
+{
+  struct epoll_event event ;
+  OFC_BOOL ret ;
+
+  ofc_lock (bridges.lock) ;
+  ret = pipe_bridge_run () ;
+  if (ret)
+    {
+      bridge->prev = OFC_NULL ;
+      bridge->next = bridges.first ;
+      if (bridges.first != OFC_NULL)
+	bridges.first->prev = bridge ;
+      bridges.first = bridge ;
+    }
+  ofc_unlock (bridges.lock) ;
+
+  if (ret)
+    {
+      event.events = EPOLLIN | EPOLLRDHUP ;
+      event.data.ptr = bridge ;
+      ret = epoll_ctl (bridges.epoll, EPOLL_CTL_ADD, bridge->sock,
+		       &event) == 0 ;
+      if (ret)
+	{
+	  /* Anything the user wrote before now is sent on the first pass */
+	  pipe_bridge_notify (bridge) ;
+	}
+      else
+	{
+	  /* The forwarder has never seen it so it can go straight away */
+	  ofc_lock (bridges.lock) ;
+	  if (bridge->prev == OFC_NULL)
+	    bridges.first = bridge->next ;
+	  else
+	    bridge->prev->next = bridge->next ;
+	  if (bridge->next != OFC_NULL)
+	    bridge->next->prev = bridge->prev ;
+	  ofc_unlock (bridges.lock) ;
+	}
+    }
+
+  if (!ret)
+    {
+      close (bridge->sock) ;
+      ofc_free (bridge->out) ;
+      ofc_free (bridge) ;
+      pipe_bridge_error (OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+    }
+  return (ret) ;
+}
+
+OFC_VOID pipe_bridge_notify (OFC_FS_PIPE_BRIDGE *bridge)
+{
+  OFC_BOOL idle ;
+
+  idle = OFC_FALSE ;
+  ofc_lock (bridges.lock) ;
+  if (!bridge->ready)
+    {
+      /*
+       * The forwarder only needs waking when the list goes from empty
+       * to not, since it drains all of it on each wake
+       */
+      idle = bridges.ready == OFC_NULL ;
+      bridge->ready = OFC_TRUE ;
+      bridge->ready_next = bridges.ready ;
+      bridges.ready = bridge ;
+    }
+  ofc_unlock (bridges.lock) ;
+
+  if (idle)
+    pipe_bridge_signal () ;
+}
+
+/** \} */
@@ -0,0 +1,66 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_FSPIPE_BRIDGE_H__)
+#define __OFC_FSPIPE_BRIDGE_H__
+
+#include "ofc/types.h"
+
+/*
+ * Forwarding between pipes and local stream sockets.  Internal to the
+ * pipe handler.
+ *
+ * Every bridge is served by one forwarder thread waiting on all the
+ * sockets at once.  The forwarder never blocks on a pipe: the pipe
+ * handler hands it what the user wrote through drain, takes what the
+ * socket sent through fill and tells it there is more to drain with
+ * pipe_bridge_notify.  Errors are returned in OfcLastError.
+ */
+typedef struct _OFC_FS_PIPE_BRIDGE OFC_FS_PIPE_BRIDGE ;
+
+typedef struct
+{
+  /*
+   * Take up to len bytes the user has written.  *closed is set once
+   * the user has closed its end and nothing is left.
+   */
+  OFC_DWORD (*drain) (OFC_VOID *context, OFC_CHAR *buffer, OFC_DWORD len,
+		      OFC_BOOL *closed) ;
+  /* Queue bytes for the user.  OFC_FALSE once the user has closed */
+  OFC_BOOL (*fill) (OFC_VOID *context, const OFC_CHAR *buffer,
+		    OFC_DWORD len) ;
+  /* The bridge is gone.  context is not used again after this */
+  OFC_VOID (*close) (OFC_VOID *context) ;
+} OFC_FS_PIPE_BRIDGE_OPS ;
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+  /* Called once from OfcFSPipeStartup */
+  OFC_VOID pipe_bridge_startup (const OFC_FS_PIPE_BRIDGE_OPS *ops) ;
+  /* Stop the forwarder and close every bridge still open */
+  OFC_VOID pipe_bridge_shutdown (OFC_VOID) ;
+  /*
+   * Connect to the socket at path.  The bridge does not forward until
+   * it is started.  OFC_NULL if the socket can't be reached.
+   */
+  OFC_FS_PIPE_BRIDGE *pipe_bridge_connect (const OFC_CHAR *path,
+					   OFC_VOID *context) ;
+  /*
+   * Hand a connected bridge to the forwarder.  If that fails the
+   * bridge is released without calling close.
+   */
+  OFC_BOOL pipe_bridge_start (OFC_FS_PIPE_BRIDGE *bridge) ;
+  /*
+   * The user has written or closed.  Safe to call with the pipe lock
+   * held.
+   */
+  OFC_VOID pipe_bridge_notify (OFC_FS_PIPE_BRIDGE *bridge) ;
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
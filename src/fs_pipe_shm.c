@@ -0,0 +1,787 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ofc/types.h"
+#include "ofc/libc.h"
+#include "ofc/heap.h"
+#include "ofc/thread.h"
+#include "ofc/lock.h"
+#include "ofc/file.h"
+
+#include "fs_pipe_shm.h"
+
+/**
+ * \defgroup pipe_shm Pipe Shared Memory Transport
+ * \ingroup pipe
+ */
+
+/** \{ */
+
+#define PIPE_SHM_REGISTRY_NAME "/ofc_pipe_registry"
+#define PIPE_SHM_SLOTS 256
+#define PIPE_SHM_KEY_MAX 128
+#define PIPE_SHM_NAME_MAX 64
+#define PIPE_SHM_RING_MIN 4096
+#define PIPE_SHM_RING_DEFAULT (64 * 1024)
+#define PIPE_SHM_RING_MAX (64 * 1024 * 1024)
+
+#define PIPE_SHM_SERVER 0
+#define PIPE_SHM_CLIENT 1
+
+/*
+ * A registry slot.  The low half of the word is the state and the
+ * high half a generation bumped each time the slot is published, so a
+ * server withdrawing its instance can't free a slot that a client has
+ * claimed and another server has reused since.
+ */
+#define PIPE_SHM_SLOT_FREE 0
+#define PIPE_SHM_SLOT_BUSY 1
+#define PIPE_SHM_SLOT_LISTENING 2
+
+#define PIPE_SHM_STATE(word) ((OFC_UINT32) ((word) & 0xffffffff))
+#define PIPE_SHM_WORD(gen, state) \
+  (((OFC_UINT64) (gen) << 32) | (OFC_UINT64) (state))
+
+typedef struct
+{
+  OFC_UINT64 word ;
+  pid_t pid ;
+  OFC_CHAR key[PIPE_SHM_KEY_MAX] ;
+  OFC_CHAR segment[PIPE_SHM_NAME_MAX] ;
+} PIPE_SHM_SLOT ;
+
+typedef struct
+{
+  PIPE_SHM_SLOT slots[PIPE_SHM_SLOTS] ;
+} PIPE_SHM_REGISTRY ;
+
+/*
+ * One direction.  Offsets run freely and are masked on use.  The
+ * sequence words are what a blocked reader or writer waits on.
+ */
+typedef struct
+{
+  OFC_UINT32 head ;
+  OFC_UINT32 tail ;
+  OFC_UINT32 data_seq ;
+  OFC_UINT32 space_seq ;
+  OFC_UINT32 reader_waiting ;
+  OFC_UINT32 writer_waiting ;
+} PIPE_SHM_RING ;
+
+/*
+ * Head of an instance segment.  The data of ring 0 (client to server)
+ * and then ring 1 (server to client) follow it.
+ */
+typedef struct
+{
+  OFC_UINT32 connected ;
+  OFC_UINT32 closed[2] ;
+  OFC_UINT32 ring_size ;
+  PIPE_SHM_RING rings[2] ;
+} PIPE_SHM_SEGMENT ;
+
+#define PIPE_SHM_HEADER_SIZE \
+  ((sizeof (PIPE_SHM_SEGMENT) + 63) & ~(OFC_SIZET) 63)
+
+struct _OFC_FS_PIPE_SHM
+{
+  PIPE_SHM_SEGMENT *segment ;
+  OFC_SIZET length ;
+  OFC_CHAR name[PIPE_SHM_NAME_MAX] ;
+  OFC_INT end ;
+  /* Registry slot and word while published, -1 otherwise */
+  OFC_INT slot ;
+  OFC_UINT64 word ;
+  OFC_UINT spin_count ;
+  /*
+   * Holds on the mapping.  The owner's is dropped by close and the
+   * segment is unmapped with the last one.
+   */
+  OFC_UINT32 users ;
+  /* Serialize the readers and the writers of this end */
+  OFC_LOCK read_lock ;
+  OFC_LOCK write_lock ;
+  /* Bytes of the message being read that have not been returned */
+  OFC_UINT32 remaining ;
+  OFC_BOOL in_message ;
+} ;
+
+static PIPE_SHM_REGISTRY *pipe_shm_registry ;
+static OFC_UINT32 pipe_shm_sequence ;
+
+static OFC_VOID pipe_shm_futex_wait (OFC_UINT32 *word, OFC_UINT32 value)
+{
+  syscall (SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0) ;
+}
+
+static OFC_VOID pipe_shm_futex_wake (OFC_UINT32 *word)
+{
+  syscall (SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0) ;
+}
+
+static OFC_VOID pipe_shm_pause (OFC_VOID)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause () ;
+#elif defined(__aarch64__)
+  __asm__ __volatile__ ("yield") ;
+#endif
+}
+
+static OFC_BOOL pipe_shm_alive (pid_t pid)
+{
+  return (kill (pid, 0) == 0 || errno != ESRCH) ;
+}
+
+static OFC_CHAR *pipe_shm_data (PIPE_SHM_SEGMENT *segment, OFC_INT ring)
+{
+  return ((OFC_CHAR *) segment + PIPE_SHM_HEADER_SIZE +
+	  (OFC_SIZET) ring * segment->ring_size) ;
+}
+
+/*
+ * Wait for a sequence word to move on from a value read before the
+ * caller found it had to wait.  The waiting flag lets the other side
+ * skip the wake system call when nobody is blocked.  Both sides order
+ * the flag and the sequence with full fences so one of them always
+ * sees the other.
+ */
+static OFC_VOID pipe_shm_wait (OFC_UINT32 *seq, OFC_UINT32 *waiting,
+			       OFC_UINT32 value)
+{
+  __atomic_store_n (waiting, 1, __ATOMIC_SEQ_CST) ;
+  if (__atomic_load_n (seq, __ATOMIC_SEQ_CST) == value)
+    pipe_shm_futex_wait (seq, value) ;
+  __atomic_store_n (waiting, 0, __ATOMIC_RELAXED) ;
+}
+
+static OFC_VOID pipe_shm_signal (OFC_UINT32 *seq, OFC_UINT32 *waiting)
+{
+  __atomic_fetch_add (seq, 1, __ATOMIC_SEQ_CST) ;
+  if (__atomic_load_n (waiting, __ATOMIC_SEQ_CST))
+    pipe_shm_futex_wake (seq) ;
+}
+
+/*
+ * Copy bytes into or out of the ring.  Called with the write or read
+ * lock of the end held so offsets need no further protection.
+ */
+static OFC_VOID pipe_shm_copy_in (OFC_FS_PIPE_SHM *shm, OFC_INT ring,
+				  OFC_UINT32 offset, const OFC_CHAR *src,
+				  OFC_UINT32 len)
+{
+  OFC_CHAR *data ;
+  OFC_UINT32 pos ;
+  OFC_UINT32 first ;
+
+  data = pipe_shm_data (shm->segment, ring) ;
+  pos = offset & (shm->segment->ring_size - 1) ;
+  first = OFC_MIN (len, shm->segment->ring_size - pos) ;
+  ofc_memcpy (data + pos, src, first) ;
+  ofc_memcpy (data, src + first, len - first) ;
+}
+
+static OFC_VOID pipe_shm_copy_out (OFC_FS_PIPE_SHM *shm, OFC_INT ring,
+				   OFC_UINT32 offset, OFC_CHAR *dst,
+				   OFC_UINT32 len)
+{
+  OFC_CHAR *data ;
+  OFC_UINT32 pos ;
+  OFC_UINT32 first ;
+
+  data = pipe_shm_data (shm->segment, ring) ;
+  pos = offset & (shm->segment->ring_size - 1) ;
+  first = OFC_MIN (len, shm->segment->ring_size - pos) ;
+  ofc_memcpy (dst, data + pos, first) ;
+  ofc_memcpy (dst + first, data, len - first) ;
+}
+
+/*
+ * Write bytes to the ring this end writes, blocking while it is full.
+ * Bytes are published as they fit so a message larger than the ring
+ * streams through it.
+ */
+static OFC_BOOL pipe_shm_put (OFC_FS_PIPE_SHM *shm, const OFC_CHAR *src,
+			      OFC_UINT32 len)
+{
+  PIPE_SHM_SEGMENT *segment ;
+  PIPE_SHM_RING *ring ;
+  OFC_INT index ;
+  OFC_UINT32 head ;
+  OFC_UINT32 tail ;
+  OFC_UINT32 space ;
+  OFC_UINT32 seq ;
+  OFC_UINT32 n ;
+  OFC_UINT spin ;
+  OFC_BOOL ret ;
+
+  segment = shm->segment ;
+  index = shm->end == PIPE_SHM_SERVER ? 1 : 0 ;
+  ring = &segment->rings[index] ;
+  head = ring->head ;
+  ret = OFC_TRUE ;
+  spin = 0 ;
+
+  while (ret && len > 0)
+    {
+      seq = __atomic_load_n (&ring->space_seq, __ATOMIC_ACQUIRE) ;
+      tail = __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE) ;
+      space = segment->ring_size - (head - tail) ;
+      if (__atomic_load_n (&segment->closed[shm->end], __ATOMIC_ACQUIRE))
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+	  ret = OFC_FALSE ;
+	}
+      else if (__atomic_load_n (&segment->closed[!shm->end],
+				__ATOMIC_ACQUIRE))
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_NO_DATA) ;
+	  ret = OFC_FALSE ;
+	}
+      else if (space > 0)
+	{
+	  n = OFC_MIN (len, space) ;
+	  pipe_shm_copy_in (shm, index, head, src, n) ;
+	  head += n ;
+	  src += n ;
+	  len -= n ;
+	  __atomic_store_n (&ring->head, head, __ATOMIC_RELEASE) ;
+	  pipe_shm_signal (&ring->data_seq, &ring->reader_waiting) ;
+	  spin = 0 ;
+	}
+      else if (spin < shm->spin_count)
+	{
+	  pipe_shm_pause () ;
+	  spin++ ;
+	}
+      else
+	pipe_shm_wait (&ring->space_seq, &ring->writer_waiting, seq) ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Read bytes from the ring this end reads, blocking until they have
+ * all arrived.  Data written before the peer closed is still returned.
+ */
+static OFC_BOOL pipe_shm_get (OFC_FS_PIPE_SHM *shm, OFC_CHAR *dst,
+			      OFC_UINT32 len)
+{
+  PIPE_SHM_SEGMENT *segment ;
+  PIPE_SHM_RING *ring ;
+  OFC_INT index ;
+  OFC_UINT32 head ;
+  OFC_UINT32 tail ;
+  OFC_UINT32 seq ;
+  OFC_UINT32 n ;
+  OFC_UINT spin ;
+  OFC_BOOL closed ;
+  OFC_BOOL ret ;
+
+  segment = shm->segment ;
+  index = shm->end == PIPE_SHM_SERVER ? 0 : 1 ;
+  ring = &segment->rings[index] ;
+  tail = ring->tail ;
+  ret = OFC_TRUE ;
+  spin = 0 ;
+
+  while (ret && len > 0)
+    {
+      seq = __atomic_load_n (&ring->data_seq, __ATOMIC_ACQUIRE) ;
+      closed = __atomic_load_n (&segment->closed[!shm->end],
+				__ATOMIC_ACQUIRE) ;
+      head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) ;
+      if (__atomic_load_n (&segment->closed[shm->end], __ATOMIC_ACQUIRE))
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+	  ret = OFC_FALSE ;
+	}
+      else if (head != tail)
+	{
+	  n = OFC_MIN (len, head - tail) ;
+	  pipe_shm_copy_out (shm, index, tail, dst, n) ;
+	  tail += n ;
+	  dst += n ;
+	  len -= n ;
+	  __atomic_store_n (&ring->tail, tail, __ATOMIC_RELEASE) ;
+	  pipe_shm_signal (&ring->space_seq, &ring->writer_waiting) ;
+	  spin = 0 ;
+	}
+      else if (closed)
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_BROKEN_PIPE) ;
+	  ret = OFC_FALSE ;
+	}
+      else if (spin < shm->spin_count)
+	{
+	  pipe_shm_pause () ;
+	  spin++ ;
+	}
+      else
+	pipe_shm_wait (&ring->data_seq, &ring->reader_waiting, seq) ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Bytes ready in the ring this end reads
+ */
+static OFC_UINT32 pipe_shm_ready (OFC_FS_PIPE_SHM *shm)
+{
+  PIPE_SHM_RING *ring ;
+
+  ring = &shm->segment->rings[shm->end == PIPE_SHM_SERVER ? 0 : 1] ;
+  return (__atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) - ring->tail) ;
+}
+
+static OFC_FS_PIPE_SHM *pipe_shm_alloc (OFC_VOID)
+{
+  OFC_FS_PIPE_SHM *shm ;
+
+  shm = ofc_malloc (sizeof (OFC_FS_PIPE_SHM)) ;
+  if (shm != OFC_NULL)
+    {
+      ofc_memset (shm, 0, sizeof (OFC_FS_PIPE_SHM)) ;
+      shm->slot = -1 ;
+      shm->users = 1 ;
+      shm->read_lock = ofc_lock_init () ;
+      shm->write_lock = ofc_lock_init () ;
+    }
+  return (shm) ;
+}
+
+static OFC_VOID pipe_shm_unmap (OFC_FS_PIPE_SHM *shm)
+{
+  if (shm->segment != OFC_NULL)
+    munmap (shm->segment, shm->length) ;
+  ofc_lock_destroy (shm->read_lock) ;
+  ofc_lock_destroy (shm->write_lock) ;
+  ofc_free (shm) ;
+}
+
+/*
+ * Free a slot published by a process that has gone away, along with
+ * its segment
+ */
+static OFC_VOID pipe_shm_reap (PIPE_SHM_SLOT *slot, OFC_UINT64 word)
+{
+  OFC_CHAR name[PIPE_SHM_NAME_MAX] ;
+
+  if (PIPE_SHM_STATE (word) == PIPE_SHM_SLOT_LISTENING &&
+      !pipe_shm_alive (slot->pid) &&
+      __atomic_compare_exchange_n (&slot->word, &word,
+				   PIPE_SHM_WORD (word >> 32,
+						  PIPE_SHM_SLOT_BUSY),
+				   OFC_FALSE, __ATOMIC_ACQUIRE,
+				   __ATOMIC_RELAXED))
+    {
+      ofc_memcpy (name, slot->segment, sizeof (name)) ;
+      __atomic_store_n (&slot->word,
+			PIPE_SHM_WORD (word >> 32, PIPE_SHM_SLOT_FREE),
+			__ATOMIC_RELEASE) ;
+      shm_unlink (name) ;
+    }
+}
+
+OFC_VOID pipe_shm_startup (OFC_VOID)
+{
+  OFC_INT fd ;
+  OFC_VOID *map ;
+
+  pipe_shm_registry = OFC_NULL ;
+  /*
+   * The first process creates the registry.  A new segment reads as
+   * zeros, which is every slot free.
+   */
+  fd = shm_open (PIPE_SHM_REGISTRY_NAME, O_CREAT | O_RDWR, 0600) ;
+  if (fd >= 0)
+    {
+      if (ftruncate (fd, sizeof (PIPE_SHM_REGISTRY)) == 0)
+	{
+	  map = mmap (NULL, sizeof (PIPE_SHM_REGISTRY),
+		      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+	  if (map != MAP_FAILED)
+	    pipe_shm_registry = map ;
+	}
+      close (fd) ;
+    }
+}
+
+OFC_VOID pipe_shm_shutdown (OFC_VOID)
+{
+  if (pipe_shm_registry != OFC_NULL)
+    munmap (pipe_shm_registry, sizeof (PIPE_SHM_REGISTRY)) ;
+  pipe_shm_registry = OFC_NULL ;
+}
+
+OFC_FS_PIPE_SHM *pipe_shm_listen (const OFC_CHAR *key,
+				  OFC_DWORD ring_size,
+				  OFC_UINT spin_count)
+{
+  OFC_FS_PIPE_SHM *shm ;
+  PIPE_SHM_SLOT *slot ;
+  OFC_UINT32 size ;
+  OFC_UINT64 word ;
+  OFC_VOID *map ;
+  OFC_INT fd ;
+  OFC_INT i ;
+
+  shm = OFC_NULL ;
+  if (pipe_shm_registry == OFC_NULL || ofc_strlen (key) >= PIPE_SHM_KEY_MAX)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_INVALID_PARAMETER) ;
+  else
+    shm = pipe_shm_alloc () ;
+
+  if (shm != OFC_NULL)
+    {
+      if (ring_size == 0)
+	ring_size = PIPE_SHM_RING_DEFAULT ;
+      ring_size = OFC_MIN (ring_size, PIPE_SHM_RING_MAX) ;
+      for (size = PIPE_SHM_RING_MIN ; size < ring_size ; size <<= 1) ;
+
+      shm->end = PIPE_SHM_SERVER ;
+      shm->spin_count = spin_count ;
+      shm->length = PIPE_SHM_HEADER_SIZE + 2 * (OFC_SIZET) size ;
+      ofc_snprintf (shm->name, sizeof (shm->name), "/ofc_pipe.%d.%u",
+		(int) getpid (),
+		__atomic_fetch_add (&pipe_shm_sequence, 1, __ATOMIC_RELAXED)) ;
+
+      map = MAP_FAILED ;
+      fd = shm_open (shm->name, O_CREAT | O_EXCL | O_RDWR, 0600) ;
+      if (fd >= 0)
+	{
+	  if (ftruncate (fd, shm->length) == 0)
+	    map = mmap (NULL, shm->length, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0) ;
+	  close (fd) ;
+	}
+
+      if (map == MAP_FAILED)
+	{
+	  if (fd >= 0)
+	    shm_unlink (shm->name) ;
+	  pipe_shm_unmap (shm) ;
+	  shm = OFC_NULL ;
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR)
+				   OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	}
+      else
+	{
+	  shm->segment = map ;
+	  shm->segment->ring_size = size ;
+	}
+    }
+
+  if (shm != OFC_NULL)
+    {
+      /*
+       * Publish the instance.  The slot is filled while busy and only
+       * then marked listening.
+       */
+      for (i = 0 ; shm->slot < 0 && i < PIPE_SHM_SLOTS ; i++)
+	{
+	  slot = &pipe_shm_registry->slots[i] ;
+	  word = __atomic_load_n (&slot->word, __ATOMIC_ACQUIRE) ;
+	  pipe_shm_reap (slot, word) ;
+	  word = __atomic_load_n (&slot->word, __ATOMIC_ACQUIRE) ;
+	  if (PIPE_SHM_STATE (word) == PIPE_SHM_SLOT_FREE &&
+	      __atomic_compare_exchange_n (&slot->word, &word,
+					   PIPE_SHM_WORD (word >> 32,
+							  PIPE_SHM_SLOT_BUSY),
+					   OFC_FALSE, __ATOMIC_ACQUIRE,
+					   __ATOMIC_RELAXED))
+	    {
+	      slot->pid = getpid () ;
+	      ofc_strncpy (slot->key, key, PIPE_SHM_KEY_MAX) ;
+	      ofc_memcpy (slot->segment, shm->name, PIPE_SHM_NAME_MAX) ;
+	      shm->slot = i ;
+	      shm->word = PIPE_SHM_WORD ((word >> 32) + 1,
+					 PIPE_SHM_SLOT_LISTENING) ;
+	      __atomic_store_n (&slot->word, shm->word, __ATOMIC_RELEASE) ;
+	    }
+	}
+
+      if (shm->slot < 0)
+	{
+	  shm_unlink (shm->name) ;
+	  pipe_shm_unmap (shm) ;
+	  shm = OFC_NULL ;
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_PIPE_BUSY) ;
+	}
+    }
+
+  return (shm) ;
+}
+
+OFC_BOOL pipe_shm_accept (OFC_FS_PIPE_SHM *shm)
+{
+  PIPE_SHM_SEGMENT *segment ;
+  OFC_BOOL ret ;
+
+  segment = shm->segment ;
+  while (!__atomic_load_n (&segment->connected, __ATOMIC_ACQUIRE))
+    pipe_shm_futex_wait (&segment->connected, 0) ;
+  /*
+   * Closing the end also sets connected to release us.  Otherwise the
+   * client released the slot when it claimed it.
+   */
+  ret = OFC_TRUE ;
+  if (__atomic_load_n (&segment->closed[shm->end], __ATOMIC_ACQUIRE))
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_INVALID_HANDLE) ;
+      ret = OFC_FALSE ;
+    }
+  else
+    __atomic_store_n (&shm->slot, -1, __ATOMIC_RELAXED) ;
+  return (ret) ;
+}
+
+OFC_FS_PIPE_SHM *pipe_shm_connect (const OFC_CHAR *key,
+				   OFC_UINT spin_count)
+{
+  OFC_FS_PIPE_SHM *shm ;
+  PIPE_SHM_SLOT *slot ;
+  OFC_CHAR name[PIPE_SHM_NAME_MAX] ;
+  OFC_UINT64 word ;
+  OFC_BOOL claimed ;
+  struct stat st ;
+  OFC_VOID *map ;
+  OFC_INT fd ;
+  OFC_INT i ;
+
+  shm = OFC_NULL ;
+  for (i = 0 ; pipe_shm_registry != OFC_NULL && shm == OFC_NULL &&
+	 i < PIPE_SHM_SLOTS ; i++)
+    {
+      slot = &pipe_shm_registry->slots[i] ;
+      word = __atomic_load_n (&slot->word, __ATOMIC_ACQUIRE) ;
+      pipe_shm_reap (slot, word) ;
+      word = __atomic_load_n (&slot->word, __ATOMIC_ACQUIRE) ;
+      /*
+       * The key is compared before the slot is claimed so may be torn.
+       * That only costs a wasted claim since it is checked again.
+       */
+      claimed = OFC_FALSE ;
+      if (PIPE_SHM_STATE (word) == PIPE_SHM_SLOT_LISTENING &&
+	  ofc_strncmp (slot->key, key, PIPE_SHM_KEY_MAX) == 0 &&
+	  __atomic_compare_exchange_n (&slot->word, &word,
+				       PIPE_SHM_WORD (word >> 32,
+						      PIPE_SHM_SLOT_BUSY),
+				       OFC_FALSE, __ATOMIC_ACQUIRE,
+				       __ATOMIC_RELAXED))
+	{
+	  claimed = ofc_strncmp (slot->key, key, PIPE_SHM_KEY_MAX) == 0 ;
+	  ofc_memcpy (name, slot->segment, sizeof (name)) ;
+	  if (claimed)
+	    __atomic_store_n (&slot->word,
+			      PIPE_SHM_WORD (word >> 32, PIPE_SHM_SLOT_FREE),
+			      __ATOMIC_RELEASE) ;
+	  else
+	    __atomic_store_n (&slot->word, word, __ATOMIC_RELEASE) ;
+	}
+
+      if (claimed)
+	{
+	  map = MAP_FAILED ;
+	  fd = shm_open (name, O_RDWR, 0600) ;
+	  if (fd >= 0)
+	    {
+	      if (fstat (fd, &st) == 0 &&
+		  (OFC_SIZET) st.st_size > PIPE_SHM_HEADER_SIZE)
+		map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, fd, 0) ;
+	      close (fd) ;
+	      /*
+	       * Nobody else can attach now so the name is not needed.
+	       * Dropping it here means a crashed server does not leak it.
+	       */
+	      shm_unlink (name) ;
+	    }
+	  /*
+	   * A server that withdrew after we claimed its slot is skipped
+	   */
+	  if (map != MAP_FAILED)
+	    {
+	      shm = pipe_shm_alloc () ;
+	      if (shm == OFC_NULL)
+		munmap (map, st.st_size) ;
+	      else
+		{
+		  shm->segment = map ;
+		  shm->length = st.st_size ;
+		  ofc_memcpy (shm->name, name, sizeof (shm->name)) ;
+		  shm->end = PIPE_SHM_CLIENT ;
+		  shm->spin_count = spin_count ;
+		  __atomic_store_n (&shm->segment->connected, 1,
+				    __ATOMIC_RELEASE) ;
+		  pipe_shm_futex_wake (&shm->segment->connected) ;
+		}
+	    }
+	}
+    }
+
+  if (shm == OFC_NULL)
+    ofc_thread_set_variable (OfcLastError,
+			     (OFC_DWORD_PTR) OFC_ERROR_FILE_NOT_FOUND) ;
+  return (shm) ;
+}
+
+OFC_BOOL pipe_shm_write (OFC_FS_PIPE_SHM *shm,
+			 const OFC_VOID *buffer,
+			 OFC_DWORD len,
+			 OFC_DWORD *written)
+{
+  OFC_UINT32 header ;
+  OFC_BOOL ret ;
+
+  *written = 0 ;
+  header = len ;
+  ofc_lock (shm->write_lock) ;
+  ret = pipe_shm_put (shm, (const OFC_CHAR *) &header, sizeof (header)) &&
+    pipe_shm_put (shm, buffer, len) ;
+  ofc_unlock (shm->write_lock) ;
+  if (ret)
+    *written = len ;
+  return (ret) ;
+}
+
+OFC_BOOL pipe_shm_read (OFC_FS_PIPE_SHM *shm,
+			OFC_VOID *buffer,
+			OFC_DWORD len,
+			OFC_DWORD *read,
+			OFC_BOOL byte_mode)
+{
+  OFC_UINT32 header ;
+  OFC_UINT32 n ;
+  OFC_BOOL more ;
+  OFC_BOOL ret ;
+
+  *read = 0 ;
+  ret = OFC_TRUE ;
+  ofc_lock (shm->read_lock) ;
+  /*
+   * Block for the first message only.  In byte mode the read goes on
+   * into the messages behind it while their bytes are already there.
+   */
+  for (more = OFC_TRUE ; ret && more ; )
+    {
+      if (!shm->in_message)
+	{
+	  ret = pipe_shm_get (shm, (OFC_CHAR *) &header, sizeof (header)) ;
+	  if (ret)
+	    {
+	      shm->remaining = header ;
+	      shm->in_message = OFC_TRUE ;
+	    }
+	}
+
+      if (ret)
+	{
+	  n = OFC_MIN (len - *read, shm->remaining) ;
+	  if (*read > 0)
+	    n = OFC_MIN (n, pipe_shm_ready (shm)) ;
+	  ret = pipe_shm_get (shm, (OFC_CHAR *) buffer + *read, n) ;
+	  if (ret)
+	    {
+	      *read += n ;
+	      shm->remaining -= n ;
+	      if (shm->remaining == 0)
+		shm->in_message = OFC_FALSE ;
+	    }
+	}
+
+      more = byte_mode && *read < len && !shm->in_message &&
+	pipe_shm_ready (shm) >= sizeof (header) ;
+    }
+
+  if (ret && !byte_mode && shm->in_message)
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_MORE_DATA) ;
+      ret = OFC_FALSE ;
+    }
+  ofc_unlock (shm->read_lock) ;
+  return (ret) ;
+}
+
+OFC_VOID pipe_shm_hold (OFC_FS_PIPE_SHM *shm)
+{
+  __atomic_fetch_add (&shm->users, 1, __ATOMIC_RELAXED) ;
+}
+
+OFC_VOID pipe_shm_release (OFC_FS_PIPE_SHM *shm)
+{
+  if (__atomic_fetch_sub (&shm->users, 1, __ATOMIC_ACQ_REL) == 1)
+    pipe_shm_unmap (shm) ;
+}
+
+OFC_VOID pipe_shm_close (OFC_FS_PIPE_SHM *shm)
+{
+  PIPE_SHM_SEGMENT *segment ;
+  PIPE_SHM_SLOT *slot ;
+  OFC_UINT64 word ;
+  OFC_INT index ;
+  OFC_INT i ;
+
+  segment = shm->segment ;
+  /*
+   * Withdraw an instance nobody has claimed.  If a client claimed it
+   * in the meantime it finds the segment closed or already gone.
+   */
+  index = __atomic_load_n (&shm->slot, __ATOMIC_RELAXED) ;
+  if (index >= 0 && pipe_shm_registry != OFC_NULL)
+    {
+      slot = &pipe_shm_registry->slots[index] ;
+      word = shm->word ;
+      __atomic_compare_exchange_n (&slot->word, &word,
+				   PIPE_SHM_WORD (word >> 32,
+						  PIPE_SHM_SLOT_FREE),
+				   OFC_FALSE, __ATOMIC_RELEASE,
+				   __ATOMIC_RELAXED) ;
+    }
+
+  /*
+   * Release anyone blocked on this end.  They fail once they see it
+   * closed and their holds keep the mapping until they have left.
+   */
+  __atomic_store_n (&segment->closed[shm->end], 1, __ATOMIC_RELEASE) ;
+  __atomic_store_n (&segment->connected, 1, __ATOMIC_RELEASE) ;
+  pipe_shm_futex_wake (&segment->connected) ;
+  for (i = 0 ; i < 2 ; i++)
+    {
+      __atomic_fetch_add (&segment->rings[i].data_seq, 1, __ATOMIC_SEQ_CST) ;
+      __atomic_fetch_add (&segment->rings[i].space_seq, 1,
+			  __ATOMIC_SEQ_CST) ;
+      pipe_shm_futex_wake (&segment->rings[i].data_seq) ;
+      pipe_shm_futex_wake (&segment->rings[i].space_seq) ;
+    }
+
+  if (shm->end == PIPE_SHM_SERVER)
+    shm_unlink (shm->name) ;
+  pipe_shm_release (shm) ;
+}
+
+/** \} */
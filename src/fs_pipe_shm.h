@@ -0,0 +1,73 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_FSPIPE_SHM_H__)
+#define __OFC_FSPIPE_SHM_H__
+
+#include "ofc/types.h"
+
+/*
+ * Shared memory transport between processes.  Internal to the pipe
+ * handler.
+ *
+ * Each shared instance is a segment holding a ring per direction.
+ * Servers waiting for a client are published in a registry segment
+ * that every process maps, keyed by the folded pipe name.  A segment
+ * has one reader and one writer per ring.  Within a process the
+ * readers and the writers of an end are each serialized by a lock of
+ * the end.  An end may be closed while other threads are blocked on
+ * it: they fail and the mapping stays until the last hold is released.
+ * Errors are returned in OfcLastError.
+ */
+typedef struct _OFC_FS_PIPE_SHM OFC_FS_PIPE_SHM ;
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+  /* Map the registry.  Called once from OfcFSPipeStartup */
+  OFC_VOID pipe_shm_startup (OFC_VOID) ;
+  OFC_VOID pipe_shm_shutdown (OFC_VOID) ;
+  /* Create a server instance and publish it under key */
+  OFC_FS_PIPE_SHM *pipe_shm_listen (const OFC_CHAR *key,
+				    OFC_DWORD ring_size,
+				    OFC_UINT spin_count) ;
+  /*
+   * Block until a client has attached to a server instance.  Fails if
+   * the instance is closed first.
+   */
+  OFC_BOOL pipe_shm_accept (OFC_FS_PIPE_SHM *shm) ;
+  /* Attach to a published server instance.  OFC_NULL if none */
+  OFC_FS_PIPE_SHM *pipe_shm_connect (const OFC_CHAR *key,
+				     OFC_UINT spin_count) ;
+  /* Write one message, blocking while the ring is full */
+  OFC_BOOL pipe_shm_write (OFC_FS_PIPE_SHM *shm,
+			   const OFC_VOID *buffer,
+			   OFC_DWORD len,
+			   OFC_DWORD *written) ;
+  /*
+   * Read a message, blocking until one arrives.  A message that does
+   * not fit fails with OFC_ERROR_MORE_DATA and the rest is returned by
+   * the next read.  In byte mode the read never fails for that and
+   * continues into the messages already waiting behind it.
+   */
+  OFC_BOOL pipe_shm_read (OFC_FS_PIPE_SHM *shm,
+			  OFC_VOID *buffer,
+			  OFC_DWORD len,
+			  OFC_DWORD *read,
+			  OFC_BOOL byte_mode) ;
+  /* Keep an instance mapped across a call made without the pipe lock */
+  OFC_VOID pipe_shm_hold (OFC_FS_PIPE_SHM *shm) ;
+  OFC_VOID pipe_shm_release (OFC_FS_PIPE_SHM *shm) ;
+  /*
+   * Withdraw or disconnect an instance, wake anyone blocked on it and
+   * drop the owner's hold
+   */
+  OFC_VOID pipe_shm_close (OFC_FS_PIPE_SHM *shm) ;
+#if defined(__cplusplus)
+}
+#endif
+
+#endif